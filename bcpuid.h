@@ -65,6 +65,7 @@
   	if (id.feature_flags & CPUID_AVX512_dq) printf("avx512_dq ");
   	if (id.feature_flags & CPUID_AVX512_bw) printf("avx512_bw ");
   	if (id.feature_flags & CPUID_AVX512_vl) printf("avx512_vl ");
+  	if (id.feature_flags & CPUID_F16C)      printf("f16c ");
   	printf("\n");
   	printf("--------------------------------------------------\n");
   
@@ -102,6 +103,7 @@ enum FeatureFlags
 	CPUID_AVX512_dq   = (1 << 11),
 	CPUID_AVX512_bw   = (1 << 12),
 	CPUID_AVX512_vl   = (1 << 13),
+	CPUID_F16C        = (1 << 14),
 };
 
 typedef struct CPUID
@@ -263,6 +265,7 @@ CPUID get_CPUID(void)
 	if (b__extract_bit(ecx, 19)) features |= CPUID_SSE41;
 	if (b__extract_bit(ecx, 20)) features |= CPUID_SSE42;
 	if (b__extract_bit(ecx, 28)) features |= CPUID_AVX;
+	if (b__extract_bit(ecx, 29)) features |= CPUID_F16C;
 	
 	if (max_cpuid >= 7)
 	{
@@ -0,0 +1,97 @@
+/*
+  Measures what alignedArray and the over-aligned types buy:
+   - transformPoints over a vec3 array that starts off a 16 byte boundary, versus an
+     alignedArray<vec3> (which takes the aligned path of the SSE2 kernel),
+   - looking up matrices by random index, as in skinning, from a mat4 array at the
+     16 byte alignment malloc gives (every matrix straddles two cache lines) versus
+     an alignedArray<amat4> (every matrix is exactly one cache line).
+
+    g++ -O2 -DBMATH_SIMD -I.. aligned_bench.cpp -o aligned_bench && ./aligned_bench
+*/
+
+#define B_RNG_IMPLEMENTATION
+#include "bmath.hpp"
+#include "brng.h"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+static double seconds() {
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Starts offset bytes after a 64 byte boundary.
+static void *allocateAt(size_t size, size_t offset, void **allocation) {
+	*allocation = std::malloc(size + 64 + offset);
+	size_t start = (size_t(*allocation) + 63) / 64 * 64;
+	return (void *)(start + offset);
+}
+
+static void benchTransform(size_t count, int repeats) {
+	mat4 m = trsMat(vec3(1, 2, 3), normalize(quat(0.1f, 0.2f, 0.3f, 0.9f)), vec3(2, 3, 4));
+	void *inAllocation, *outAllocation;
+	vec3 *in = (vec3 *)allocateAt(count * sizeof(vec3), 4, &inAllocation);
+	vec3 *out = (vec3 *)allocateAt(count * sizeof(vec3), 4, &outAllocation);
+	alignedArray<vec3> points(count), result(count);
+	for (size_t i = 0; i < count; ++i)
+		in[i] = points[i] = vec3(float(i), 1, 2);
+	transformPoints(m, in, out, count); // touch every page first
+	transformPoints(m, points, &result);
+
+	double start = seconds();
+	for (int r = 0; r < repeats; ++r)
+		transformPoints(m, in, out, count);
+	double unaligned = seconds() - start;
+	start = seconds();
+	for (int r = 0; r < repeats; ++r)
+		transformPoints(m, points, &result);
+	double aligned = seconds() - start;
+
+	double scale = 1e9 / (double(count) * repeats);
+	printf("transformPoints %8zu vec3s:  unaligned %5.2f ns  aligned %5.2f ns  (%.2fx)\n",
+		count, unaligned * scale, aligned * scale, unaligned / aligned);
+	std::free(inAllocation);
+	std::free(outAllocation);
+}
+
+static void benchGather(size_t count, size_t lookups) {
+	void *allocation;
+	mat4 *plain = (mat4 *)allocateAt(count * sizeof(mat4), 16, &allocation);
+	alignedArray<amat4> aligned(count);
+	for (size_t i = 0; i < count; ++i)
+		plain[i] = aligned[i] = mat4(float(i % 7) + 1);
+
+	RNG rng = seedRNG(1234);
+	alignedArray<uint> indices(lookups);
+	for (size_t i = 0; i < lookups; ++i)
+		indices[i] = uint(randUniform(&rng, 0, float(count))) % uint(count);
+
+	vec4 v = vec4(1, 2, 3, 1);
+	vec4 sum = vec4(0);
+	double start = seconds();
+	for (size_t i = 0; i < lookups; ++i)
+		sum += plain[indices[i]] * v;
+	double straddling = seconds() - start;
+	start = seconds();
+	for (size_t i = 0; i < lookups; ++i)
+		sum += aligned[indices[i]] * v;
+	double oneLine = seconds() - start;
+
+	double scale = 1e9 / double(lookups);
+	printf("mat4 gather %8zu matrices:  straddling %5.2f ns  cache line %5.2f ns  (%.2fx)  [%g]\n",
+		count, straddling * scale, oneLine * scale, straddling / oneLine, sum.x);
+	std::free(allocation);
+}
+
+int main() {
+	// in L1, in L2 and in memory
+	benchTransform(1000, 20000);
+	benchTransform(50000, 400);
+	benchTransform(4000000, 20);
+
+	benchGather(256, 20000000);
+	benchGather(16384, 20000000);
+	benchGather(1000000, 20000000);
+	return 0;
+}
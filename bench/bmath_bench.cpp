@@ -0,0 +1,243 @@
+/*
+  Cycle counts of the core bmath operations, for float and double and for 2, 3 and 4
+  components where that applies. Each operation runs over an array of random inputs
+  many times, and the fastest run divided by the array size is reported - these are
+  throughput numbers, not latency. The cycles come from rdtsc, which counts at the
+  nominal clock rate, so turn off turbo or pin the clock to compare runs.
+
+  Prints a table and writes the results to a JSON file (bmath_bench.json by default)
+  so that two versions can be diffed:
+
+    g++ -O2 -I.. bmath_bench.cpp -o bmath_bench && ./bmath_bench [output.json]
+    g++ -O2 -DBMATH_SIMD -I.. bmath_bench.cpp -o bmath_bench && ./bmath_bench simd.json
+
+  x86 only.
+*/
+
+#define B_RNG_IMPLEMENTATION
+#include "bmath.hpp"
+#include "brng.h"
+#include <cstdio>
+#include <vector>
+
+#ifdef _MSC_VER
+#	include <intrin.h>
+#	pragma intrinsic(_ReadWriteBarrier)
+#	define clobberMemory() _ReadWriteBarrier()
+#else
+#	include <x86intrin.h>
+#	define clobberMemory() __asm__ __volatile__("" ::: "memory")
+#endif
+
+// Small enough to stay in cache even for dmat4, and long enough for the loop
+// overhead not to matter.
+static const size_t COUNT = 128;
+static const int REPEATS = 200;
+
+struct result {
+	const char *name;
+	const char *type;
+	int n; // 0 if not applicable
+	double cycles;
+};
+
+static std::vector<result> results;
+
+static void record(const char *name, const char *type, int n, double cycles) {
+	result r = { name, type, n, cycles };
+	results.push_back(r);
+	if (n)
+		printf("%-16s %-6s %d  %8.2f\n", name, type, n, cycles);
+	else
+		printf("%-16s %-6s    %8.2f\n", name, type, cycles);
+}
+
+// Runs body for i = 0 .. COUNT-1, REPEATS times, and records the fastest run.
+#define BENCH(name, type, n, body) \
+	do { \
+		unsigned long long best = ~0ull; \
+		for (int repeat = 0; repeat < REPEATS; ++repeat) { \
+			clobberMemory(); \
+			unsigned long long start = __rdtsc(); \
+			for (size_t i = 0; i < COUNT; ++i) { \
+				body; \
+			} \
+			clobberMemory(); \
+			unsigned long long cycles = __rdtsc() - start; \
+			if (cycles < best) \
+				best = cycles; \
+		} \
+		record(name, type, n, double(best) / COUNT); \
+	} while (0)
+
+template<class T>
+static T randomScalar(RNG *rng) {
+	return T(randUniform(rng, -1, 1));
+}
+
+template<class T, int N>
+static vector<T, N> randomVector(RNG *rng) {
+	vector<T, N> v;
+	for (int i = 0; i < N; ++i)
+		v[i] = randomScalar<T>(rng);
+	return v;
+}
+
+// Diagonally dominant, so always invertible.
+template<class T, int N>
+static matrix<T, N, N> randomMatrix(RNG *rng) {
+	matrix<T, N, N> m;
+	for (int c = 0; c < N; ++c)
+		for (int r = 0; r < N; ++r)
+			m.col[c][r] = randomScalar<T>(rng) + (c == r ? T(N) : T(0));
+	return m;
+}
+
+template<class T>
+static quaternion<T> randomRotation(RNG *rng) {
+	return normalize(quaternion<T>(randomScalar<T>(rng), randomScalar<T>(rng), randomScalar<T>(rng), randomScalar<T>(rng)));
+}
+
+template<class T, int N>
+static void benchVectors(RNG *rng, const char *type) {
+	alignedArray<vector<T, N> > a(COUNT), b(COUNT), c(COUNT), v(COUNT);
+	alignedArray<T> s(COUNT);
+	for (size_t i = 0; i < COUNT; ++i) {
+		a[i] = randomVector<T, N>(rng);
+		b[i] = randomVector<T, N>(rng);
+		c[i] = randomVector<T, N>(rng);
+		s[i] = randomScalar<T>(rng);
+	}
+
+	BENCH("a + b", type, N, v[i] = a[i] + b[i]);
+	BENCH("a * b", type, N, v[i] = a[i] * b[i]);
+	BENCH("a / b", type, N, v[i] = a[i] / b[i]);
+	BENCH("a * b + c", type, N, v[i] = a[i] * b[i] + c[i]);
+	BENCH("a * scalar", type, N, v[i] = a[i] * s[i]);
+	BENCH("dot", type, N, s[i] = dot(a[i], b[i]));
+	BENCH("normalize", type, N, v[i] = normalize(a[i]));
+}
+
+template<class T>
+static void benchCross(RNG *rng, const char *type) {
+	alignedArray<vector<T, 3> > a(COUNT), b(COUNT), v(COUNT);
+	for (size_t i = 0; i < COUNT; ++i) {
+		a[i] = randomVector<T, 3>(rng);
+		b[i] = randomVector<T, 3>(rng);
+	}
+	BENCH("cross", type, 3, v[i] = cross(a[i], b[i]));
+}
+
+template<class T, int N>
+static void benchMatrices(RNG *rng, const char *type) {
+	alignedArray<matrix<T, N, N> > a(COUNT), b(COUNT), m(COUNT);
+	alignedArray<vector<T, N> > x(COUNT), v(COUNT);
+	alignedArray<T> s(COUNT);
+	for (size_t i = 0; i < COUNT; ++i) {
+		a[i] = randomMatrix<T, N>(rng);
+		b[i] = randomMatrix<T, N>(rng);
+		x[i] = randomVector<T, N>(rng);
+	}
+
+	BENCH("mat * mat", type, N, m[i] = a[i] * b[i]);
+	BENCH("mat * vec", type, N, v[i] = a[i] * x[i]);
+	BENCH("inverse", type, N, m[i] = inverse(a[i]));
+	BENCH("transpose", type, N, m[i] = transpose(a[i]));
+	BENCH("determinant", type, N, s[i] = determinant(a[i]));
+}
+
+// The specialized inverses, against inverse() of the same translate-rotate-scale matrices.
+// rigid has the same translation and rotation without the scale.
+template<class T>
+static void benchInverses(RNG *rng, const char *type) {
+	alignedArray<matrix<T, 4, 4> > trs(COUNT), rigid(COUNT), m(COUNT);
+	alignedArray<vector<T, 3> > t(COUNT), s(COUNT);
+	alignedArray<quaternion<T> > r(COUNT);
+	for (size_t i = 0; i < COUNT; ++i) {
+		t[i] = randomVector<T, 3>(rng) * T(10);
+		r[i] = randomRotation<T>(rng);
+		s[i] = vector<T, 3>(T(randUniform(rng, 0.5f, 2)), T(randUniform(rng, 0.5f, 2)), T(randUniform(rng, 0.5f, 2)));
+		trs[i] = trsMat(t[i], r[i], s[i]);
+		rigid[i] = trsMat(t[i], r[i], vector<T, 3>(1));
+	}
+
+	BENCH("inverse (TRS)", type, 4, m[i] = inverse(trs[i]));
+	BENCH("inverseAffine", type, 4, m[i] = inverseAffine(trs[i]));
+	BENCH("inverseRigid", type, 4, m[i] = inverseRigid(rigid[i]));
+	BENCH("inverseTRS", type, 4, m[i] = inverseTRS(t[i], r[i], s[i]));
+}
+
+template<class T>
+static void benchRotations(RNG *rng, const char *type) {
+	alignedArray<quaternion<T> > p(COUNT), q(COUNT), r(COUNT);
+	alignedArray<matrix<T, 4, 4> > m(COUNT), rotations(COUNT);
+	alignedArray<vector<T, 3> > eye(COUNT), target(COUNT);
+	alignedArray<T> t(COUNT), fov(COUNT);
+	for (size_t i = 0; i < COUNT; ++i) {
+		p[i] = randomRotation<T>(rng);
+		q[i] = randomRotation<T>(rng);
+		rotations[i] = quatToMat(q[i]);
+		eye[i] = randomVector<T, 3>(rng) * T(10);
+		target[i] = randomVector<T, 3>(rng);
+		t[i] = T(randUniform(rng, 0, 1));
+		fov[i] = T(randUniform(rng, 0.5f, 2));
+	}
+
+	BENCH("slerp", type, 0, r[i] = slerp(p[i], q[i], t[i]));
+	BENCH("nlerp", type, 0, r[i] = nlerp(p[i], q[i], t[i]));
+	BENCH("quatToMat", type, 0, m[i] = quatToMat(q[i]));
+	BENCH("matToQuat", type, 0, r[i] = matToQuat(rotations[i]));
+	BENCH("lookAtMat", type, 0, m[i] = lookAtMat(eye[i], target[i], vector<T, 3>(0, 1, 0)));
+	BENCH("perspectiveMat", type, 0, m[i] = perspectiveMat(fov[i], T(16) / T(9), T(0.1), T(1000)));
+}
+
+template<class T>
+static void benchType(RNG *rng, const char *type) {
+	benchVectors<T, 2>(rng, type);
+	benchVectors<T, 3>(rng, type);
+	benchVectors<T, 4>(rng, type);
+	benchCross<T>(rng, type);
+	benchMatrices<T, 2>(rng, type);
+	benchMatrices<T, 3>(rng, type);
+	benchMatrices<T, 4>(rng, type);
+	benchInverses<T>(rng, type);
+	benchRotations<T>(rng, type);
+}
+
+static bool writeJSON(const char *path) {
+	FILE *file = fopen(path, "w");
+	if (!file)
+		return false;
+	fprintf(file, "{\n");
+	#ifdef BMATH_SIMD
+		fprintf(file, "  \"simd\": true,\n");
+	#else
+		fprintf(file, "  \"simd\": false,\n");
+	#endif
+	fprintf(file, "  \"count\": %d,\n", int(COUNT));
+	fprintf(file, "  \"repeats\": %d,\n", REPEATS);
+	fprintf(file, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); ++i) {
+		const result &r = results[i];
+		fprintf(file, "    { \"name\": \"%s\", \"type\": \"%s\", \"n\": %d, \"cycles\": %.3f }%s\n",
+			r.name, r.type, r.n, r.cycles, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+	const char *path = argc > 1 ? argv[1] : "bmath_bench.json";
+	RNG rng = seedRNG(1234);
+
+	printf("%-16s %-6s n  cycles/op\n", "operation", "type");
+	benchType<float>(&rng, "float");
+	benchType<double>(&rng, "double");
+
+	if (!writeJSON(path)) {
+		printf("couldn't write %s\n", path);
+		return 1;
+	}
+	printf("wrote %s\n", path);
+	return 0;
+}
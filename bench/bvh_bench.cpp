@@ -0,0 +1,151 @@
+/*
+  Builds a bvh over a generated mesh (a bumpy sphere of 2 million triangles), once with
+  buildBVH and once on all cores with buildBVHTop/buildBVHTask/finishBVH, and measures
+  the build times and the throughput of raycast, raycastAny and overlapping. Checks that
+  both trees give the same results.
+
+    g++ -O2 -std=c++14 -pthread -I.. bvh_bench.cpp -o bvh_bench && ./bvh_bench [grid size] [threads]
+*/
+
+#define B_RNG_IMPLEMENTATION
+#include "bmath.hpp"
+#include "brng.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+static double seconds() {
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// A sphere made of a size x size grid, pushed in and out so that it isn't too regular.
+static void generateMesh(int size, std::vector<vec3> *vertices, std::vector<uint> *indices) {
+	vertices->clear();
+	indices->clear();
+	for (int y = 0; y <= size; ++y)
+		for (int x = 0; x <= size; ++x) {
+			float theta = PI * y / size;
+			float phi = 2 * PI * x / size;
+			float r = 10 + 0.5f * sin(7 * theta) * cos(5 * phi);
+			vertices->push_back(r * vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi)));
+		}
+	for (int y = 0; y < size; ++y)
+		for (int x = 0; x < size; ++x) {
+			uint i = uint(y * (size + 1) + x);
+			uint quad[6] = { i, i + 1, i + uint(size) + 1, i + 1, i + uint(size) + 2, i + uint(size) + 1 };
+			indices->insert(indices->end(), quad, quad + 6);
+		}
+}
+
+static bvh buildParallel(const aabb<float> *boxes, size_t count, bvhNode *nodes, uint *primitives, int threadCount) {
+	std::vector<bvhBuildTask> tasks(64 * size_t(threadCount));
+	size_t taskCount;
+	bvh tree = buildBVHTop(boxes, count, nodes, primitives, count / (4 * size_t(threadCount)) + 1, tasks.data(), tasks.size(), &taskCount);
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; ++t)
+		threads.push_back(std::thread([&]() {
+			for (size_t i; (i = next++) < taskCount;)
+				buildBVHTask(tree, boxes, &tasks[i]);
+		}));
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+
+	finishBVH(&tree, tasks.data(), taskCount);
+	return tree;
+}
+
+int main(int argc, char **argv) {
+	int size = argc > 1 ? atoi(argv[1]) : 1000;
+	int threadCount = argc > 2 ? atoi(argv[2]) : int(std::thread::hardware_concurrency());
+	if (threadCount < 1)
+		threadCount = 1;
+
+	std::vector<vec3> vertices;
+	std::vector<uint> indices;
+	generateMesh(size, &vertices, &indices);
+	size_t triangleCount = indices.size() / 3;
+	std::vector<aabb<float>> boxes(triangleCount);
+	for (size_t i = 0; i < triangleCount; ++i)
+		boxes[i] = triangleBounds(vertices[indices[3 * i + 0]], vertices[indices[3 * i + 1]], vertices[indices[3 * i + 2]]);
+	printf("%zu triangles, %d threads\n", triangleCount, threadCount);
+
+	std::vector<bvhNode> serialNodes(bvhNodeCapacity(triangleCount)), parallelNodes(bvhNodeCapacity(triangleCount));
+	std::vector<uint> serialPrimitives(triangleCount), parallelPrimitives(triangleCount);
+
+	double start = seconds();
+	bvh serial = buildBVH(boxes.data(), triangleCount, serialNodes.data(), serialPrimitives.data());
+	double serialTime = seconds() - start;
+	start = seconds();
+	bvh parallel = buildParallel(boxes.data(), triangleCount, parallelNodes.data(), parallelPrimitives.data(), threadCount);
+	double parallelTime = seconds() - start;
+	printf("build:       serial %7.1f ms  parallel %7.1f ms  (%.2fx)  %zu / %zu nodes\n",
+		1000 * serialTime, 1000 * parallelTime, serialTime / parallelTime, serial.nodeCount, parallel.nodeCount);
+
+	// rays from outside the sphere towards random points near it
+	RNG rng = seedRNG(1234);
+	const int rayCount = 1000000;
+	std::vector<ray<float>> rays(rayCount);
+	for (int i = 0; i < rayCount; ++i) {
+		vec3 from = 30.0f * normalize(vec3(randGaussian(&rng, 0, 1), randGaussian(&rng, 0, 1), randGaussian(&rng, 0, 1)));
+		vec3 to = vec3(randUniform(&rng, -12, 12), randUniform(&rng, -12, 12), randUniform(&rng, -12, 12));
+		rays[i] = ray<float>(from, normalize(to - from));
+	}
+
+	int mismatches = 0;
+	const bvh *trees[2] = { &serial, &parallel };
+	const char *names[2] = { "serial", "parallel" };
+	size_t hits[2] = {};
+	float distanceSum[2] = {};
+	for (int t = 0; t < 2; ++t) {
+		start = seconds();
+		for (int i = 0; i < rayCount; ++i) {
+			float distance;
+			uint triangle;
+			vec2 barycentric;
+			if (raycast(rays[i], *trees[t], vertices.data(), indices.data(), &distance, &triangle, &barycentric)) {
+				++hits[t];
+				distanceSum[t] += distance;
+			}
+		}
+		double time = seconds() - start;
+		printf("raycast:     %-8s %7.2f Mrays/s  (%zu hits)\n", names[t], rayCount / time / 1e6, hits[t]);
+	}
+	mismatches += hits[0] != hits[1] || distanceSum[0] != distanceSum[1];
+
+	for (int t = 0; t < 2; ++t) {
+		size_t anyHits = 0;
+		start = seconds();
+		for (int i = 0; i < rayCount; ++i)
+			anyHits += raycastAny(rays[i], *trees[t], vertices.data(), indices.data());
+		double time = seconds() - start;
+		printf("raycastAny:  %-8s %7.2f Mrays/s  (%zu hits)\n", names[t], rayCount / time / 1e6, anyHits);
+		mismatches += anyHits != hits[0];
+	}
+
+	// small boxes on the surface
+	const int boxCount = 100000;
+	std::vector<uint> results(4096);
+	size_t overlapCounts[2] = {};
+	for (int t = 0; t < 2; ++t) {
+		RNG boxRng = seedRNG(5678);
+		start = seconds();
+		for (int i = 0; i < boxCount; ++i) {
+			vec3 center = 10.0f * normalize(vec3(randGaussian(&boxRng, 0, 1), randGaussian(&boxRng, 0, 1), randGaussian(&boxRng, 0, 1)));
+			aabb<float> box = aabb<float>(center - vec3(0.1f, 0.1f, 0.1f), center + vec3(0.1f, 0.1f, 0.1f));
+			overlapCounts[t] += overlapping(*trees[t], boxes.data(), box, results.data(), results.size());
+		}
+		double time = seconds() - start;
+		printf("overlapping: %-8s %7.2f Mqueries/s  (%zu results)\n", names[t], boxCount / time / 1e6, overlapCounts[t]);
+	}
+	mismatches += overlapCounts[0] != overlapCounts[1];
+
+	if (mismatches)
+		printf("the serial and parallel trees gave different results\n");
+	return mismatches != 0;
+}
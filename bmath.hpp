@@ -9,31 +9,47 @@
   2D, 3D, and 4D vector/matrix math and nothing more. This library 
   is intended to be a lightweight alternative to GLM. Unlike GLM it
   does not go out of its way to provide GLSL equivalent functionality.
-  Only the commonly used stuff is provided, things like sin(vec4) are not. 
+  Only the commonly used stuff is provided. 
   Just like GLM, this is a header-only library.
 
   This library provides:
   + 2D, 3D and 4D vectors, 2x2, 3x3, 4x4 matrices, generic to any type
+  + 4x3 affine transform matrices (mat4x3) - a mat4 without the constant bottom row
   + quaternions, generic to any type
+  + dual quaternions for rigid transforms
+  + bounding volumes (aabb, sphere), planes and view frustums, with batch frustum culling
+  + rays and ray-box, ray-sphere and ray-triangle tests, also on packets of 4 or 8 rays
+  + 4-wide bounding volume hierarchy (bvh) for raycasts and overlap queries on big meshes
+  + transform hierarchy that only updates the world matrices of changed nodes
+  + linear blend and dual quaternion skinning of whole vertex arrays
+  + GLSL-style swizzles (swizzle<2, 1, 0>(v) for v.zyx), also write-masked ones
   + full suite of vector operators (unary: + - ~ binary: + - * / % & | ^ << >>)
   + some matrix and quaternion operators (+ - * /)
   + most GLSL vector and matrix functions (but not all)
-  + some color conversion functions
+  + some color conversion functions (HSV, sRGB) and array versions for whole images
   + transform matrix building functions (perspective, translate, rotate, lookAt ..)
-  + constexpr where possible
+  + constexpr where possible - also the transform builders (rotationMat, perspectiveMat ..)
+    with C++20, or GCC 9 / Clang 9 and C++14, through constexpr sqrt, sin, cos ..
+  + structure-of-arrays vectors of SIMD-wide floats (vec3N, ..) when BMATH_SIMD is defined
+  + batch functions that transform whole arrays of points and directions
+  + decomposition of transforms into translation, rotation and scale, and batch blending
+  + fast approximate normalize, length and reciprocal (fastNormalize, ..)
+  + vector sin, cos, tan, atan2, exp, log, pow - evaluated in all SIMD lanes at once
+    with BMATH_SIMD, in a precise and a fast (fastSin, ..) accuracy tier
+    (the precise vec2, vec3, vec4 versions only with BMATH_SIMD_MATH)
+  + over-aligned vec4, mat4 and quat (avec4, amat4, ..) and an aligned dynamic array
+  + 16-bit half float storage type (half, hvec2, ..) and bulk float <-> half conversion
+  + unorm/snorm packing (packUnorm4x8, ..), octahedral directions and compressed quaternions
 
   This library does NOT provide:
-  - non-square matrices
+  - non-square matrices (other than the 4x3 affine matrix)
   - vectors of arbitrary size
   - "1D vectors"
-  - dual quaternions
-  - 16-bit floats
+  - 16-bit float arithmetic (half is only a storage format)
   - bit-twiddling math (bitCount, findLSB, bitfieldInsert)
-  - trigonometric functions for vectors (sin, cos, ..)
-  - packing functions (packDouble2x32, ..)
-  - arbitrary vector swizzles
+  - bit-exact packing functions (packDouble2x32, ..)
   - complete set of operators for matrices and quaternions
-  - low-level optimization (simd, forceinline, ...)
+  - low-level optimization (forceinline, ...) - SSE is only used with BMATH_SIMD or BMATH_DISPATCH
 
   Most functions are implemented as templates in order to reduce code duplication.
 
@@ -63,6 +79,33 @@
   #define BMATH_NO_CPP11
   - Don't use C++ 11 features: constexpr and log2, exp2 from <cmath>
 
+  #define BMATH_SIMD
+  - Store vec4, ivec4 and uvec4 in SSE registers and implement their operators
+    and common functions with SSE intrinsics. SSE4.1 and AVX instructions are
+    used when the compiler is allowed to emit them (-msse4.1, -mavx, /arch:AVX).
+    These vectors (and the matrices and quaternions built from them) become 16 byte
+    aligned, and their operators can no longer be used in constant expressions.
+    Also defines floatN and boolN - a float and a comparison mask per SIMD lane - so
+    that vec2N, vec3N and vec4N can run the generic vector functions on 4 (SSE) or
+    8 (AVX) vectors at once. Use loadN/storeN to move data in and out of them.
+    Has no effect when compiling for a processor without SSE2.
+
+  #define BMATH_SIMD_MATH
+  - With BMATH_SIMD, also compute sin, cos, sincos, tan, atan2, exp, log and pow of
+    vec2, vec3 and vec4 with the floatN polynomials instead of calling the C library
+    per component. This is faster but not identical: pow gives NaN for any negative
+    base (even with integer exponents), exp flushes results below FLT_MIN to zero, and
+    sin, cos and tan lose accuracy for very large arguments (|x| > 8192 or so).
+    The fastSin, fastCos, .. versions always use floatN with BMATH_SIMD.
+
+  #define BMATH_DISPATCH
+  - Pick the SSE2, AVX2 or AVX-512 version of the batch functions (transformPoints, ..)
+    at runtime based on get_CPUID() from bcpuid.h, instead of at compile time. The
+    program doesn't need to be compiled for AVX. Needs bcpuid.h next to this file and
+    B_CPUID_IMPLEMENTATION defined in one source file. The choice is made once on first
+    use, and can be overridden with setSimdLevel (for testing). Independent of BMATH_SIMD.
+    The bulk half conversions (convertFloatToHalf, ..) also check for F16C this way.
+
   Either #define these before including the file, or just uncomment the lines below.
 */
 
@@ -70,12 +113,18 @@
 //#define BMATH_LEFT_HANDED
 //#define BMATH_DEPTH_CLIP_ZERO_TO_ONE
 //#define BMATH_NO_CPP11
+//#define BMATH_SIMD
+//#define BMATH_SIMD_MATH
+//#define BMATH_DISPATCH
 
 #pragma once
 #ifndef BMATH_H
 #define BMATH_H
 
 #include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 
 #ifdef BMATH_NAMESPACE
 #	define BMATH_BEGIN namespace BMATH_NAMESPACE {
@@ -132,6 +181,99 @@
 #	define BMATH_CONSTEXPR
 #endif
 
+// sqrt, sin, cos, .. can only be constexpr if they can tell when they're evaluated at
+// compile time, and they need C++14 constexpr functions with branches and loops
+#if defined BMATH_HAS_CONSTEXPR && ((defined _MSVC_LANG && _MSVC_LANG >= 202002L) || __cplusplus >= 202002L)
+#	include <type_traits>
+#	define BMATH_HAS_CONSTANT_EVALUATED
+#	define b__IS_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#elif defined BMATH_HAS_CONSTEXPR && __cplusplus >= 201402L && ((defined __GNUC__ && __GNUC__ >= 9) || (defined __clang__ && __clang_major__ >= 9))
+#	define BMATH_HAS_CONSTANT_EVALUATED
+#	define b__IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+
+#ifdef BMATH_HAS_CONSTANT_EVALUATED
+#	define BMATH_CONSTEXPR_MATH constexpr
+#else
+#	define BMATH_CONSTEXPR_MATH
+#endif
+
+#if defined _MSC_VER
+#	define BMATH_ALIGN(alignment) __declspec(align(alignment))
+#elif defined __GNUC__ || defined __clang__
+#	define BMATH_ALIGN(alignment) __attribute__((aligned(alignment)))
+#else
+#	define BMATH_ALIGN(alignment) alignas(alignment)
+#endif
+
+#ifdef BMATH_SIMD
+#	if defined __SSE2__ || defined _M_X64 || defined _M_AMD64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#		define BMATH_HAS_SSE2
+#	endif
+#	if defined BMATH_HAS_SSE2 && (defined __SSE4_1__ || defined __AVX__)
+#		define BMATH_HAS_SSE41
+#	endif
+#	if defined BMATH_HAS_SSE2 && defined __AVX__
+#		define BMATH_HAS_AVX
+#	endif
+#	if defined BMATH_HAS_SSE2 && defined __AVX2__
+#		define BMATH_HAS_AVX2
+#	endif
+#	if defined BMATH_HAS_SSE2 && defined __AVX512F__
+#		define BMATH_HAS_AVX512
+#	endif
+#	if defined BMATH_HAS_AVX && defined __F16C__
+#		define BMATH_HAS_F16C
+#	endif
+#endif // BMATH_SIMD
+
+#ifdef BMATH_DISPATCH
+#	if defined __SSE2__ || defined _M_X64 || defined _M_AMD64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#		define BMATH_HAS_DISPATCH
+#	endif
+#endif // BMATH_DISPATCH
+
+// which versions of the batch kernels get compiled
+#if defined BMATH_HAS_SSE2 || defined BMATH_HAS_DISPATCH
+#	define BMATH_KERNEL_SSE2
+#endif
+#if defined BMATH_HAS_AVX2 || defined BMATH_HAS_DISPATCH
+#	define BMATH_KERNEL_AVX2
+#endif
+#if defined BMATH_HAS_AVX512 || defined BMATH_HAS_DISPATCH
+#	define BMATH_KERNEL_AVX512
+#endif
+#if defined BMATH_HAS_F16C || defined BMATH_HAS_DISPATCH
+#	define BMATH_KERNEL_F16C
+#endif
+
+#if defined BMATH_HAS_DISPATCH && (defined __GNUC__ || defined __clang__)
+#	define BMATH_TARGET_AVX2   __attribute__((target("avx2")))
+#	define BMATH_TARGET_AVX512 __attribute__((target("avx512f")))
+#	define BMATH_TARGET_F16C   __attribute__((target("avx,f16c")))
+#else
+#	define BMATH_TARGET_AVX2
+#	define BMATH_TARGET_AVX512
+#	define BMATH_TARGET_F16C
+#endif
+
+#ifdef BMATH_HAS_DISPATCH
+#	include "bcpuid.h"
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#endif
+
+#if defined BMATH_HAS_AVX || defined BMATH_HAS_DISPATCH
+#	include <immintrin.h>
+#elif defined BMATH_HAS_SSE41
+#	include <smmintrin.h>
+#elif defined BMATH_HAS_SSE2
+#	include <emmintrin.h>
+#endif
+
 BMATH_BEGIN
 
 #ifdef BMATH_HAS_CONSTEXPR
@@ -144,8 +286,15 @@ BMATH_CONSTEXPR double PI64 = 3.141592653589793;
 template<class T, int N>        struct vector;
 template<class T, int C, int R> struct matrix;
 template<class T>               struct quaternion;
+template<class T>               struct dualquaternion;
+template<class T>               struct aabb;
+template<class T>               struct sphere;
+template<class T>               struct plane;
+template<class T>               struct frustum;
+template<class T>               struct ray;
 
 typedef unsigned int      uint;
+using std::size_t;
 typedef vector<float,  2> vec2;
 typedef vector<float,  3> vec3;
 typedef vector<float,  4> vec4;
@@ -167,11 +316,115 @@ typedef matrix<float,  4, 4> mat4;
 typedef matrix<double, 2, 2> dmat2;
 typedef matrix<double, 3, 3> dmat3;
 typedef matrix<double, 4, 4> dmat4;
+typedef matrix<float,  4, 3> mat4x3;
+typedef matrix<double, 4, 3> dmat4x3;
 typedef quaternion<float>  quat;
 typedef quaternion<double> dquat;
+typedef dualquaternion<float>  dualquat;
+typedef dualquaternion<double> ddualquat;
+
+struct half;
+typedef vector<half, 2> hvec2;
+typedef vector<half, 3> hvec3;
+typedef vector<half, 4> hvec4;
+
+// The constructors that broadcast a scalar take any type, so vec4(av) would call them
+// instead of the copy constructor for the aligned types (avec4, ..) which derive from
+// vec4. They're removed for the aligned types by specializing this without the type.
+// The tag is a class so that no argument converts to it.
+struct b__broadcastTag {};
+template<class T> struct b__broadcast { typedef b__broadcastTag type; };
+
+#ifdef BMATH_HAS_SSE2
+// SSE register type used to store a vector<T, 4> - only float, int and uint have one.
+template<class T> struct simd4 { struct type { T elem[4]; }; };
+template<> struct simd4<float> { typedef __m128  type; };
+template<> struct simd4<int>   { typedef __m128i type; };
+template<> struct simd4<uint>  { typedef __m128i type; };
+
+// "Wide" scalars: floatN holds one float per SIMD lane (8 with AVX, 4 with SSE)
+// and boolN holds one comparison mask per lane. Vectors of these store N vectors
+// in structure-of-arrays form, so that all of the generic vector functions
+// process a whole register of vectors at once.
+struct floatN;
+struct boolN;
+typedef vector<floatN, 2> vec2N;
+typedef vector<floatN, 3> vec3N;
+typedef vector<floatN, 4> vec4N;
+typedef vector<boolN,  2> bvec2N;
+typedef vector<boolN,  3> bvec3N;
+typedef vector<boolN,  4> bvec4N;
+#endif
 
 // Type Definitions
 
+// IEEE 754 binary16 float conversions, rounding to nearest even. Denormals, infinities
+// and NaNs are converted correctly (NaNs are quieted), the same as the F16C instructions.
+inline unsigned short b__floatToHalfBits(float f) {
+	uint x;
+	memcpy(&x, &f, sizeof x);
+	uint sign = (x >> 16) & 0x8000;
+	x &= 0x7FFFFFFF;
+	if (x >= 0x7F800000) // inf and NaN
+		return (unsigned short)(sign | 0x7C00 | (x > 0x7F800000 ? 0x200 | ((x >> 13) & 0x3FF) : 0));
+	if (x >= 0x477FF000) // rounds to more than 65504
+		return (unsigned short)(sign | 0x7C00);
+	if (x >= 0x38800000) { // normal: rebias the exponent and round the 13 dropped mantissa bits
+		x = x - ((127 - 15) << 23) + 0xFFF + ((x >> 13) & 1);
+		return (unsigned short)(sign | (x >> 13));
+	}
+	if (x < 0x33000000) // rounds to 0
+		return (unsigned short)sign;
+	// denormal: shift the mantissa (with its implicit 1) down to units of 2^-24
+	uint shift = 126 - (x >> 23);
+	uint mantissa = (x & 0x7FFFFF) | 0x800000;
+	uint h = mantissa >> shift;
+	uint rest = mantissa & ((1u << shift) - 1);
+	uint halfway = 1u << (shift - 1);
+	if (rest > halfway || (rest == halfway && (h & 1)))
+		++h;
+	return (unsigned short)(sign | h);
+}
+
+inline float b__halfBitsToFloat(unsigned short h) {
+	uint sign = uint(h & 0x8000) << 16;
+	uint exponent = (h >> 10) & 0x1F;
+	uint mantissa = h & 0x3FF;
+	uint x;
+	if (exponent == 0x1F) // inf and NaN
+		x = sign | 0x7F800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+	else if (exponent != 0)
+		x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	else { // zero and denormals are exactly mantissa * 2^-24
+		float f = float(mantissa) * 5.96046448e-8f;
+		memcpy(&x, &f, sizeof x);
+		x |= sign;
+	}
+	float f;
+	memcpy(&f, &x, sizeof f);
+	return f;
+}
+
+// 16-bit float storage type. It converts to and from float, but has no arithmetic
+// of its own - any math on it is done in float. Convert whole arrays with
+// convertFloatToHalf and convertHalfToFloat.
+struct half {
+	unsigned short bits;
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline half() = default;
+#else
+	inline half() {}
+#endif
+
+	inline explicit half(float f)
+		: bits(b__floatToHalfBits(f)) {}
+
+	inline operator float() const {
+		return b__halfBitsToFloat(bits);
+	}
+};
+
 // disable warning: nonstandard extension used nameless struct/union
 #if defined _MSC_VER
 #	pragma warning(push)
@@ -202,6 +455,10 @@ struct vector<T, 2> {
 	inline vector() {}
 	inline BMATH_CONSTEXPR vector(const vector &v)
 		: x(v.x), y(v.y) {};
+	inline vector &operator=(const vector &v) {
+		x = v.x; y = v.y;
+		return *this;
+	}
 #endif
 
 	template<class X, class Y> 
@@ -209,7 +466,7 @@ struct vector<T, 2> {
 		: x(T(x)), y(T(y)) {}
 
 	template<class XY> 
-	inline BMATH_CONSTEXPR explicit vector(XY xy)
+	inline BMATH_CONSTEXPR explicit vector(XY xy, typename b__broadcast<XY>::type = b__broadcastTag())
 		: x(T(xy)), y(T(xy)) {}
 	
 	template<class XY> 
@@ -249,6 +506,10 @@ struct vector<T, 3> {
 	inline vector() {}
 	inline BMATH_CONSTEXPR vector(const vector &v)
 		: x(v.x), y(v.y), z(v.z) {};
+	inline vector &operator=(const vector &v) {
+		x = v.x; y = v.y; z = v.z;
+		return *this;
+	}
 #endif
 
 	template<class X, class Y, class Z> 
@@ -264,7 +525,7 @@ struct vector<T, 3> {
 		: x(T(x)), y(T(yz.x)), z(T(yz.y)) {}
 	
 	template<class XYX> 
-	inline BMATH_CONSTEXPR explicit vector(XYX xyz)
+	inline BMATH_CONSTEXPR explicit vector(XYX xyz, typename b__broadcast<XYX>::type = b__broadcastTag())
 		: x(T(xyz)), y(T(xyz)), z(T(xyz)) {}
 	
 	template<class XY> 
@@ -297,6 +558,9 @@ struct vector<T, 4> {
 		vector<T, 3> rgb;
 		struct { vector<T, 2> xy, zw; };
 		T elem[4];
+#ifdef BMATH_HAS_SSE2
+		typename simd4<T>::type simd;
+#endif
 	};
 
 #ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
@@ -306,6 +570,10 @@ struct vector<T, 4> {
 	inline vector() {}
 	inline BMATH_CONSTEXPR vector(const vector &v)
 		: x(v.x), y(v.y), z(v.z), w(v.w) {};
+	inline vector &operator=(const vector &v) {
+		x = v.x; y = v.y; z = v.z; w = v.w;
+		return *this;
+	}
 #endif
 
 	template<class X, class Y, class Z, class W> 
@@ -337,7 +605,7 @@ struct vector<T, 4> {
 		: x(T(x)), y(T(yzw.x)), z(T(yzw.y)), w(T(yzw.z)) {}
 	
 	template<class XYZW> 
-	inline BMATH_CONSTEXPR explicit vector(XYZW xyzw)
+	inline BMATH_CONSTEXPR explicit vector(XYZW xyzw, typename b__broadcast<XYZW>::type = b__broadcastTag())
 		: x(T(xyzw)), y(T(xyzw)), z(T(xyzw)), w(T(xyzw)) {}
 	
 	template<class XY> 
@@ -352,6 +620,11 @@ struct vector<T, 4> {
 	inline BMATH_CONSTEXPR explicit vector(vector<XYZW, 4> xyzw)
 		: x(T(xyzw.x)), y(T(xyzw.y)), z(T(xyzw.z)), w(T(xyzw.w)) {}
 
+#ifdef BMATH_HAS_SSE2
+	inline explicit vector(typename simd4<T>::type xyzw)
+		: simd(xyzw) {}
+#endif
+
 	inline T &operator[](int index) {
 		return elem[index];
 	}
@@ -372,6 +645,11 @@ struct matrix<T, 2, 2> {
 	inline matrix() {}
 	inline BMATH_CONSTEXPR matrix(const matrix &m)
 		: col{ m.col[0], m.col[1] } {};
+	inline matrix &operator=(const matrix &m) {
+		for (int i = 0; i < 2; ++i)
+			col[i] = m.col[i];
+		return *this;
+	}
 #endif
 
 	template<
@@ -417,7 +695,7 @@ struct matrix<T, 2, 2> {
 			vector<T, 2>(     0, diag.y) } {}
 	
 	template<class D> 
-	inline BMATH_CONSTEXPR explicit matrix(D diag)
+	inline BMATH_CONSTEXPR explicit matrix(D diag, typename b__broadcast<D>::type = b__broadcastTag())
 		: col{
 			vector<T, 2>(diag,    0),
 			vector<T, 2>(   0, diag) } {}
@@ -442,6 +720,11 @@ struct matrix<T, 3, 3> {
 	inline matrix() {}
 	inline BMATH_CONSTEXPR matrix(const matrix &m)
 		: col{ m.col[0], m.col[1], m.col[2] } {};
+	inline matrix &operator=(const matrix &m) {
+		for (int i = 0; i < 3; ++i)
+			col[i] = m.col[i];
+		return *this;
+	}
 #endif
 
 	template<
@@ -490,6 +773,13 @@ struct matrix<T, 3, 3> {
 			vector<T, 3>(m.col[0].xyz), 
 			vector<T, 3>(m.col[1].xyz), 
 			vector<T, 3>(m.col[2].xyz) } {}
+
+	template<class M43> 
+	inline BMATH_CONSTEXPR explicit matrix(matrix<M43, 4, 3> m)
+		: col{ 
+			vector<T, 3>(m.col[0]), 
+			vector<T, 3>(m.col[1]), 
+			vector<T, 3>(m.col[2]) } {}
 	
 	template<class D> 
 	inline BMATH_CONSTEXPR explicit matrix(vector<D, 3> diag)
@@ -499,7 +789,7 @@ struct matrix<T, 3, 3> {
 			vector<T, 3>(     0,      0, diag.z) } {}
 	
 	template<class D> 
-	inline BMATH_CONSTEXPR explicit matrix(D diag)
+	inline BMATH_CONSTEXPR explicit matrix(D diag, typename b__broadcast<D>::type = b__broadcastTag())
 		: col{
 			vector<T, 3>(diag,    0,    0),
 			vector<T, 3>(   0, diag,    0),
@@ -525,6 +815,11 @@ struct matrix<T, 4, 4> {
 	inline matrix() {}
 	inline BMATH_CONSTEXPR matrix(const matrix &m)
 		: col{ m.col[0], m.col[1], m.col[2], m.col[3] } {};
+	inline matrix &operator=(const matrix &m) {
+		for (int i = 0; i < 4; ++i)
+			col[i] = m.col[i];
+		return *this;
+	}
 #endif
 
 	template<
@@ -583,6 +878,14 @@ struct matrix<T, 4, 4> {
 			vector<T, 4>(m.col[2]),
 			vector<T, 4>(m.col[3]) } {}
 
+	template<class M43> 
+	inline BMATH_CONSTEXPR explicit matrix(matrix<M43, 4, 3> m)
+		: col{
+			vector<T, 4>(m.col[0], 0),
+			vector<T, 4>(m.col[1], 0),
+			vector<T, 4>(m.col[2], 0),
+			vector<T, 4>(m.col[3], 1) } {}
+
 	template<class D> 
 	inline BMATH_CONSTEXPR explicit matrix(vector<D, 4> diag)
 		: col{
@@ -592,7 +895,7 @@ struct matrix<T, 4, 4> {
 			vector<T, 4>(     0,      0,      0, diag.w) } {}
 
 	template<class D> 
-	inline BMATH_CONSTEXPR explicit matrix(D diag)
+	inline BMATH_CONSTEXPR explicit matrix(D diag, typename b__broadcast<D>::type = b__broadcastTag())
 		: col{
 			vector<T, 4>(diag,    0,    0,    0),
 			vector<T, 4>(   0, diag,    0,    0),
@@ -607,6 +910,109 @@ struct matrix<T, 4, 4> {
 	}
 };
 
+// Affine transform with 4 columns and 3 rows - a mat4 without its constant
+// (0, 0, 0, 1) bottom row, so it takes 48 bytes instead of 64. The first 3 columns
+// hold the rotation/scale and the last one holds the translation.
+template<class T> 
+struct matrix<T, 4, 3> {
+
+	vector<T, 3> col[4];
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline matrix() = default;
+	inline BMATH_CONSTEXPR matrix(const matrix & m) = default;
+#else
+	inline matrix() {}
+	inline BMATH_CONSTEXPR matrix(const matrix &m)
+		: col{ m.col[0], m.col[1], m.col[2], m.col[3] } {};
+	inline matrix &operator=(const matrix &m) {
+		for (int i = 0; i < 4; ++i)
+			col[i] = m.col[i];
+		return *this;
+	}
+#endif
+
+	template<
+		class X0, class Y0, class Z0,
+		class X1, class Y1, class Z1,
+		class X2, class Y2, class Z2,
+		class X3, class Y3, class Z3>
+	inline BMATH_CONSTEXPR matrix(
+		X0 x0, Y0 y0, Z0 z0,
+		X1 x1, Y1 y1, Z1 z1,
+		X2 x2, Y2 y2, Z2 z2,
+		X3 x3, Y3 y3, Z3 z3)
+		: col{
+			vector<T, 3>(x0, y0, z0),
+			vector<T, 3>(x1, y1, z1),
+			vector<T, 3>(x2, y2, z2),
+			vector<T, 3>(x3, y3, z3) } {}
+
+	template<
+		class C0,
+		class C1,
+		class C2,
+		class C3>
+	inline BMATH_CONSTEXPR matrix(
+		vector<C0, 3> col0,
+		vector<C1, 3> col1,
+		vector<C2, 3> col2,
+		vector<C3, 3> col3)
+		: col{ 
+			vector<T, 3>(col0), 
+			vector<T, 3>(col1), 
+			vector<T, 3>(col2), 
+			vector<T, 3>(col3) } {}
+
+	template<class M33> 
+	inline BMATH_CONSTEXPR explicit matrix(matrix<M33, 3, 3> m)
+		: col{
+			vector<T, 3>(m.col[0]),
+			vector<T, 3>(m.col[1]),
+			vector<T, 3>(m.col[2]),
+			vector<T, 3>(0, 0, 0) } {}
+
+	template<class M43> 
+	inline BMATH_CONSTEXPR explicit matrix(matrix<M43, 4, 3> m)
+		: col{
+			vector<T, 3>(m.col[0]),
+			vector<T, 3>(m.col[1]),
+			vector<T, 3>(m.col[2]),
+			vector<T, 3>(m.col[3]) } {}
+
+	// drops the bottom row, which should be (0, 0, 0, 1)
+	template<class M44> 
+	inline BMATH_CONSTEXPR explicit matrix(matrix<M44, 4, 4> m)
+		: col{
+			vector<T, 3>(m.col[0]),
+			vector<T, 3>(m.col[1]),
+			vector<T, 3>(m.col[2]),
+			vector<T, 3>(m.col[3]) } {}
+
+	template<class D> 
+	inline BMATH_CONSTEXPR explicit matrix(vector<D, 3> diag)
+		: col{
+			vector<T, 3>(diag.x,      0,      0),
+			vector<T, 3>(     0, diag.y,      0),
+			vector<T, 3>(     0,      0, diag.z),
+			vector<T, 3>(     0,      0,      0) } {}
+
+	template<class D> 
+	inline BMATH_CONSTEXPR explicit matrix(D diag, typename b__broadcast<D>::type = b__broadcastTag())
+		: col{
+			vector<T, 3>(diag,    0,    0),
+			vector<T, 3>(   0, diag,    0),
+			vector<T, 3>(   0,    0, diag),
+			vector<T, 3>(   0,    0,    0) } {}
+
+	inline vector<T, 3> &operator[](int index) {
+		return col[index];
+	}
+	inline BMATH_CONSTEXPR const vector<T, 3> &operator[](int index) const {
+		return col[index];
+	}
+};
+
 template<class T> 
 struct quaternion {
 
@@ -624,6 +1030,10 @@ struct quaternion {
 	inline quaternion() {}
 	inline BMATH_CONSTEXPR quaternion(const quaternion &q)
 		: x(q.x), y(q.y), z(q.z), w(q.w) {};
+	inline quaternion &operator=(const quaternion &q) {
+		x = q.x; y = q.y; z = q.z; w = q.w;
+		return *this;
+	}
 #endif
 
 	template<class X, class Y, class Z, class W> 
@@ -650,6 +1060,318 @@ struct quaternion {
 	}
 };
 
+// real + dual * e, where e * e = 0. A unit dual quaternion is a rotation followed by
+// a translation, which unlike a matrix can be blended with others without shearing.
+template<class T>
+struct dualquaternion {
+
+	quaternion<T> real;
+	quaternion<T> dual;
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline dualquaternion() = default;
+#else
+	inline dualquaternion() {}
+#endif
+
+	template<class R, class D>
+	inline BMATH_CONSTEXPR dualquaternion(quaternion<R> real, quaternion<D> dual)
+		: real(real), dual(dual) {}
+
+	template<class Q>
+	inline BMATH_CONSTEXPR explicit dualquaternion(dualquaternion<Q> q)
+		: real(q.real), dual(q.dual) {}
+};
+
+// Axis-aligned bounding box, stored as its min and max corners.
+template<class T>
+struct aabb {
+
+	vector<T, 3> min;
+	vector<T, 3> max;
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline aabb() = default;
+#else
+	inline aabb() {}
+#endif
+
+	template<class MIN, class MAX>
+	inline BMATH_CONSTEXPR aabb(vector<MIN, 3> minCorner, vector<MAX, 3> maxCorner)
+		: min(minCorner), max(maxCorner) {}
+
+	template<class B>
+	inline BMATH_CONSTEXPR explicit aabb(aabb<B> box)
+		: min(box.min), max(box.max) {}
+};
+
+template<class T>
+struct sphere {
+
+	vector<T, 3> center;
+	T radius;
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline sphere() = default;
+#else
+	inline sphere() {}
+#endif
+
+	template<class C, class R>
+	inline BMATH_CONSTEXPR sphere(vector<C, 3> center, R radius)
+		: center(center), radius(T(radius)) {}
+
+	template<class S>
+	inline BMATH_CONSTEXPR explicit sphere(sphere<S> s)
+		: center(s.center), radius(T(s.radius)) {}
+};
+
+// The points p where dot(normal, p) + d = 0. The normal points to the positive
+// side of the plane, and distances are only true distances if it's normalized.
+template<class T>
+struct plane {
+
+	vector<T, 3> normal;
+	T d;
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline plane() = default;
+#else
+	inline plane() {}
+#endif
+
+	template<class N, class D>
+	inline BMATH_CONSTEXPR plane(vector<N, 3> normal, D d)
+		: normal(normal), d(T(d)) {}
+
+	// from the plane equation (a, b, c, d)
+	template<class ABCD>
+	inline BMATH_CONSTEXPR explicit plane(vector<ABCD, 4> abcd)
+		: normal(abcd.x, abcd.y, abcd.z), d(T(abcd.w)) {}
+
+	template<class P>
+	inline BMATH_CONSTEXPR explicit plane(plane<P> p)
+		: normal(p.normal), d(T(p.d)) {}
+};
+
+// The 6 planes of a view frustum with their normals pointing inside,
+// in the order left, right, bottom, top, near, far.
+template<class T>
+struct frustum {
+
+	plane<T> planes[6];
+
+	inline plane<T> &operator[](int index) {
+		return planes[index];
+	}
+	inline BMATH_CONSTEXPR const plane<T> &operator[](int index) const {
+		return planes[index];
+	}
+};
+
+// The points origin + t * direction for t >= 0. The direction doesn't need to be
+// normalized. A ray<floatN> is a packet of 4 (SSE) or 8 (AVX) rays in SoA form.
+template<class T>
+struct ray {
+
+	vector<T, 3> origin;
+	vector<T, 3> direction;
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline ray() = default;
+#else
+	inline ray() {}
+#endif
+
+	template<class O, class D>
+	inline BMATH_CONSTEXPR ray(vector<O, 3> origin, vector<D, 3> direction)
+		: origin(origin), direction(direction) {}
+
+	template<class R>
+	inline BMATH_CONSTEXPR explicit ray(ray<R> r)
+		: origin(r.origin), direction(r.direction) {}
+};
+
+// Over-aligned versions of the 4 component types. They convert to and from the plain
+// types implicitly (vec4 v = av, amat4 am = m) or with a cast (vec4(av), dmat4(am)),
+// and work with all of their operators and functions, which return the plain types.
+// Arrays of them never split a SIMD load across two cache lines, and each amat4
+// fills exactly one cache line (64 bytes) instead of straddling two.
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+#	define b__ALIGNED_TYPE(name, type, alignment) \
+		struct BMATH_ALIGN(alignment) name : type { \
+			inline name() = default; \
+			inline BMATH_CONSTEXPR name(type v) : type(v) {} \
+		}; \
+		template<> struct b__broadcast<name> {};
+#else
+#	define b__ALIGNED_TYPE(name, type, alignment) \
+		struct BMATH_ALIGN(alignment) name : type { \
+			inline name() {} \
+			inline BMATH_CONSTEXPR name(type v) : type(v) {} \
+		}; \
+		template<> struct b__broadcast<name> {};
+#endif
+
+b__ALIGNED_TYPE(avec4,    vec4,    16)
+b__ALIGNED_TYPE(advec4,   dvec4,   32)
+b__ALIGNED_TYPE(aivec4,   ivec4,   16)
+b__ALIGNED_TYPE(auvec4,   uvec4,   16)
+b__ALIGNED_TYPE(aquat,    quat,    16)
+b__ALIGNED_TYPE(adquat,   dquat,   32)
+b__ALIGNED_TYPE(amat4,    mat4,    64)
+b__ALIGNED_TYPE(admat4,   dmat4,   64)
+b__ALIGNED_TYPE(amat4x3,  mat4x3,  16)
+b__ALIGNED_TYPE(admat4x3, dmat4x3, 32)
+
+#undef b__ALIGNED_TYPE
+
+// Dynamic array whose first element is aligned to Alignment bytes (a cache line by
+// default), for the batch functions, which also take them directly, as in
+// transformPoints(m, points, &result). With a 64 byte aligned vec3 array, every 16 byte
+// load the batch kernels make is aligned too, and the SSE2 kernel takes a faster path
+// for that. The elements are copied with memcpy and never constructed or destroyed, so
+// T has to be trivially copyable, like all of the vector and matrix types.
+// Not copyable - pass it by reference.
+template<class T, size_t Alignment = 64>
+struct alignedArray {
+
+	T *data;
+	size_t count;
+	void *allocation;
+
+	inline alignedArray()
+		: data(NULL), count(0), allocation(NULL) {}
+
+	inline explicit alignedArray(size_t count)
+		: data(NULL), count(0), allocation(NULL) { resize(count); }
+
+	inline ~alignedArray() {
+		std::free(allocation);
+	}
+
+	// Keeps the first min(count, newCount) elements, the rest are uninitialized.
+	// Returns false (and leaves the array as it is) if out of memory.
+	inline bool resize(size_t newCount) {
+		if (newCount == count)
+			return true;
+		void *newAllocation = NULL;
+		T *newData = NULL;
+		if (newCount > 0) {
+			if (newCount > (size_t(-1) - Alignment) / sizeof(T))
+				return false;
+			newAllocation = std::malloc(newCount * sizeof(T) + Alignment - 1);
+			if (!newAllocation)
+				return false;
+			size_t offset = (Alignment - size_t(newAllocation) % Alignment) % Alignment;
+			newData = (T *)((char *)newAllocation + offset);
+			if (count > 0)
+				std::memcpy((void *)newData, (const void *)data, (count < newCount ? count : newCount) * sizeof(T));
+		}
+		std::free(allocation);
+		allocation = newAllocation;
+		data = newData;
+		count = newCount;
+		return true;
+	}
+
+	inline T &operator[](size_t index) {
+		return data[index];
+	}
+	inline const T &operator[](size_t index) const {
+		return data[index];
+	}
+
+private:
+	alignedArray(const alignedArray &);
+	alignedArray &operator=(const alignedArray &);
+};
+
+#ifdef BMATH_HAS_SSE2
+
+struct boolN {
+
+#ifdef BMATH_HAS_AVX
+	typedef __m256 type;
+#else
+	typedef __m128 type;
+#endif
+	type simd;
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline boolN() = default;
+#else
+	inline boolN() {}
+#endif
+
+	inline explicit boolN(type mask)
+		: simd(mask) {}
+
+#ifdef BMATH_HAS_AVX
+	inline boolN(bool b)
+		: simd(_mm256_castsi256_ps(_mm256_set1_epi32(b ? -1 : 0))) {}
+#else
+	inline boolN(bool b)
+		: simd(_mm_castsi128_ps(_mm_set1_epi32(b ? -1 : 0))) {}
+#endif
+
+#ifdef BMATH_HAS_AVX
+	inline bool operator[](int lane) const {
+		return ((_mm256_movemask_ps(simd) >> lane) & 1) != 0;
+	}
+#else
+	inline bool operator[](int lane) const {
+		return ((_mm_movemask_ps(simd) >> lane) & 1) != 0;
+	}
+#endif
+};
+
+struct floatN {
+
+#ifdef BMATH_HAS_AVX
+	enum { width = 8 };
+	typedef __m256 type;
+#else
+	enum { width = 4 };
+	typedef __m128 type;
+#endif
+	type simd;
+
+#ifdef BMATH_HAS_DEFAULT_CONSTRUCTOR
+	inline floatN() = default;
+#else
+	inline floatN() {}
+#endif
+
+	inline explicit floatN(type lanes)
+		: simd(lanes) {}
+
+#ifdef BMATH_HAS_AVX
+	inline floatN(float f)
+		: simd(_mm256_set1_ps(f)) {}
+
+	// 1 for true lanes and 0 for false lanes, like float(bool)
+	inline explicit floatN(boolN mask)
+		: simd(_mm256_and_ps(mask.simd, _mm256_set1_ps(1.0f))) {}
+#else
+	inline floatN(float f)
+		: simd(_mm_set1_ps(f)) {}
+
+	// 1 for true lanes and 0 for false lanes, like float(bool)
+	inline explicit floatN(boolN mask)
+		: simd(_mm_and_ps(mask.simd, _mm_set1_ps(1.0f))) {}
+#endif
+
+	inline float &operator[](int lane) {
+		return ((float *)&simd)[lane];
+	}
+	inline const float &operator[](int lane) const {
+		return ((const float *)&simd)[lane];
+	}
+};
+
+#endif // BMATH_HAS_SSE2
+
 // nonstandard extension used: nameless struct/union
 #if defined _MSC_VER
 #	pragma warning(pop)
@@ -1374,26 +2096,222 @@ inline vector<T, N> operator --(vector<T, N> &v, int) {
 	return copy;
 }
 
-// Matrix Operators
+#ifdef BMATH_HAS_SSE2
 
-template<class T>
-inline BMATH_CONSTEXPR matrix<T, 2, 2> operator +(matrix<T, 2, 2> m) {
-	return matrix<T, 2, 2>(
-		+m.col[0],
-		+m.col[1]);
+// SSE Vector Operators
+
+inline bvec4 b__maskToBool4(int mask) {
+	bvec4 result;
+	result.x = (mask & 1) != 0;
+	result.y = (mask & 2) != 0;
+	result.z = (mask & 4) != 0;
+	result.w = (mask & 8) != 0;
+	return result;
 }
 
-template<class T>
-inline BMATH_CONSTEXPR matrix<T, 3, 3> operator +(matrix<T, 3, 3> m) {
-	return matrix<T, 3, 3>(
-		+m.col[0],
-		+m.col[1],
-		+m.col[2]);
+inline bvec4 b__maskToBool4(__m128 mask) {
+	return b__maskToBool4(_mm_movemask_ps(mask));
 }
 
-template<class T>
-inline BMATH_CONSTEXPR matrix<T, 4, 4> operator +(matrix<T, 4, 4> m) {
-	return matrix<T, 4, 4>(
+inline bvec4 b__maskToBool4(__m128i mask) {
+	return b__maskToBool4(_mm_movemask_ps(_mm_castsi128_ps(mask)));
+}
+
+inline vec4 operator -(vec4 v) {
+	return vec4(_mm_xor_ps(v.simd, _mm_set1_ps(-0.0f)));
+}
+
+inline vec4 operator +(vec4 left, vec4 right) {
+	return vec4(_mm_add_ps(left.simd, right.simd));
+}
+
+inline vec4 operator -(vec4 left, vec4 right) {
+	return vec4(_mm_sub_ps(left.simd, right.simd));
+}
+
+inline vec4 operator *(vec4 left, vec4 right) {
+	return vec4(_mm_mul_ps(left.simd, right.simd));
+}
+
+inline vec4 operator /(vec4 left, vec4 right) {
+	return vec4(_mm_div_ps(left.simd, right.simd));
+}
+
+inline bvec4 operator ==(vec4 left, vec4 right) {
+	return b__maskToBool4(_mm_cmpeq_ps(left.simd, right.simd));
+}
+
+inline bvec4 operator !=(vec4 left, vec4 right) {
+	return b__maskToBool4(_mm_cmpneq_ps(left.simd, right.simd));
+}
+
+inline bvec4 operator >=(vec4 left, vec4 right) {
+	return b__maskToBool4(_mm_cmpge_ps(left.simd, right.simd));
+}
+
+inline bvec4 operator <=(vec4 left, vec4 right) {
+	return b__maskToBool4(_mm_cmple_ps(left.simd, right.simd));
+}
+
+inline bvec4 operator >(vec4 left, vec4 right) {
+	return b__maskToBool4(_mm_cmpgt_ps(left.simd, right.simd));
+}
+
+inline bvec4 operator <(vec4 left, vec4 right) {
+	return b__maskToBool4(_mm_cmplt_ps(left.simd, right.simd));
+}
+
+inline ivec4 operator -(ivec4 v) {
+	return ivec4(_mm_sub_epi32(_mm_setzero_si128(), v.simd));
+}
+
+inline ivec4 operator ~(ivec4 v) {
+	return ivec4(_mm_xor_si128(v.simd, _mm_set1_epi32(-1)));
+}
+
+inline ivec4 operator +(ivec4 left, ivec4 right) {
+	return ivec4(_mm_add_epi32(left.simd, right.simd));
+}
+
+inline ivec4 operator -(ivec4 left, ivec4 right) {
+	return ivec4(_mm_sub_epi32(left.simd, right.simd));
+}
+
+inline ivec4 operator &(ivec4 left, ivec4 right) {
+	return ivec4(_mm_and_si128(left.simd, right.simd));
+}
+
+inline ivec4 operator |(ivec4 left, ivec4 right) {
+	return ivec4(_mm_or_si128(left.simd, right.simd));
+}
+
+inline ivec4 operator ^(ivec4 left, ivec4 right) {
+	return ivec4(_mm_xor_si128(left.simd, right.simd));
+}
+
+inline bvec4 operator ==(ivec4 left, ivec4 right) {
+	return b__maskToBool4(_mm_cmpeq_epi32(left.simd, right.simd));
+}
+
+inline bvec4 operator !=(ivec4 left, ivec4 right) {
+	return b__maskToBool4(~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(left.simd, right.simd))));
+}
+
+inline bvec4 operator >=(ivec4 left, ivec4 right) {
+	return b__maskToBool4(~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(left.simd, right.simd))));
+}
+
+inline bvec4 operator <=(ivec4 left, ivec4 right) {
+	return b__maskToBool4(~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(left.simd, right.simd))));
+}
+
+inline bvec4 operator >(ivec4 left, ivec4 right) {
+	return b__maskToBool4(_mm_cmpgt_epi32(left.simd, right.simd));
+}
+
+inline bvec4 operator <(ivec4 left, ivec4 right) {
+	return b__maskToBool4(_mm_cmplt_epi32(left.simd, right.simd));
+}
+
+inline uvec4 operator -(uvec4 v) {
+	return uvec4(_mm_sub_epi32(_mm_setzero_si128(), v.simd));
+}
+
+inline uvec4 operator ~(uvec4 v) {
+	return uvec4(_mm_xor_si128(v.simd, _mm_set1_epi32(-1)));
+}
+
+inline uvec4 operator +(uvec4 left, uvec4 right) {
+	return uvec4(_mm_add_epi32(left.simd, right.simd));
+}
+
+inline uvec4 operator -(uvec4 left, uvec4 right) {
+	return uvec4(_mm_sub_epi32(left.simd, right.simd));
+}
+
+inline uvec4 operator &(uvec4 left, uvec4 right) {
+	return uvec4(_mm_and_si128(left.simd, right.simd));
+}
+
+inline uvec4 operator |(uvec4 left, uvec4 right) {
+	return uvec4(_mm_or_si128(left.simd, right.simd));
+}
+
+inline uvec4 operator ^(uvec4 left, uvec4 right) {
+	return uvec4(_mm_xor_si128(left.simd, right.simd));
+}
+
+inline bvec4 operator ==(uvec4 left, uvec4 right) {
+	return b__maskToBool4(_mm_cmpeq_epi32(left.simd, right.simd));
+}
+
+inline bvec4 operator !=(uvec4 left, uvec4 right) {
+	return b__maskToBool4(~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(left.simd, right.simd))));
+}
+
+#ifdef BMATH_HAS_SSE41
+
+inline ivec4 operator *(ivec4 left, ivec4 right) {
+	return ivec4(_mm_mullo_epi32(left.simd, right.simd));
+}
+
+inline uvec4 operator *(uvec4 left, uvec4 right) {
+	return uvec4(_mm_mullo_epi32(left.simd, right.simd));
+}
+
+#endif // BMATH_HAS_SSE41
+
+#ifdef BMATH_HAS_AVX2
+
+inline ivec4 operator <<(ivec4 left, ivec4 right) {
+	return ivec4(_mm_sllv_epi32(left.simd, right.simd));
+}
+
+inline ivec4 operator >>(ivec4 left, ivec4 right) {
+	return ivec4(_mm_srav_epi32(left.simd, right.simd));
+}
+
+inline uvec4 operator <<(uvec4 left, uvec4 right) {
+	return uvec4(_mm_sllv_epi32(left.simd, right.simd));
+}
+
+inline uvec4 operator >>(uvec4 left, uvec4 right) {
+	return uvec4(_mm_srlv_epi32(left.simd, right.simd));
+}
+
+#endif // BMATH_HAS_AVX2
+
+#endif // BMATH_HAS_SSE2
+
+// Matrix Operators
+
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 2, 2> operator +(matrix<T, 2, 2> m) {
+	return matrix<T, 2, 2>(
+		+m.col[0],
+		+m.col[1]);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 3, 3> operator +(matrix<T, 3, 3> m) {
+	return matrix<T, 3, 3>(
+		+m.col[0],
+		+m.col[1],
+		+m.col[2]);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 4> operator +(matrix<T, 4, 4> m) {
+	return matrix<T, 4, 4>(
+		+m.col[0],
+		+m.col[1],
+		+m.col[2],
+		+m.col[3]);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> operator +(matrix<T, 4, 3> m) {
+	return matrix<T, 4, 3>(
 		+m.col[0],
 		+m.col[1],
 		+m.col[2],
@@ -1424,6 +2342,15 @@ inline BMATH_CONSTEXPR matrix<T, 4, 4> operator -(matrix<T, 4, 4> m) {
 		-m.col[3]);
 }
 
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> operator -(matrix<T, 4, 3> m) {
+	return matrix<T, 4, 3>(
+		-m.col[0],
+		-m.col[1],
+		-m.col[2],
+		-m.col[3]);
+}
+
 template<class T>
 inline BMATH_CONSTEXPR matrix<T, 2, 2> operator +(matrix<T, 2, 2> left, matrix<T, 2, 2> right) {
 	return matrix<T, 2, 2>(
@@ -1448,6 +2375,15 @@ inline BMATH_CONSTEXPR matrix<T, 4, 4> operator +(matrix<T, 4, 4> left, matrix<T
 		left.col[3] + right.col[3]);
 }
 
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> operator +(matrix<T, 4, 3> left, matrix<T, 4, 3> right) {
+	return matrix<T, 4, 3>(
+		left.col[0] + right.col[0],
+		left.col[1] + right.col[1],
+		left.col[2] + right.col[2],
+		left.col[3] + right.col[3]);
+}
+
 template<class T>
 inline BMATH_CONSTEXPR matrix<T, 2, 2> operator -(matrix<T, 2, 2> left, matrix<T, 2, 2> right) {
 	return matrix<T, 2, 2>(
@@ -1472,6 +2408,15 @@ inline BMATH_CONSTEXPR matrix<T, 4, 4> operator -(matrix<T, 4, 4> left, matrix<T
 		left.col[3] - right.col[3]);
 }
 
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> operator -(matrix<T, 4, 3> left, matrix<T, 4, 3> right) {
+	return matrix<T, 4, 3>(
+		left.col[0] - right.col[0],
+		left.col[1] - right.col[1],
+		left.col[2] - right.col[2],
+		left.col[3] - right.col[3]);
+}
+
 template<class T>
 inline BMATH_CONSTEXPR matrix<T, 2, 2> operator *(matrix<T, 2, 2> left, matrix<T, 2, 2> right) {
 	return matrix<T, 2, 2>(
@@ -1525,6 +2470,28 @@ inline BMATH_CONSTEXPR matrix<T, 4, 4> operator *(matrix<T, 4, 4> left, matrix<T
 		left.col[0].w * right.col[3].x + left.col[1].w * right.col[3].y + left.col[2].w * right.col[3].z + left.col[3].w * right.col[3].w);
 }
 
+// Composes two affine transforms, as if both had a (0, 0, 0, 1) bottom row.
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> operator *(matrix<T, 4, 3> left, matrix<T, 4, 3> right) {
+	return matrix<T, 4, 3>(
+
+		left.col[0].x * right.col[0].x + left.col[1].x * right.col[0].y + left.col[2].x * right.col[0].z,
+		left.col[0].y * right.col[0].x + left.col[1].y * right.col[0].y + left.col[2].y * right.col[0].z,
+		left.col[0].z * right.col[0].x + left.col[1].z * right.col[0].y + left.col[2].z * right.col[0].z,
+
+		left.col[0].x * right.col[1].x + left.col[1].x * right.col[1].y + left.col[2].x * right.col[1].z,
+		left.col[0].y * right.col[1].x + left.col[1].y * right.col[1].y + left.col[2].y * right.col[1].z,
+		left.col[0].z * right.col[1].x + left.col[1].z * right.col[1].y + left.col[2].z * right.col[1].z,
+
+		left.col[0].x * right.col[2].x + left.col[1].x * right.col[2].y + left.col[2].x * right.col[2].z,
+		left.col[0].y * right.col[2].x + left.col[1].y * right.col[2].y + left.col[2].y * right.col[2].z,
+		left.col[0].z * right.col[2].x + left.col[1].z * right.col[2].y + left.col[2].z * right.col[2].z,
+
+		left.col[0].x * right.col[3].x + left.col[1].x * right.col[3].y + left.col[2].x * right.col[3].z + left.col[3].x,
+		left.col[0].y * right.col[3].x + left.col[1].y * right.col[3].y + left.col[2].y * right.col[3].z + left.col[3].y,
+		left.col[0].z * right.col[3].x + left.col[1].z * right.col[3].y + left.col[2].z * right.col[3].z + left.col[3].z);
+}
+
 template<class T>
 inline BMATH_CONSTEXPR vector<T, 2> operator *(matrix<T, 2, 2> left, vector<T, 2> right) {
 	return vector<T, 2>(
@@ -1549,6 +2516,15 @@ inline BMATH_CONSTEXPR vector<T, 4> operator *(matrix<T, 4, 4> left, vector<T, 4
 		left.col[0].w * right.x + left.col[1].w * right.y + left.col[2].w * right.z + left.col[3].w * right.w);
 }
 
+// Use w = 1 to transform a point and w = 0 to transform a direction.
+template<class T>
+inline BMATH_CONSTEXPR vector<T, 3> operator *(matrix<T, 4, 3> left, vector<T, 4> right) {
+	return vector<T, 3>(
+		left.col[0].x * right.x + left.col[1].x * right.y + left.col[2].x * right.z + left.col[3].x * right.w,
+		left.col[0].y * right.x + left.col[1].y * right.y + left.col[2].y * right.z + left.col[3].y * right.w,
+		left.col[0].z * right.x + left.col[1].z * right.y + left.col[2].z * right.z + left.col[3].z * right.w);
+}
+
 template<class T>
 inline BMATH_CONSTEXPR matrix<T, 2, 2> operator /(matrix<T, 2, 2> left, matrix<T, 2, 2> right) {
 	return matrix<T, 2, 2>(
@@ -1645,6 +2621,15 @@ inline BMATH_CONSTEXPR matrix<T, 4, 4> operator *(matrix<T, 4, 4> left, T right)
 		left.col[3] * vector<T, 4>(right));
 }
 
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> operator *(matrix<T, 4, 3> left, T right) {
+	return matrix<T, 4, 3>(
+		left.col[0] * right,
+		left.col[1] * right,
+		left.col[2] * right,
+		left.col[3] * right);
+}
+
 template<class T>
 inline BMATH_CONSTEXPR matrix<T, 2, 2> operator /(matrix<T, 2, 2> left, T right) {
 	return left / matrix<T, 2, 2>(
@@ -1669,6 +2654,15 @@ inline BMATH_CONSTEXPR matrix<T, 4, 4> operator /(matrix<T, 4, 4> left, T right)
 		vector<T, 4>(right));
 }
 
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> operator /(matrix<T, 4, 3> left, T right) {
+	return matrix<T, 4, 3>(
+		left.col[0] / right,
+		left.col[1] / right,
+		left.col[2] / right,
+		left.col[3] / right);
+}
+
 template<class T, int C, int R>
 inline BMATH_CONSTEXPR matrix<T, C, R> operator +(T left, matrix<T, C, R> right) {
 	return right + left;
@@ -1771,6 +2765,23 @@ inline BMATH_CONSTEXPR bool operator ==(matrix<T, 4, 4> left, matrix<T, 4, 4> ri
 		left.col[3].w == right.col[3].w;
 }
 
+template<class T>
+inline BMATH_CONSTEXPR bool operator ==(matrix<T, 4, 3> left, matrix<T, 4, 3> right) {
+	return
+		left.col[0].x == right.col[0].x and
+		left.col[0].y == right.col[0].y and
+		left.col[0].z == right.col[0].z and
+		left.col[1].x == right.col[1].x and
+		left.col[1].y == right.col[1].y and
+		left.col[1].z == right.col[1].z and
+		left.col[2].x == right.col[2].x and
+		left.col[2].y == right.col[2].y and
+		left.col[2].z == right.col[2].z and
+		left.col[3].x == right.col[3].x and
+		left.col[3].y == right.col[3].y and
+		left.col[3].z == right.col[3].z;
+}
+
 template<class T>
 inline BMATH_CONSTEXPR bool operator !=(matrix<T, 2, 2> left, matrix<T, 2, 2> right) {
 	return
@@ -1815,6 +2826,23 @@ inline BMATH_CONSTEXPR bool operator !=(matrix<T, 4, 4> left, matrix<T, 4, 4> ri
 		left.col[3].w != right.col[3].w;
 }
 
+template<class T>
+inline BMATH_CONSTEXPR bool operator !=(matrix<T, 4, 3> left, matrix<T, 4, 3> right) {
+	return
+		left.col[0].x != right.col[0].x or
+		left.col[0].y != right.col[0].y or
+		left.col[0].z != right.col[0].z or
+		left.col[1].x != right.col[1].x or
+		left.col[1].y != right.col[1].y or
+		left.col[1].z != right.col[1].z or
+		left.col[2].x != right.col[2].x or
+		left.col[2].y != right.col[2].y or
+		left.col[2].z != right.col[2].z or
+		left.col[3].x != right.col[3].x or
+		left.col[3].y != right.col[3].y or
+		left.col[3].z != right.col[3].z;
+}
+
 template<class T, int C, int R>
 inline matrix<T, C, R> &operator +=(matrix<T, C, R> &left, matrix<T, C, R> right) {
 	return left = left + right;
@@ -1830,6 +2858,11 @@ inline matrix<T, N, N> &operator *=(matrix<T, N, N> &left, matrix<T, N, N> right
 	return left = left * right;
 }
 
+template<class T>
+inline matrix<T, 4, 3> &operator *=(matrix<T, 4, 3> &left, matrix<T, 4, 3> right) {
+	return left = left * right;
+}
+
 template<class T, int C, int R>
 inline matrix<T, C, R> &operator /=(matrix<T, C, R> &left, matrix<T, C, R> right) {
 	return left = left / right;
@@ -1855,6 +2888,69 @@ inline matrix<T, C, R> &operator /=(matrix<T, C, R> &left, T right) {
 	return left = left / right;
 }
 
+#ifdef BMATH_HAS_SSE2
+
+// The SSE matrix products do the same multiplies and adds in the same order as
+// the scalar code above, so they give bit-identical results (0 ulp difference)
+// as long as the compiler doesn't contract the scalar code into fused multiply-adds.
+
+inline __m128 b__mulMat4Vec4(__m128 c0, __m128 c1, __m128 c2, __m128 c3, __m128 v) {
+	__m128 result =             _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+	result = _mm_add_ps(result, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+	result = _mm_add_ps(result, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+	result = _mm_add_ps(result, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+	return result;
+}
+
+#ifdef BMATH_HAS_AVX
+inline __m256 b__mulMat4Vec4x2(__m256 c0, __m256 c1, __m256 c2, __m256 c3, __m256 v) {
+	__m256 result =                _mm256_mul_ps(c0, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+	result = _mm256_add_ps(result, _mm256_mul_ps(c1, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+	result = _mm256_add_ps(result, _mm256_mul_ps(c2, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+	result = _mm256_add_ps(result, _mm256_mul_ps(c3, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+	return result;
+}
+#endif
+
+inline vec4 operator *(mat4 left, vec4 right) {
+	// broadcasting each component separately avoids a store forwarding stall when
+	// right was just built from scalars, such as vec4(point, 1)
+	__m128 result =             _mm_mul_ps(left.col[0].simd, _mm_set1_ps(right.x));
+	result = _mm_add_ps(result, _mm_mul_ps(left.col[1].simd, _mm_set1_ps(right.y)));
+	result = _mm_add_ps(result, _mm_mul_ps(left.col[2].simd, _mm_set1_ps(right.z)));
+	result = _mm_add_ps(result, _mm_mul_ps(left.col[3].simd, _mm_set1_ps(right.w)));
+	return vec4(result);
+}
+
+inline mat4 operator *(mat4 left, mat4 right) {
+	mat4 result;
+	#if defined BMATH_HAS_AVX
+	{
+		// two columns of the result at once - the left matrix is broadcast to both 128-bit lanes
+		__m256 c0 = _mm256_broadcast_ps(&left.col[0].simd);
+		__m256 c1 = _mm256_broadcast_ps(&left.col[1].simd);
+		__m256 c2 = _mm256_broadcast_ps(&left.col[2].simd);
+		__m256 c3 = _mm256_broadcast_ps(&left.col[3].simd);
+		_mm256_storeu_ps(&result.col[0].x, b__mulMat4Vec4x2(c0, c1, c2, c3, _mm256_loadu_ps(&right.col[0].x)));
+		_mm256_storeu_ps(&result.col[2].x, b__mulMat4Vec4x2(c0, c1, c2, c3, _mm256_loadu_ps(&right.col[2].x)));
+	}
+	#else
+	{
+		__m128 c0 = left.col[0].simd;
+		__m128 c1 = left.col[1].simd;
+		__m128 c2 = left.col[2].simd;
+		__m128 c3 = left.col[3].simd;
+		result.col[0].simd = b__mulMat4Vec4(c0, c1, c2, c3, right.col[0].simd);
+		result.col[1].simd = b__mulMat4Vec4(c0, c1, c2, c3, right.col[1].simd);
+		result.col[2].simd = b__mulMat4Vec4(c0, c1, c2, c3, right.col[2].simd);
+		result.col[3].simd = b__mulMat4Vec4(c0, c1, c2, c3, right.col[3].simd);
+	}
+	#endif
+	return result;
+}
+
+#endif // BMATH_HAS_SSE2
+
 // Quaternion Operators
 
 template<class T>
@@ -2041,6 +3137,59 @@ inline quaternion<T> &operator /=(quaternion<T> &left, T right) {
 	return left = left / right;
 }
 
+// Dual Quaternion Operators
+
+template<class T>
+inline BMATH_CONSTEXPR dualquaternion<T> operator -(dualquaternion<T> q) {
+	return dualquaternion<T>(-q.real, -q.dual);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR dualquaternion<T> operator +(dualquaternion<T> left, dualquaternion<T> right) {
+	return dualquaternion<T>(left.real + right.real, left.dual + right.dual);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR dualquaternion<T> operator -(dualquaternion<T> left, dualquaternion<T> right) {
+	return dualquaternion<T>(left.real - right.real, left.dual - right.dual);
+}
+
+// Composes the transforms: right is applied first, then left.
+template<class T>
+inline BMATH_CONSTEXPR dualquaternion<T> operator *(dualquaternion<T> left, dualquaternion<T> right) {
+	return dualquaternion<T>(left.real * right.real, left.real * right.dual + left.dual * right.real);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR dualquaternion<T> operator *(dualquaternion<T> left, T right) {
+	return dualquaternion<T>(left.real * right, left.dual * right);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR dualquaternion<T> operator *(T left, dualquaternion<T> right) {
+	return dualquaternion<T>(left * right.real, left * right.dual);
+}
+
+template<class T>
+inline dualquaternion<T> &operator +=(dualquaternion<T> &left, dualquaternion<T> right) {
+	return left = left + right;
+}
+
+template<class T>
+inline dualquaternion<T> &operator -=(dualquaternion<T> &left, dualquaternion<T> right) {
+	return left = left - right;
+}
+
+template<class T>
+inline dualquaternion<T> &operator *=(dualquaternion<T> &left, dualquaternion<T> right) {
+	return left = left * right;
+}
+
+template<class T>
+inline dualquaternion<T> &operator *=(dualquaternion<T> &left, T right) {
+	return left = left * right;
+}
+
 // Trigonometric Functions
 
 using std::sin;
@@ -2057,17 +3206,95 @@ using std::asinh;
 using std::acosh;
 using std::atanh;
 
-template<class T> 
-inline BMATH_CONSTEXPR T radians(T degrees) {
-	return degrees * T(3.141592653589793) / T(180);
+template<class T>
+inline vector<T, 2> sin(vector<T, 2> v) {
+	return vector<T, 2>(
+		sin(v.x),
+		sin(v.y));
 }
 
-template<class T> 
-inline BMATH_CONSTEXPR T degrees(T radians) {
-	return radians * T(180) / T(3.141592653589793);
+template<class T>
+inline vector<T, 3> sin(vector<T, 3> v) {
+	return vector<T, 3>(
+		sin(v.x),
+		sin(v.y),
+		sin(v.z));
 }
 
-// Exponential Functions
+template<class T>
+inline vector<T, 4> sin(vector<T, 4> v) {
+	return vector<T, 4>(
+		sin(v.x),
+		sin(v.y),
+		sin(v.z),
+		sin(v.w));
+}
+
+template<class T>
+inline vector<T, 2> cos(vector<T, 2> v) {
+	return vector<T, 2>(
+		cos(v.x),
+		cos(v.y));
+}
+
+template<class T>
+inline vector<T, 3> cos(vector<T, 3> v) {
+	return vector<T, 3>(
+		cos(v.x),
+		cos(v.y),
+		cos(v.z));
+}
+
+template<class T>
+inline vector<T, 4> cos(vector<T, 4> v) {
+	return vector<T, 4>(
+		cos(v.x),
+		cos(v.y),
+		cos(v.z),
+		cos(v.w));
+}
+
+template<class T, int N>
+inline void sincos(vector<T, N> v, vector<T, N> *sine, vector<T, N> *cosine) {
+	*sine = sin(v);
+	*cosine = cos(v);
+}
+
+template<class T>
+inline vector<T, 2> tan(vector<T, 2> v) {
+	return vector<T, 2>(
+		tan(v.x),
+		tan(v.y));
+}
+
+template<class T>
+inline vector<T, 3> tan(vector<T, 3> v) {
+	return vector<T, 3>(
+		tan(v.x),
+		tan(v.y),
+		tan(v.z));
+}
+
+template<class T>
+inline vector<T, 4> tan(vector<T, 4> v) {
+	return vector<T, 4>(
+		tan(v.x),
+		tan(v.y),
+		tan(v.z),
+		tan(v.w));
+}
+
+template<class T> 
+inline BMATH_CONSTEXPR T radians(T degrees) {
+	return degrees * T(3.141592653589793) / T(180);
+}
+
+template<class T> 
+inline BMATH_CONSTEXPR T degrees(T radians) {
+	return radians * T(180) / T(3.141592653589793);
+}
+
+// Exponential Functions
 
 using std::pow;
 using std::exp;
@@ -2235,6 +3462,237 @@ inline vector<T, 4> log2(vector<T, 4> v) {
 
 #endif
 
+// Constant Evaluated Functions
+
+// Versions of sqrt, sin, cos, tan, acos and atan2 that can run at compile time, for
+// the functions that build transforms (rotationMat, perspectiveMat, rotationQuat ..).
+// These evaluate in double precision, and are within 6 ulp of the runtime functions
+// for doubles, and almost always round to the same float. They fail to compile
+// (by calling the runtime function) for inputs they can't handle, like sqrt(-1) or
+// sin(1e7). The b__ wrappers call them in constant expressions and the normal
+// functions otherwise, so the generated code doesn't change. This needs C++20 or GCC 9
+// or Clang 9 in C++14 mode. With BMATH_SIMD the float vec4, mat4 and quat functions can't
+// be constant expressions anyway, but the double ones can.
+
+#ifdef BMATH_HAS_CONSTANT_EVALUATED
+
+// scales x by powers of 4 into [0.25, 1), so that Newton's method starting from 1
+// converges in a fixed number of steps, then undoes the scaling (all exact)
+inline constexpr double b__constexprSqrt(double x) {
+	if (!(x > 0) || x + x == x)
+		return x == 0 ? x : sqrt(x); // 0, negative, inf and NaN
+	double d = x;
+	double scale = 1;
+	while (d >= 1) {
+		d *= 0.25;
+		scale *= 2;
+	}
+	while (d < 0.25) {
+		d *= 4;
+		scale *= 0.5;
+	}
+	double r = 1;
+	for (int i = 0; i < 6; ++i)
+		r = 0.5 * (r + d / r);
+	return r * scale;
+}
+
+#define b__HALF_PI_HI 1.5707963267948966
+#define b__HALF_PI_LO 6.123233995736766e-17
+
+// Reduces x to r in [-pi/4, pi/4] with x = r + quadrant * pi/2. pi/2 is split into
+// 33 bit parts (as in fdlibm), so that k times each part is exact for |x| < 1e6.
+inline constexpr double b__constexprReduce(double x, int *quadrant) {
+	if (!(x > -1e6 && x < 1e6))
+		return sin(x); // inf, NaN or too big - not a constant expression
+	double q = x * (1 / b__HALF_PI_HI);
+	double k = double((long long)(q >= 0 ? q + 0.5 : q - 0.5));
+	*quadrant = int((long long)k & 3);
+	double r = x - k * 1.57079632673412561417e+00;
+	r -= k * 6.07710050630396597660e-11;
+	r -= k * 2.02226624871116645580e-21;
+	return r - k * 8.47842766036889956997e-32;
+}
+
+// Taylor series - with |r| <= pi/4 the terms fall below 1e-17 after x^21
+inline constexpr double b__constexprSinKernel(double r) {
+	double r2 = r * r;
+	double term = r;
+	double sum = r;
+	for (int i = 2; i <= 22; i += 2) {
+		term *= -r2 / double(i * (i + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+inline constexpr double b__constexprCosKernel(double r) {
+	double r2 = r * r;
+	double term = 1;
+	double sum = 1;
+	for (int i = 1; i <= 21; i += 2) {
+		term *= -r2 / double(i * (i + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+inline constexpr double b__constexprSin(double x) {
+	int quadrant = 0;
+	double r = b__constexprReduce(x, &quadrant);
+	switch (quadrant) {
+		case 0:  return +b__constexprSinKernel(r);
+		case 1:  return +b__constexprCosKernel(r);
+		case 2:  return -b__constexprSinKernel(r);
+		default: return -b__constexprCosKernel(r);
+	}
+}
+
+inline constexpr double b__constexprCos(double x) {
+	int quadrant = 0;
+	double r = b__constexprReduce(x, &quadrant);
+	switch (quadrant) {
+		case 0:  return +b__constexprCosKernel(r);
+		case 1:  return -b__constexprSinKernel(r);
+		case 2:  return -b__constexprCosKernel(r);
+		default: return +b__constexprSinKernel(r);
+	}
+}
+
+inline constexpr double b__constexprTan(double x) {
+	int quadrant = 0;
+	double r = b__constexprReduce(x, &quadrant);
+	double s = b__constexprSinKernel(r);
+	double c = b__constexprCosKernel(r);
+	return quadrant & 1 ? -c / s : s / c;
+}
+
+// atan for x >= 0: reduces to |t| <= tan(pi/8) with atan(x) = pi/2 - atan(1/x) and
+// atan(x) = pi/4 + atan((x - 1) / (x + 1)), where the series converges quickly
+inline constexpr double b__constexprAtan(double x) {
+	double offset = 0;
+	bool inverted = x > 1;
+	if (inverted)
+		x = 1 / x;
+	if (x > 0.41421356237309503) {
+		x = (x - 1) / (x + 1);
+		offset = b__HALF_PI_HI * 0.5;
+	}
+	double x2 = x * x;
+	double power = x;
+	double sum = 0;
+	for (int i = 1; i <= 45; i += 2) {
+		sum += power / double(i);
+		power *= -x2;
+	}
+	sum += offset;
+	return inverted ? (b__HALF_PI_HI - sum) + b__HALF_PI_LO : sum;
+}
+
+// -0 is treated as +0, since the sign of zero can't be read in a constant expression
+inline constexpr double b__constexprAtan2(double y, double x) {
+	double dy = y;
+	double dx = x;
+	double ay = dy < 0 ? -dy : dy;
+	double ax = dx < 0 ? -dx : dx;
+	if (!(ay + ay != ay || ay == 0) || !(ax + ax != ax || ax == 0))
+		return atan2(y, x); // NaN or infinite - not a constant expression
+	if (ay == 0 && ax == 0)
+		return 0;
+	double angle = ax == 0 ? b__HALF_PI_HI : b__constexprAtan(ay / ax);
+	if (dx < 0)
+		angle = (2 * b__HALF_PI_HI - angle) + 2 * b__HALF_PI_LO;
+	return dy < 0 ? -angle : angle;
+}
+
+inline constexpr double b__constexprAcos(double x) {
+	if (!(x >= -1 && x <= 1))
+		return acos(x); // NaN - not a constant expression
+	return b__constexprAtan2(b__constexprSqrt((1 - x) * (1 + x)), x);
+}
+
+#undef b__HALF_PI_HI
+#undef b__HALF_PI_LO
+
+#endif // BMATH_HAS_CONSTANT_EVALUATED
+
+// The float and double overloads can be constant evaluated, everything else (like
+// floatN or long double) goes through the template and just calls the normal function.
+#ifdef BMATH_HAS_CONSTANT_EVALUATED
+#	define b__CONSTANT_EVALUATED_OVERLOAD(T, name, constexprName) \
+		inline constexpr T b__##name(T x) { \
+			return b__IS_CONSTANT_EVALUATED() ? T(constexprName(double(x))) : name(x); \
+		}
+#	define b__CONSTANT_EVALUATED_FUNCTION(name, constexprName) \
+		b__CONSTANT_EVALUATED_OVERLOAD(float, name, constexprName) \
+		b__CONSTANT_EVALUATED_OVERLOAD(double, name, constexprName) \
+		template<class T> \
+		inline T b__##name(T x) { \
+			return name(x); \
+		}
+#	define b__CONSTANT_EVALUATED_OVERLOAD2(T, name, constexprName) \
+		inline constexpr T b__##name(T a, T b) { \
+			return b__IS_CONSTANT_EVALUATED() ? T(constexprName(double(a), double(b))) : name(a, b); \
+		}
+#	define b__CONSTANT_EVALUATED_FUNCTION2(name, constexprName) \
+		b__CONSTANT_EVALUATED_OVERLOAD2(float, name, constexprName) \
+		b__CONSTANT_EVALUATED_OVERLOAD2(double, name, constexprName) \
+		template<class T> \
+		inline T b__##name(T a, T b) { \
+			return name(a, b); \
+		}
+#else
+#	define b__CONSTANT_EVALUATED_FUNCTION(name, constexprName) \
+		template<class T> \
+		inline T b__##name(T x) { \
+			return name(x); \
+		}
+#	define b__CONSTANT_EVALUATED_FUNCTION2(name, constexprName) \
+		template<class T> \
+		inline T b__##name(T a, T b) { \
+			return name(a, b); \
+		}
+#endif
+
+b__CONSTANT_EVALUATED_FUNCTION(sqrt, b__constexprSqrt)
+b__CONSTANT_EVALUATED_FUNCTION(sin, b__constexprSin)
+b__CONSTANT_EVALUATED_FUNCTION(cos, b__constexprCos)
+b__CONSTANT_EVALUATED_FUNCTION(tan, b__constexprTan)
+b__CONSTANT_EVALUATED_FUNCTION(acos, b__constexprAcos)
+b__CONSTANT_EVALUATED_FUNCTION2(atan2, b__constexprAtan2)
+
+#undef b__CONSTANT_EVALUATED_OVERLOAD
+#undef b__CONSTANT_EVALUATED_FUNCTION
+#undef b__CONSTANT_EVALUATED_OVERLOAD2
+#undef b__CONSTANT_EVALUATED_FUNCTION2
+
+// The vector atan2 is here instead of with the other trigonometric functions, since
+// it uses b__atan2 so that it can be constant evaluated.
+
+template<class T>
+inline BMATH_CONSTEXPR_MATH vector<T, 2> atan2(vector<T, 2> y, vector<T, 2> x) {
+	return vector<T, 2>(
+		b__atan2(y.x, x.x),
+		b__atan2(y.y, x.y));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR_MATH vector<T, 3> atan2(vector<T, 3> y, vector<T, 3> x) {
+	return vector<T, 3>(
+		b__atan2(y.x, x.x),
+		b__atan2(y.y, x.y),
+		b__atan2(y.z, x.z));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR_MATH vector<T, 4> atan2(vector<T, 4> y, vector<T, 4> x) {
+	return vector<T, 4>(
+		b__atan2(y.x, x.x),
+		b__atan2(y.y, x.y),
+		b__atan2(y.z, x.z),
+		b__atan2(y.w, x.w));
+}
+
 // Common Functions
 
 using std::abs;
@@ -2670,6 +4128,81 @@ inline BMATH_CONSTEXPR vector<bool, 4> isinf(vector<T, 4> v) {
 		isinf(v.w));
 }
 
+#ifdef BMATH_HAS_SSE2
+
+inline __m128 b__horizontalSum4(__m128 v) {
+	__m128 sum = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+inline vec4 max(vec4 a, vec4 b) {
+	return vec4(_mm_max_ps(a.simd, b.simd));
+}
+
+inline vec4 min(vec4 a, vec4 b) {
+	return vec4(_mm_min_ps(a.simd, b.simd));
+}
+
+inline vec4 abs(vec4 v) {
+	return vec4(_mm_andnot_ps(_mm_set1_ps(-0.0f), v.simd));
+}
+
+inline vec4 sqrt(vec4 v) {
+	return vec4(_mm_sqrt_ps(v.simd));
+}
+
+inline float compSum(vec4 v) {
+	return _mm_cvtss_f32(b__horizontalSum4(v.simd));
+}
+
+inline float compMax(vec4 v) {
+	__m128 m = _mm_max_ps(v.simd, _mm_shuffle_ps(v.simd, v.simd, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(_mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+inline float compMin(vec4 v) {
+	__m128 m = _mm_min_ps(v.simd, _mm_shuffle_ps(v.simd, v.simd, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(_mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+#ifdef BMATH_HAS_SSE41
+
+inline ivec4 max(ivec4 a, ivec4 b) {
+	return ivec4(_mm_max_epi32(a.simd, b.simd));
+}
+
+inline uvec4 max(uvec4 a, uvec4 b) {
+	return uvec4(_mm_max_epu32(a.simd, b.simd));
+}
+
+inline ivec4 min(ivec4 a, ivec4 b) {
+	return ivec4(_mm_min_epi32(a.simd, b.simd));
+}
+
+inline uvec4 min(uvec4 a, uvec4 b) {
+	return uvec4(_mm_min_epu32(a.simd, b.simd));
+}
+
+inline ivec4 abs(ivec4 v) {
+	return ivec4(_mm_abs_epi32(v.simd));
+}
+
+inline vec4 floor(vec4 v) {
+	return vec4(_mm_floor_ps(v.simd));
+}
+
+inline vec4 trunc(vec4 v) {
+	return vec4(_mm_round_ps(v.simd, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+}
+
+inline vec4 ceil(vec4 v) {
+	return vec4(_mm_ceil_ps(v.simd));
+}
+
+#endif // BMATH_HAS_SSE41
+
+#endif // BMATH_HAS_SSE2
+
 // Color Space Functions
 
 inline BMATH_CONSTEXPR vec4 unpackRGBA8(uint r8g8b8a8) {
@@ -2680,11 +4213,12 @@ inline BMATH_CONSTEXPR vec4 unpackRGBA8(uint r8g8b8a8) {
 	return vec4(r, g, b, a) * (1.0f / 255.0f);
 }
 
+// Values outside [0, 1] are clamped.
 inline BMATH_CONSTEXPR uint packRGBA8(vec4 rgba) {
-	uint r = uint(rgba.x * 255.5f);
-	uint g = uint(rgba.g * 255.5f);
-	uint b = uint(rgba.b * 255.5f);
-	uint a = uint(rgba.a * 255.5f);
+	uint r = uint(clamp(rgba.r, 0.0f, 1.0f) * 255.5f);
+	uint g = uint(clamp(rgba.g, 0.0f, 1.0f) * 255.5f);
+	uint b = uint(clamp(rgba.b, 0.0f, 1.0f) * 255.5f);
+	uint a = uint(clamp(rgba.a, 0.0f, 1.0f) * 255.5f);
 	return
 		(r << 24) |
 		(g << 16) |
@@ -2692,6 +4226,126 @@ inline BMATH_CONSTEXPR uint packRGBA8(vec4 rgba) {
 		(a <<  0);
 }
 
+// Exact sRGB transfer functions. The vec4 versions leave alpha as it is, since it
+// is always linear.
+
+inline float SRGBtoLinear(float c) {
+	return c <= 0.04045f ? c * (1.0f / 12.92f) : std::pow((c + 0.055f) * (1.0f / 1.055f), 2.4f);
+}
+
+inline float linearToSRGB(float c) {
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+inline vec3 SRGBtoLinear(vec3 srgb) {
+	return vec3(SRGBtoLinear(srgb.r), SRGBtoLinear(srgb.g), SRGBtoLinear(srgb.b));
+}
+
+inline vec3 linearToSRGB(vec3 rgb) {
+	return vec3(linearToSRGB(rgb.r), linearToSRGB(rgb.g), linearToSRGB(rgb.b));
+}
+
+inline vec4 SRGBtoLinear(vec4 srgba) {
+	return vec4(SRGBtoLinear(srgba.r), SRGBtoLinear(srgba.g), SRGBtoLinear(srgba.b), srgba.a);
+}
+
+inline vec4 linearToSRGB(vec4 rgba) {
+	return vec4(linearToSRGB(rgba.r), linearToSRGB(rgba.g), linearToSRGB(rgba.b), rgba.a);
+}
+
+// Lookup tables for converting between 8 bit sRGB and linear floats, built on first use.
+// Linear to sRGB goes through thresholds: the result is k when
+// threshold[k] <= linear < threshold[k + 1]. To find k without a search, the range
+// [2^-13, 1] is split into 128 buckets per power of 2 (by the top float bits) which
+// are narrower than the gap between any 2 thresholds. So k is either the value at the
+// start of the bucket, or one more than that. Everything below 2^-13 rounds to 0.
+// This gives the exact sRGB value rounded to nearest for every float.
+struct b__srgbTables {
+	float toLinear[256];
+	float threshold[257];
+	unsigned char bucket[13 * 128 + 1];
+
+	inline b__srgbTables() {
+		for (int i = 0; i < 256; ++i) {
+			double c = i / 255.0;
+			toLinear[i] = float(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+		}
+
+		// smallest float that is >= the linear value of sRGB (k - 0.5) / 255
+		threshold[0] = 0;
+		threshold[256] = 2; // never reached since the input is clamped to 1
+		for (int k = 1; k < 256; ++k) {
+			double c = (k - 0.5) / 255.0;
+			double linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+			float f = float(linear);
+			if (f < linear) {
+				uint bits;
+				memcpy(&bits, &f, sizeof bits);
+				++bits;
+				memcpy(&f, &bits, sizeof f);
+			}
+			threshold[k] = f;
+		}
+
+		int k = 0;
+		for (uint i = 0; i < sizeof bucket; ++i) {
+			uint bits = minBits + (i << 16);
+			float start;
+			memcpy(&start, &bits, sizeof start);
+			while (k < 255 && threshold[k + 1] <= start)
+				++k;
+			bucket[i] = (unsigned char)k;
+		}
+	}
+
+	static const uint minBits = 0x39000000; // 2^-13
+};
+
+inline const b__srgbTables &b__srgb() {
+	static const b__srgbTables tables;
+	return tables;
+}
+
+inline uint b__linearToSRGB8(const b__srgbTables &tables, float linear) {
+	float x = clamp(linear, 1.220703125e-4f, 1.0f); // [2^-13, 1]
+	uint bits;
+	memcpy(&bits, &x, sizeof bits);
+	uint k = tables.bucket[(bits - b__srgbTables::minBits) >> 16];
+	return k + (x >= tables.threshold[k + 1]);
+}
+
+// Like unpackRGBA8, but converts r, g, b from sRGB to linear (using a lookup table).
+inline vec4 unpackSRGBA8(uint r8g8b8a8) {
+	const b__srgbTables &tables = b__srgb();
+	return vec4(
+		tables.toLinear[(r8g8b8a8 >> 24) & 0xFF],
+		tables.toLinear[(r8g8b8a8 >> 16) & 0xFF],
+		tables.toLinear[(r8g8b8a8 >>  8) & 0xFF],
+		float(r8g8b8a8 & 0xFF) * (1.0f / 255.0f));
+}
+
+// Like packRGBA8, but converts r, g, b from linear to sRGB. They are rounded to the
+// nearest 8 bit value, exactly as if linearToSRGB were evaluated with infinite precision.
+inline uint packSRGBA8(vec4 rgba) {
+	const b__srgbTables &tables = b__srgb();
+	return
+		(b__linearToSRGB8(tables, rgba.r) << 24) |
+		(b__linearToSRGB8(tables, rgba.g) << 16) |
+		(b__linearToSRGB8(tables, rgba.b) <<  8) |
+		(uint(clamp(rgba.a, 0.0f, 1.0f) * 255.5f));
+}
+
+inline BMATH_CONSTEXPR vec4 premultiplyAlpha(vec4 rgba) {
+	return vec4(rgba.r * rgba.a, rgba.g * rgba.a, rgba.b * rgba.a, rgba.a);
+}
+
+// Fully transparent colors become 0.
+inline BMATH_CONSTEXPR vec4 unpremultiplyAlpha(vec4 rgba) {
+	return rgba.a == 0
+		? vec4(0, 0, 0, 0)
+		: vec4(rgba.r / rgba.a, rgba.g / rgba.a, rgba.b / rgba.a, rgba.a);
+}
+
 inline BMATH_CONSTEXPR vec3 HSVtoRGB(vec3 hsv) {
 	float h = hsv.x;
 	float s = hsv.y;
@@ -2721,6 +4375,7 @@ inline BMATH_CONSTEXPR vec3 RGBtoHSV(vec3 rgb) {
 	float v = max;
 	float s = delta / max;
 	float h =
+		delta == 0 ? 0 :
 		rgb.x == max ? (rgb.g - rgb.b) / (6 * delta) + 0 / 3.0f :
 		rgb.y == max ? (rgb.b - rgb.r) / (6 * delta) + 1 / 3.0f :
 		(rgb.r - rgb.g) / (6 * delta) + 2 / 3.0f;
@@ -2754,17 +4409,17 @@ inline BMATH_CONSTEXPR T distanceSq(vector<T, N> p1, vector<T, N> p2) {
 }
 
 template<class T, int N>
-inline T length(vector<T, N> v) {
-	return sqrt(dot(v, v));
+inline BMATH_CONSTEXPR_MATH T length(vector<T, N> v) {
+	return b__sqrt(dot(v, v));
 }
 
 template<class T, int N>
-inline T distance(vector<T, N> p1, vector<T, N> p2) {
+inline BMATH_CONSTEXPR_MATH T distance(vector<T, N> p1, vector<T, N> p2) {
 	return length(p1 - p2);
 }
 
 template<class T, int N>
-inline vector<T, N> normalize(vector<T, N> v) {
+inline BMATH_CONSTEXPR_MATH vector<T, N> normalize(vector<T, N> v) {
 	return v / length(v);
 }
 
@@ -2803,7 +4458,7 @@ inline BMATH_CONSTEXPR vector<T, N> lerp(vector<T, N> from, vector<T, N> to, T a
 }
 
 template<class T>
-inline vector<T, 3> slerp(vector<T, 3> from, vector<T, 3> to, T amount) {
+inline BMATH_CONSTEXPR_MATH vector<T, 3> slerp(vector<T, 3> from, vector<T, 3> to, T amount) {
 	vector<T, 3> z = to;
 
 	T cosTheta = dot(from, to);
@@ -2818,10 +4473,111 @@ inline vector<T, 3> slerp(vector<T, 3> from, vector<T, 3> to, T amount) {
 		return lerp(from, to, amount);
 
 	// Essential Mathematics, page 467.
-	T angle = acos(cosTheta);
-	return (sin((T(1) - amount) * angle) * from + sin(amount * angle) * z) / sin(angle);
+	T angle = b__acos(cosTheta);
+	return (b__sin((T(1) - amount) * angle) * from + b__sin(amount * angle) * z) / b__sin(angle);
+}
+
+#ifdef BMATH_HAS_SSE2
+
+inline float dot(vec4 left, vec4 right) {
+	return _mm_cvtss_f32(b__horizontalSum4(_mm_mul_ps(left.simd, right.simd)));
+}
+
+inline float length(vec4 v) {
+	return _mm_cvtss_f32(_mm_sqrt_ss(b__horizontalSum4(_mm_mul_ps(v.simd, v.simd))));
+}
+
+inline vec4 normalize(vec4 v) {
+	return vec4(_mm_div_ps(v.simd, _mm_sqrt_ps(b__horizontalSum4(_mm_mul_ps(v.simd, v.simd)))));
+}
+
+#endif // BMATH_HAS_SSE2
+
+// Fast Approximate Functions
+
+// These use the SSE rsqrt and rcp instructions (12 bit estimates) refined with one
+// Newton-Raphson step, which is several times faster than a sqrt and divide. The
+// maximum relative error, measured over 2*10^7 random inputs, is:
+//   fastRcp                               2.0e-7 (1.7 * FLT_EPSILON)
+//   fastInverseSqrt                       2.8e-7 (2.3 * FLT_EPSILON)
+//   fastLength, fastInverseLength         3.2e-7 (2.7 * FLT_EPSILON)
+//   fastNormalize (length of the result)  3.4e-7 (2.9 * FLT_EPSILON)
+// instead of about 1 FLT_EPSILON for the exact functions. The results may also differ
+// between cpu vendors since the estimates aren't exactly specified. Without SSE
+// these just call the exact functions.
+// Zero and infinity come out differently on the two paths. With SSE, the Newton step
+// turns both into NaN for fastRcp, fastInverseSqrt and fastInverseLength. Without SSE,
+// zero gives infinity and infinity gives 0, like the exact functions. Either way,
+// fastNormalize of a zero vector is NaN, same as normalize, and fastLength of a zero
+// vector is 0.
+
+inline float fastRcp(float x) {
+	#if defined BMATH_HAS_SSE2 || defined BMATH_HAS_DISPATCH
+	{
+		float y = _mm_cvtss_f32(_mm_rcp_ss(_mm_set_ss(x)));
+		return y * (2.0f - x * y);
+	}
+	#else
+		return 1.0f / x;
+	#endif
+}
+
+inline float fastInverseSqrt(float x) {
+	#if defined BMATH_HAS_SSE2 || defined BMATH_HAS_DISPATCH
+	{
+		float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+		return y * (1.5f - 0.5f * x * y * y);
+	}
+	#else
+		return 1.0f / sqrt(x);
+	#endif
+}
+
+template<int N>
+inline vector<float, N> fastRcp(vector<float, N> v) {
+	vector<float, N> result;
+	for (int i = 0; i < N; ++i)
+		result[i] = fastRcp(v[i]);
+	return result;
 }
 
+template<int N>
+inline float fastInverseLength(vector<float, N> v) {
+	return fastInverseSqrt(dot(v, v));
+}
+
+template<int N>
+inline float fastLength(vector<float, N> v) {
+	// clamp so that a zero vector gives 0 * finite instead of 0 * NaN
+	float lengthSq = dot(v, v);
+	return lengthSq * fastInverseSqrt(max(lengthSq, 1.17549435e-38f));
+}
+
+template<int N>
+inline vector<float, N> fastNormalize(vector<float, N> v) {
+	return v * fastInverseSqrt(dot(v, v));
+}
+
+#ifdef BMATH_HAS_SSE2
+
+inline vec4 fastRcp(vec4 v) {
+	__m128 y = _mm_rcp_ps(v.simd);
+	return vec4(_mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(v.simd, y))));
+}
+
+// 1 / sqrt of every component of x
+inline __m128 b__fastInverseSqrt4(__m128 x) {
+	__m128 y = _mm_rsqrt_ps(x);
+	__m128 halfXYY = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), y), y);
+	return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), halfXYY));
+}
+
+inline vec4 fastNormalize(vec4 v) {
+	return vec4(_mm_mul_ps(v.simd, b__fastInverseSqrt4(b__horizontalSum4(_mm_mul_ps(v.simd, v.simd)))));
+}
+
+#endif // BMATH_HAS_SSE2
+
 // Matrix Functions
 
 template<class T>
@@ -3014,6 +4770,278 @@ inline BMATH_CONSTEXPR matrix<T, 4, 4> inverse(matrix<T, 4, 4> m) {
 	return inverse / (d.x + d.y + d.z + d.w);
 }
 
+// Inverse of an affine transform - the bottom row is assumed to be (0, 0, 0, 1).
+// Much cheaper than the general inverse.
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> inverseAffine(matrix<T, 4, 3> m) {
+	// the rows of the inverse 3x3 are the cross products of the columns over the determinant
+	vector<T, 3> r0 = cross(m.col[1], m.col[2]);
+	vector<T, 3> r1 = cross(m.col[2], m.col[0]);
+	vector<T, 3> r2 = cross(m.col[0], m.col[1]);
+	T inverseDet = T(1) / dot(m.col[0], r0);
+	r0 = r0 * inverseDet;
+	r1 = r1 * inverseDet;
+	r2 = r2 * inverseDet;
+	vector<T, 3> t = m.col[3];
+
+	return matrix<T, 4, 3>(
+		r0.x, r1.x, r2.x,
+		r0.y, r1.y, r2.y,
+		r0.z, r1.z, r2.z,
+		-dot(r0, t), -dot(r1, t), -dot(r2, t));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 4> inverseAffine(matrix<T, 4, 4> m) {
+	return matrix<T, 4, 4>(inverseAffine(matrix<T, 4, 3>(m)));
+}
+
+// Inverse of a rotation + translation (no scale or shear) - the rotation part
+// is just transposed. Cheaper still than inverseAffine.
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 3> inverseRigid(matrix<T, 4, 3> m) {
+	vector<T, 3> r0 = m.col[0];
+	vector<T, 3> r1 = m.col[1];
+	vector<T, 3> r2 = m.col[2];
+	vector<T, 3> t = m.col[3];
+
+	return matrix<T, 4, 3>(
+		r0.x, r1.x, r2.x,
+		r0.y, r1.y, r2.y,
+		r0.z, r1.z, r2.z,
+		-dot(r0, t), -dot(r1, t), -dot(r2, t));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 4> inverseRigid(matrix<T, 4, 4> m) {
+	return matrix<T, 4, 4>(inverseRigid(matrix<T, 4, 3>(m)));
+}
+
+// translationMat(translation) * quatToMat(rotation) * scaleMat(scale), built directly
+// from the decomposed transform without the matrix products.
+template<class T>
+inline matrix<T, 4, 4> trsMat(vector<T, 3> translation, quaternion<T> rotation, vector<T, 3> scale) {
+	matrix<T, 4, 4> r = quatToMat(rotation);
+	r.col[0] *= scale.x;
+	r.col[1] *= scale.y;
+	r.col[2] *= scale.z;
+	r.col[3] = vector<T, 4>(translation, T(1));
+	return r;
+}
+
+// Inverse of translationMat(translation) * quatToMat(rotation) * scaleMat(scale),
+// built directly from the decomposed transform. The rotation must be normalized.
+template<class T>
+inline matrix<T, 4, 4> inverseTRS(vector<T, 3> translation, quaternion<T> rotation, vector<T, 3> scale) {
+	// scaleMat(1 / scale) * transpose(quatToMat(rotation)) * translationMat(-translation)
+	// so the rows of the inverse are the columns of the rotation over the scale
+	matrix<T, 4, 4> r = quatToMat(rotation);
+	vector<T, 3> r0 = vector<T, 3>(r.col[0]) / scale.x;
+	vector<T, 3> r1 = vector<T, 3>(r.col[1]) / scale.y;
+	vector<T, 3> r2 = vector<T, 3>(r.col[2]) / scale.z;
+
+	return matrix<T, 4, 4>(
+		r0.x, r1.x, r2.x, T(0),
+		r0.y, r1.y, r2.y, T(0),
+		r0.z, r1.z, r2.z, T(0),
+		-dot(r0, translation), -dot(r1, translation), -dot(r2, translation), T(1));
+}
+
+#ifdef BMATH_HAS_SSE2
+
+// The SSE inverse and determinant use the 2x2 block matrix method, which groups
+// the products differently than the cofactor expansion above, so results are not
+// bit-identical. Both versions keep the (normwise) relative error of the inverse
+// and the relative error of the determinant below 2 * cond(m) ulp, where cond(m)
+// is the condition number of the matrix (1 for rotations). Transpose is exact.
+
+// pshufd is used for single-register shuffles since it doesn't overwrite its input
+#define b__SWIZZLE(v, x, y, z, w) _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(v), _MM_SHUFFLE(w, z, y, x)))
+#define b__SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+// 2x2 matrices are packed into one register as (m00, m01, m10, m11)
+
+inline __m128 b__mat2Mul(__m128 a, __m128 b) {
+	return _mm_add_ps(
+		_mm_mul_ps(a, b__SWIZZLE(b, 0, 3, 0, 3)),
+		_mm_mul_ps(b__SWIZZLE(a, 1, 0, 3, 2), b__SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+inline __m128 b__mat2AdjMul(__m128 a, __m128 b) { // adjugate(a) * b
+	return _mm_sub_ps(
+		_mm_mul_ps(b__SWIZZLE(a, 3, 3, 0, 0), b),
+		_mm_mul_ps(b__SWIZZLE(a, 1, 1, 2, 2), b__SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+inline __m128 b__mat2MulAdj(__m128 a, __m128 b) { // a * adjugate(b)
+	return _mm_sub_ps(
+		_mm_mul_ps(a, b__SWIZZLE(b, 3, 0, 3, 0)),
+		_mm_mul_ps(b__SWIZZLE(a, 1, 0, 3, 2), b__SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+inline mat4 transpose(mat4 m) {
+	_MM_TRANSPOSE4_PS(m.col[0].simd, m.col[1].simd, m.col[2].simd, m.col[3].simd);
+	return m;
+}
+
+inline float determinant(mat4 m) {
+	// split into 2x2 blocks | A C |
+	//                       | B D |
+	__m128 A = _mm_movelh_ps(m.col[0].simd, m.col[1].simd);
+	__m128 B = _mm_movehl_ps(m.col[1].simd, m.col[0].simd);
+	__m128 C = _mm_movelh_ps(m.col[2].simd, m.col[3].simd);
+	__m128 D = _mm_movehl_ps(m.col[3].simd, m.col[2].simd);
+
+	// (|A|, |B|, |C|, |D|)
+	__m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(b__SHUFFLE(m.col[0].simd, m.col[2].simd, 0, 2, 0, 2), b__SHUFFLE(m.col[1].simd, m.col[3].simd, 1, 3, 1, 3)),
+		_mm_mul_ps(b__SHUFFLE(m.col[0].simd, m.col[2].simd, 1, 3, 1, 3), b__SHUFFLE(m.col[1].simd, m.col[3].simd, 0, 2, 0, 2)));
+
+	// |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+	__m128 detAD_BC = _mm_mul_ps(detSub, b__SWIZZLE(detSub, 3, 2, 1, 0));
+	__m128 tr = _mm_mul_ps(b__mat2AdjMul(A, B), b__SWIZZLE(b__mat2AdjMul(D, C), 0, 2, 1, 3));
+	return _mm_cvtss_f32(detAD_BC) + _mm_cvtss_f32(b__SWIZZLE(detAD_BC, 1, 1, 1, 1)) - _mm_cvtss_f32(b__horizontalSum4(tr));
+}
+
+inline mat4 inverse(mat4 m) {
+	// split into 2x2 blocks | A C |
+	//                       | B D |
+	__m128 A = _mm_movelh_ps(m.col[0].simd, m.col[1].simd);
+	__m128 B = _mm_movehl_ps(m.col[1].simd, m.col[0].simd);
+	__m128 C = _mm_movelh_ps(m.col[2].simd, m.col[3].simd);
+	__m128 D = _mm_movehl_ps(m.col[3].simd, m.col[2].simd);
+
+	// (|A|, |B|, |C|, |D|)
+	__m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(b__SHUFFLE(m.col[0].simd, m.col[2].simd, 0, 2, 0, 2), b__SHUFFLE(m.col[1].simd, m.col[3].simd, 1, 3, 1, 3)),
+		_mm_mul_ps(b__SHUFFLE(m.col[0].simd, m.col[2].simd, 1, 3, 1, 3), b__SHUFFLE(m.col[1].simd, m.col[3].simd, 0, 2, 0, 2)));
+	__m128 detA = b__SWIZZLE(detSub, 0, 0, 0, 0);
+	__m128 detB = b__SWIZZLE(detSub, 1, 1, 1, 1);
+	__m128 detC = b__SWIZZLE(detSub, 2, 2, 2, 2);
+	__m128 detD = b__SWIZZLE(detSub, 3, 3, 3, 3);
+
+	// inverse(M) = 1/|M| * | X Y |
+	//                      | Z W |
+	// computed from the adjugates: X# = |D|A - B(D#C), W# = |A|D - C(A#B), Y# = |B|C - D(A#B)#, Z# = |C|B - A(D#C)#
+	__m128 D_C = b__mat2AdjMul(D, C);
+	__m128 A_B = b__mat2AdjMul(A, B);
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), b__mat2Mul(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), b__mat2Mul(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), b__mat2MulAdj(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), b__mat2MulAdj(A, D_C));
+
+	// |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+	__m128 tr = b__horizontalSum4(_mm_mul_ps(A_B, b__SWIZZLE(D_C, 0, 2, 1, 3)));
+	__m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+	__m128 invDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+
+	X_ = _mm_mul_ps(X_, invDetM);
+	Y_ = _mm_mul_ps(Y_, invDetM);
+	Z_ = _mm_mul_ps(Z_, invDetM);
+	W_ = _mm_mul_ps(W_, invDetM);
+
+	// the final shuffle also turns the adjugates back into the blocks
+	mat4 result;
+	result.col[0].simd = b__SHUFFLE(X_, Y_, 3, 1, 3, 1);
+	result.col[1].simd = b__SHUFFLE(X_, Y_, 2, 0, 2, 0);
+	result.col[2].simd = b__SHUFFLE(Z_, W_, 3, 1, 3, 1);
+	result.col[3].simd = b__SHUFFLE(Z_, W_, 2, 0, 2, 0);
+	return result;
+}
+
+// cross product of the xyz lanes, w comes out as 0 (for finite w)
+inline __m128 b__cross3(__m128 a, __m128 b) {
+	__m128 ayzx = b__SWIZZLE(a, 1, 2, 0, 3);
+	__m128 byzx = b__SWIZZLE(b, 1, 2, 0, 3);
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, byzx), _mm_mul_ps(ayzx, b));
+	return b__SWIZZLE(c, 1, 2, 0, 3);
+}
+
+// rows r0, r1, r2 of the inverse rotation/scale part and the original translation t
+inline mat4 b__affineFromRows(__m128 r0, __m128 r1, __m128 r2, __m128 t) {
+	__m128 r3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	__m128 negT = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(r0, b__SWIZZLE(t, 0, 0, 0, 0)),
+		_mm_mul_ps(r1, b__SWIZZLE(t, 1, 1, 1, 1))),
+		_mm_mul_ps(r2, b__SWIZZLE(t, 2, 2, 2, 2)));
+	mat4 result;
+	result.col[0].simd = r0;
+	result.col[1].simd = r1;
+	result.col[2].simd = r2;
+	result.col[3].simd = _mm_sub_ps(_mm_set_ps(1, 0, 0, 0), negT);
+	return result;
+}
+
+inline mat4 inverseAffine(mat4 m) {
+	__m128 r0 = b__cross3(m.col[1].simd, m.col[2].simd);
+	__m128 r1 = b__cross3(m.col[2].simd, m.col[0].simd);
+	__m128 r2 = b__cross3(m.col[0].simd, m.col[1].simd);
+	__m128 det = _mm_mul_ps(m.col[0].simd, r0);
+	det = _mm_add_ps(_mm_add_ps(b__SWIZZLE(det, 0, 0, 0, 0), b__SWIZZLE(det, 1, 1, 1, 1)), b__SWIZZLE(det, 2, 2, 2, 2));
+	__m128 inverseDet = _mm_div_ps(_mm_set1_ps(1), det);
+	r0 = _mm_mul_ps(r0, inverseDet);
+	r1 = _mm_mul_ps(r1, inverseDet);
+	r2 = _mm_mul_ps(r2, inverseDet);
+	return b__affineFromRows(r0, r1, r2, m.col[3].simd);
+}
+
+// (built with _mm_setr_ps since constructing a vec4 from scalars goes through memory)
+inline mat4 inverseTRS(vec3 translation, quat rotation, vec3 scale) {
+	quat q = rotation;
+	__m128 r0 = _mm_setr_ps(
+		1 - 2 * (q.y * q.y + q.z * q.z),
+		2 * (q.x * q.y + q.w * q.z),
+		2 * (q.x * q.z - q.w * q.y), 0);
+	__m128 r1 = _mm_setr_ps(
+		2 * (q.x * q.y - q.w * q.z),
+		1 - 2 * (q.x * q.x + q.z * q.z),
+		2 * (q.y * q.z + q.w * q.x), 0);
+	__m128 r2 = _mm_setr_ps(
+		2 * (q.x * q.z + q.w * q.y),
+		2 * (q.y * q.z - q.w * q.x),
+		1 - 2 * (q.x * q.x + q.y * q.y), 0);
+	return b__affineFromRows(
+		_mm_div_ps(r0, _mm_set1_ps(scale.x)),
+		_mm_div_ps(r1, _mm_set1_ps(scale.y)),
+		_mm_div_ps(r2, _mm_set1_ps(scale.z)),
+		_mm_setr_ps(translation.x, translation.y, translation.z, 0));
+}
+
+inline mat4 trsMat(vec3 translation, quat rotation, vec3 scale) {
+	quat q = rotation;
+	mat4 m;
+	m.col[0].simd = _mm_setr_ps(
+		(1 - 2 * (q.y * q.y + q.z * q.z)) * scale.x,
+		(2 * (q.x * q.y + q.w * q.z)) * scale.x,
+		(2 * (q.x * q.z - q.w * q.y)) * scale.x, 0);
+	m.col[1].simd = _mm_setr_ps(
+		(2 * (q.x * q.y - q.w * q.z)) * scale.y,
+		(1 - 2 * (q.x * q.x + q.z * q.z)) * scale.y,
+		(2 * (q.y * q.z + q.w * q.x)) * scale.y, 0);
+	m.col[2].simd = _mm_setr_ps(
+		(2 * (q.x * q.z + q.w * q.y)) * scale.z,
+		(2 * (q.y * q.z - q.w * q.x)) * scale.z,
+		(1 - 2 * (q.x * q.x + q.y * q.y)) * scale.z, 0);
+	m.col[3].simd = _mm_setr_ps(translation.x, translation.y, translation.z, 1);
+	return m;
+}
+
+inline mat4 inverseRigid(mat4 m) {
+	// zero w so that it doesn't end up in the translation
+	__m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	return b__affineFromRows(
+		_mm_and_ps(m.col[0].simd, xyz),
+		_mm_and_ps(m.col[1].simd, xyz),
+		_mm_and_ps(m.col[2].simd, xyz),
+		m.col[3].simd);
+}
+
+#undef b__SWIZZLE
+#undef b__SHUFFLE
+
+#endif // BMATH_HAS_SSE2
+
 template<class T>
 inline BMATH_CONSTEXPR matrix<T, 4, 4> scaleMat(vector<T, 3> xyz) {
 	return matrix<T, 4, 4>(vector<T, 4>(xyz, T(1)));
@@ -3029,10 +5057,10 @@ inline BMATH_CONSTEXPR matrix<T, 4, 4> translationMat(vector<T, 3> xyz) {
 }
 
 template<class T>
-inline matrix<T, 4, 4> rotationMat(vector<T, 3> axis, T angleRad) {
+inline BMATH_CONSTEXPR_MATH matrix<T, 4, 4> rotationMat(vector<T, 3> axis, T angleRad) {
 	T a = angleRad;
-	T s = sin(a);
-	T c = cos(a);
+	T s = b__sin(a);
+	T c = b__cos(a);
 
 	axis = normalize(axis);
 	vector<T, 3> temp((T(1) - c) * axis);
@@ -3057,7 +5085,7 @@ inline matrix<T, 4, 4> rotationMat(vector<T, 3> axis, T angleRad) {
 }
 
 template<class T>
-inline matrix<T, 4, 4> lookToMat(vector<T, 3> pos, vector<T, 3> dir, vector<T, 3> up) {
+inline BMATH_CONSTEXPR_MATH matrix<T, 4, 4> lookToMat(vector<T, 3> pos, vector<T, 3> dir, vector<T, 3> up) {
 	#if defined BMATH_RIGHT_HANDED
 	{
 		vector<T, 3> f = normalize(dir);
@@ -3086,13 +5114,13 @@ inline matrix<T, 4, 4> lookToMat(vector<T, 3> pos, vector<T, 3> dir, vector<T, 3
 }
 
 template<class T>
-inline matrix<T, 4, 4> lookAtMat(vector<T, 3> pos, vector<T, 3> target, vector<T, 3> up) {
+inline BMATH_CONSTEXPR_MATH matrix<T, 4, 4> lookAtMat(vector<T, 3> pos, vector<T, 3> target, vector<T, 3> up) {
 	return lookToMat(pos, target - pos, up);
 }
 
 template<class T>
-inline matrix<T, 4, 4> perspectiveMat(T vertFOV, T aspect, T near, T far) {
-	T theta = tan(vertFOV / T(2));
+inline BMATH_CONSTEXPR_MATH matrix<T, 4, 4> perspectiveMat(T vertFOV, T aspect, T near, T far) {
+	T theta = b__tan(vertFOV / T(2));
 	matrix<T, 4, 4> m(T(0));
 	m.col[0].x = +T(1) / (aspect * theta);
 	m.col[1].y = +T(1) / (theta);
@@ -3145,8 +5173,8 @@ inline matrix<T, 4, 4> orthoMat(T left, T right, T bottom, T top, T near, T far)
 	{
 		#if defined BMATH_DEPTH_CLIP_ZERO_TO_ONE
 		{
-			m.col[2].z = -T(1) / (zFar - near);
-			m.col[3].z = -near / (zFar - near);
+			m.col[2].z = -T(1) / (far - near);
+			m.col[3].z = -near / (far - near);
 		}
 		#elif defined BMATH_DEPTH_CLIP_MINUS_ONE_TO_ONE
 		{
@@ -3220,202 +5248,3924 @@ inline BMATH_CONSTEXPR vector<bool, N> epsilonNotEqual(vector<T, N> left, vector
 	return abs(left - right) > epsilon;
 }
 
-// Quaternion Functions
-
-template<class T>
-inline vector<T, 3> axis(quaternion<T> q) {
-	T s = T(1) - q.w * q.w;
-	if (s <= T(0))
-		return vector<T, 3>(0, 0, 1);
-	return q.xyz / sqrt(s);
+// Number of floats between left and right (0 when they're equal, also for +0 and -0),
+// for checking that optimized or reordered code stays within a few ulp of a reference.
+// It's the largest possible distance if either one is NaN.
+inline uint ulpDistance(float left, float right) {
+	uint a, b;
+	memcpy(&a, &left, sizeof a);
+	memcpy(&b, &right, sizeof b);
+	if ((a & 0x7FFFFFFF) > 0x7F800000 || (b & 0x7FFFFFFF) > 0x7F800000)
+		return 0xFFFFFFFF;
+	// maps the floats to unsigned integers in the same order
+	a = a & 0x80000000 ? 0x80000000 - (a & 0x7FFFFFFF) : 0x80000000 + a;
+	b = b & 0x80000000 ? 0x80000000 - (b & 0x7FFFFFFF) : 0x80000000 + b;
+	return a > b ? a - b : b - a;
 }
 
-template<class T>
-inline T angle(quaternion<T> q) {
-	return acos(q.w) * T(2);
+inline unsigned long long ulpDistance(double left, double right) {
+	unsigned long long a, b;
+	unsigned long long sign = 1ull << 63;
+	memcpy(&a, &left, sizeof a);
+	memcpy(&b, &right, sizeof b);
+	if ((a & ~sign) > 0x7FF0000000000000ull || (b & ~sign) > 0x7FF0000000000000ull)
+		return ~0ull;
+	a = a & sign ? sign - (a & ~sign) : sign + a;
+	b = b & sign ? sign - (b & ~sign) : sign + b;
+	return a > b ? a - b : b - a;
 }
 
+// maxUlps is 64-bit because doubles that are far apart can be more than 2^32 ulp apart.
 template<class T>
-inline BMATH_CONSTEXPR quaternion<T> conjugate(quaternion<T> q) {
-	return quaternion<T>(-q.x, -q.y, -q.z, q.w);
+inline bool ulpEqual(T left, T right, unsigned long long maxUlps) {
+	return ulpDistance(left, right) <= maxUlps;
 }
 
-template<class T>
-inline BMATH_CONSTEXPR T lengthSq(quaternion<T> q) {
-	return q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
-}
+template<class T, int N>
+inline vector<bool, N> ulpEqual(vector<T, N> left, vector<T, N> right, unsigned long long maxUlps) {
+	vector<bool, N> result;
+	for (int i = 0; i < N; ++i)
+		result[i] = ulpDistance(left[i], right[i]) <= maxUlps;
+	return result;
+}
+
+// Swizzle Functions
+
+// GLSL swizzles with the component indices as template arguments: v.zyx is
+// swizzle<2, 1, 0>(v), and v.xxyy is swizzle<0, 0, 1, 1>(v). The write-masked
+// assignment v.zx = a is v = swizzle<2, 0>(v, a), which replaces v.z with a.x and
+// v.x with a.y. Out of range indices, and writing the same component twice, don't
+// compile. With SSE a vec4 to vec4 swizzle is a single shuffle, and writing to a vec4
+// is a shuffle and a blend. Those SSE versions go component by component when they're
+// constant evaluated, so they're constexpr too, but only where BMATH_CONSTEXPR_MATH is
+// (C++20, or C++14 with GCC or clang 9+). Elsewhere, vec4, ivec4 and uvec4 swizzles
+// can't be constexpr with BMATH_SIMD.
+
+// Component I of v - only defined for the components that v has.
+template<int I> struct b__component;
+
+template<> struct b__component<0> {
+	template<class T, int N>
+	static inline BMATH_CONSTEXPR T get(vector<T, N> v) { return v.x; }
+};
 
-template<class T>
-inline T length(quaternion<T> q) {
-	return sqrt(lengthSq(q));
-}
+template<> struct b__component<1> {
+	template<class T, int N>
+	static inline BMATH_CONSTEXPR T get(vector<T, N> v) { return v.y; }
+};
 
-template<class T>
-inline quaternion<T> normalize(quaternion<T> q) {
+template<> struct b__component<2> {
+	template<class T, int N>
+	static inline BMATH_CONSTEXPR T get(vector<T, N> v) { return v.z; }
+};
+
+template<> struct b__component<3> {
+	template<class T, int N>
+	static inline BMATH_CONSTEXPR T get(vector<T, N> v) { return v.w; }
+};
+
+// Component I of v after writing value to the components X, Y, Z and W (-1 if unused).
+template<int I, int X, int Y, int Z, int W, class T, int N, int K>
+inline BMATH_CONSTEXPR T b__storedComponent(vector<T, N> v, vector<T, K> value) {
+	return
+		I == X ? b__component<0>::get(value) :
+		I == Y ? b__component<1>::get(value) :
+		I == Z ? b__component<Z < 0 ? 0 : 2>::get(value) :
+		I == W ? b__component<W < 0 ? 0 : 3>::get(value) :
+		b__component<I>::get(v);
+}
+
+// Only the valid swizzle stores into an N component vector have an apply function.
+// The lanes are the SSE shuffle that moves the components of value into place, and
+// blend has a bit set for every written component.
+template<int N, int X, int Y, int Z, int W, bool Valid =
+	X >= 0 && X < N && Y >= 0 && Y < N && Z >= -1 && Z < N && W >= -1 && W < N &&
+	X != Y && (Z < 0 || (Z != X && Z != Y)) && (W < 0 || (W != X && W != Y && W != Z))>
+struct b__swizzleStore {};
+
+template<int X, int Y, int Z, int W>
+struct b__swizzleStore<2, X, Y, Z, W, true> {
+	template<class T, int K>
+	static inline BMATH_CONSTEXPR vector<T, 2> apply(vector<T, 2> v, vector<T, K> value) {
+		return vector<T, 2>(
+			b__storedComponent<0, X, Y, Z, W>(v, value),
+			b__storedComponent<1, X, Y, Z, W>(v, value));
+	}
+};
+
+template<int X, int Y, int Z, int W>
+struct b__swizzleStore<3, X, Y, Z, W, true> {
+	template<class T, int K>
+	static inline BMATH_CONSTEXPR vector<T, 3> apply(vector<T, 3> v, vector<T, K> value) {
+		return vector<T, 3>(
+			b__storedComponent<0, X, Y, Z, W>(v, value),
+			b__storedComponent<1, X, Y, Z, W>(v, value),
+			b__storedComponent<2, X, Y, Z, W>(v, value));
+	}
+};
+
+template<int X, int Y, int Z, int W>
+struct b__swizzleStore<4, X, Y, Z, W, true> {
+	enum {
+		lane0 = X == 0 ? 0 : Y == 0 ? 1 : Z == 0 ? 2 : W == 0 ? 3 : 0,
+		lane1 = X == 1 ? 0 : Y == 1 ? 1 : Z == 1 ? 2 : W == 1 ? 3 : 1,
+		lane2 = X == 2 ? 0 : Y == 2 ? 1 : Z == 2 ? 2 : W == 2 ? 3 : 2,
+		lane3 = X == 3 ? 0 : Y == 3 ? 1 : Z == 3 ? 2 : W == 3 ? 3 : 3,
+		blend = (1 << X) | (1 << Y) | (Z < 0 ? 0 : 1 << Z) | (W < 0 ? 0 : 1 << W)
+	};
+	template<class T, int K>
+	static inline BMATH_CONSTEXPR vector<T, 4> apply(vector<T, 4> v, vector<T, K> value) {
+		return vector<T, 4>(
+			b__storedComponent<0, X, Y, Z, W>(v, value),
+			b__storedComponent<1, X, Y, Z, W>(v, value),
+			b__storedComponent<2, X, Y, Z, W>(v, value),
+			b__storedComponent<3, X, Y, Z, W>(v, value));
+	}
+};
+
+template<int X, int Y, class T, int N>
+inline BMATH_CONSTEXPR vector<T, 2> swizzle(vector<T, N> v) {
+	return vector<T, 2>(
+		b__component<X>::get(v),
+		b__component<Y>::get(v));
+}
+
+template<int X, int Y, int Z, class T, int N>
+inline BMATH_CONSTEXPR vector<T, 3> swizzle(vector<T, N> v) {
+	return vector<T, 3>(
+		b__component<X>::get(v),
+		b__component<Y>::get(v),
+		b__component<Z>::get(v));
+}
+
+template<int X, int Y, int Z, int W, class T, int N>
+inline BMATH_CONSTEXPR vector<T, 4> swizzle(vector<T, N> v) {
+	return vector<T, 4>(
+		b__component<X>::get(v),
+		b__component<Y>::get(v),
+		b__component<Z>::get(v),
+		b__component<W>::get(v));
+}
+
+template<int X, int Y, class T, int N>
+inline BMATH_CONSTEXPR vector<T, N> swizzle(vector<T, N> v, vector<T, 2> value) {
+	return b__swizzleStore<N, X, Y, -1, -1>::apply(v, value);
+}
+
+template<int X, int Y, int Z, class T, int N>
+inline BMATH_CONSTEXPR vector<T, N> swizzle(vector<T, N> v, vector<T, 3> value) {
+	return b__swizzleStore<N, X, Y, Z, -1>::apply(v, value);
+}
+
+template<int X, int Y, int Z, int W, class T, int N>
+inline BMATH_CONSTEXPR vector<T, N> swizzle(vector<T, N> v, vector<T, 4> value) {
+	return b__swizzleStore<N, X, Y, Z, W>::apply(v, value);
+}
+
+#ifdef BMATH_HAS_SSE2
+
+// Only defined for indices in [0, 3].
+template<int X, int Y, int Z, int W, bool Valid = ((X | Y | Z | W) & ~3) == 0>
+struct b__swizzleShuffle {};
+
+template<int X, int Y, int Z, int W>
+struct b__swizzleShuffle<X, Y, Z, W, true> {
+	enum { mask = _MM_SHUFFLE(W, Z, Y, X) };
+};
+
+template<int X, int Y, int Z, int W>
+inline BMATH_CONSTEXPR_MATH vec4 swizzle(vec4 v) {
+	#ifdef BMATH_HAS_CONSTANT_EVALUATED
+	{
+		if (b__IS_CONSTANT_EVALUATED())
+			return vec4(b__component<X>::get(v), b__component<Y>::get(v), b__component<Z>::get(v), b__component<W>::get(v));
+	}
+	#endif
+	return vec4(_mm_shuffle_ps(v.simd, v.simd, (b__swizzleShuffle<X, Y, Z, W>::mask)));
+}
+
+template<int X, int Y, int Z, int W>
+inline BMATH_CONSTEXPR_MATH ivec4 swizzle(ivec4 v) {
+	#ifdef BMATH_HAS_CONSTANT_EVALUATED
+	{
+		if (b__IS_CONSTANT_EVALUATED())
+			return ivec4(b__component<X>::get(v), b__component<Y>::get(v), b__component<Z>::get(v), b__component<W>::get(v));
+	}
+	#endif
+	return ivec4(_mm_shuffle_epi32(v.simd, (b__swizzleShuffle<X, Y, Z, W>::mask)));
+}
+
+template<int X, int Y, int Z, int W>
+inline BMATH_CONSTEXPR_MATH uvec4 swizzle(uvec4 v) {
+	#ifdef BMATH_HAS_CONSTANT_EVALUATED
+	{
+		if (b__IS_CONSTANT_EVALUATED())
+			return uvec4(b__component<X>::get(v), b__component<Y>::get(v), b__component<Z>::get(v), b__component<W>::get(v));
+	}
+	#endif
+	return uvec4(_mm_shuffle_epi32(v.simd, (b__swizzleShuffle<X, Y, Z, W>::mask)));
+}
+
+template<int X, int Y, int Z, int W>
+inline __m128 b__swizzleStoreSse2(__m128 v, __m128 value) {
+	typedef b__swizzleStore<4, X, Y, Z, W> store;
+	__m128 moved = _mm_shuffle_ps(value, value, _MM_SHUFFLE(store::lane3, store::lane2, store::lane1, store::lane0));
+	if (store::blend == 15)
+		return moved;
+	#ifdef BMATH_HAS_SSE41
+	{
+		return _mm_blend_ps(v, moved, store::blend);
+	}
+	#else
+	{
+		__m128 mask = _mm_castsi128_ps(_mm_setr_epi32(
+			-(store::blend & 1), -((store::blend >> 1) & 1), -((store::blend >> 2) & 1), -((store::blend >> 3) & 1)));
+		return _mm_or_ps(_mm_and_ps(mask, moved), _mm_andnot_ps(mask, v));
+	}
+	#endif
+}
+
+template<int X, int Y>
+inline BMATH_CONSTEXPR_MATH vec4 swizzle(vec4 v, vec2 value) {
+	#ifdef BMATH_HAS_CONSTANT_EVALUATED
+	{
+		if (b__IS_CONSTANT_EVALUATED())
+			return b__swizzleStore<4, X, Y, -1, -1>::apply(v, value);
+	}
+	#endif
+	return vec4(b__swizzleStoreSse2<X, Y, -1, -1>(v.simd, _mm_setr_ps(value.x, value.y, 0, 0)));
+}
+
+template<int X, int Y, int Z>
+inline BMATH_CONSTEXPR_MATH vec4 swizzle(vec4 v, vec3 value) {
+	#ifdef BMATH_HAS_CONSTANT_EVALUATED
+	{
+		if (b__IS_CONSTANT_EVALUATED())
+			return b__swizzleStore<4, X, Y, Z, -1>::apply(v, value);
+	}
+	#endif
+	return vec4(b__swizzleStoreSse2<X, Y, Z, -1>(v.simd, _mm_setr_ps(value.x, value.y, value.z, 0)));
+}
+
+template<int X, int Y, int Z, int W>
+inline BMATH_CONSTEXPR_MATH vec4 swizzle(vec4 v, vec4 value) {
+	#ifdef BMATH_HAS_CONSTANT_EVALUATED
+	{
+		if (b__IS_CONSTANT_EVALUATED())
+			return b__swizzleStore<4, X, Y, Z, W>::apply(v, value);
+	}
+	#endif
+	return vec4(b__swizzleStoreSse2<X, Y, Z, W>(v.simd, value.simd));
+}
+
+#endif // BMATH_HAS_SSE2
+
+// Wide Functions
+
+#ifdef BMATH_HAS_SSE2
+
+#ifdef BMATH_HAS_AVX
+#	define b__WIDE(op) _mm256_##op##_ps
+#else
+#	define b__WIDE(op) _mm_##op##_ps
+#endif
+
+inline floatN loadN(const float *lanes) {
+	return floatN(b__WIDE(loadu)(lanes));
+}
+
+inline void storeN(float *lanes, floatN f) {
+	b__WIDE(storeu)(lanes, f.simd);
+}
+
+inline floatN operator -(floatN f) {
+	return floatN(b__WIDE(xor)(f.simd, b__WIDE(set1)(-0.0f)));
+}
+
+inline floatN operator +(floatN left, floatN right) {
+	return floatN(b__WIDE(add)(left.simd, right.simd));
+}
+
+inline floatN operator -(floatN left, floatN right) {
+	return floatN(b__WIDE(sub)(left.simd, right.simd));
+}
+
+inline floatN operator *(floatN left, floatN right) {
+	return floatN(b__WIDE(mul)(left.simd, right.simd));
+}
+
+inline floatN operator /(floatN left, floatN right) {
+	return floatN(b__WIDE(div)(left.simd, right.simd));
+}
+
+inline floatN &operator +=(floatN &left, floatN right) {
+	return left = left + right;
+}
+
+inline floatN &operator -=(floatN &left, floatN right) {
+	return left = left - right;
+}
+
+inline floatN &operator *=(floatN &left, floatN right) {
+	return left = left * right;
+}
+
+inline floatN &operator /=(floatN &left, floatN right) {
+	return left = left / right;
+}
+
+#ifdef BMATH_HAS_AVX
+
+inline boolN operator ==(floatN left, floatN right) {
+	return boolN(_mm256_cmp_ps(left.simd, right.simd, _CMP_EQ_OQ));
+}
+
+inline boolN operator !=(floatN left, floatN right) {
+	return boolN(_mm256_cmp_ps(left.simd, right.simd, _CMP_NEQ_UQ));
+}
+
+inline boolN operator >=(floatN left, floatN right) {
+	return boolN(_mm256_cmp_ps(left.simd, right.simd, _CMP_GE_OQ));
+}
+
+inline boolN operator <=(floatN left, floatN right) {
+	return boolN(_mm256_cmp_ps(left.simd, right.simd, _CMP_LE_OQ));
+}
+
+inline boolN operator >(floatN left, floatN right) {
+	return boolN(_mm256_cmp_ps(left.simd, right.simd, _CMP_GT_OQ));
+}
+
+inline boolN operator <(floatN left, floatN right) {
+	return boolN(_mm256_cmp_ps(left.simd, right.simd, _CMP_LT_OQ));
+}
+
+#else
+
+inline boolN operator ==(floatN left, floatN right) {
+	return boolN(_mm_cmpeq_ps(left.simd, right.simd));
+}
+
+inline boolN operator !=(floatN left, floatN right) {
+	return boolN(_mm_cmpneq_ps(left.simd, right.simd));
+}
+
+inline boolN operator >=(floatN left, floatN right) {
+	return boolN(_mm_cmpge_ps(left.simd, right.simd));
+}
+
+inline boolN operator <=(floatN left, floatN right) {
+	return boolN(_mm_cmple_ps(left.simd, right.simd));
+}
+
+inline boolN operator >(floatN left, floatN right) {
+	return boolN(_mm_cmpgt_ps(left.simd, right.simd));
+}
+
+inline boolN operator <(floatN left, floatN right) {
+	return boolN(_mm_cmplt_ps(left.simd, right.simd));
+}
+
+#endif // BMATH_HAS_AVX
+
+inline boolN operator ~(boolN b) {
+	return boolN(b__WIDE(xor)(b.simd, boolN(true).simd));
+}
+
+inline boolN operator !(boolN b) {
+	return ~b;
+}
+
+inline boolN operator &(boolN left, boolN right) {
+	return boolN(b__WIDE(and)(left.simd, right.simd));
+}
+
+inline boolN operator |(boolN left, boolN right) {
+	return boolN(b__WIDE(or)(left.simd, right.simd));
+}
+
+inline boolN operator ^(boolN left, boolN right) {
+	return boolN(b__WIDE(xor)(left.simd, right.simd));
+}
+
+inline bool all(boolN b) {
+	return b__WIDE(movemask)(b.simd) == (1 << floatN::width) - 1;
+}
+
+inline bool any(boolN b) {
+	return b__WIDE(movemask)(b.simd) != 0;
+}
+
+inline floatN select(boolN mask, floatN ifTrue, floatN ifFalse) {
+#ifdef BMATH_HAS_SSE41
+	return floatN(b__WIDE(blendv)(ifFalse.simd, ifTrue.simd, mask.simd));
+#else
+	return floatN(_mm_or_ps(_mm_and_ps(mask.simd, ifTrue.simd), _mm_andnot_ps(mask.simd, ifFalse.simd)));
+#endif
+}
+
+inline floatN min(floatN a, floatN b) {
+	return floatN(b__WIDE(min)(a.simd, b.simd));
+}
+
+inline floatN max(floatN a, floatN b) {
+	return floatN(b__WIDE(max)(a.simd, b.simd));
+}
+
+inline floatN abs(floatN f) {
+	return floatN(b__WIDE(andnot)(b__WIDE(set1)(-0.0f), f.simd));
+}
+
+inline floatN sqrt(floatN f) {
+	return floatN(b__WIDE(sqrt)(f.simd));
+}
+
+inline floatN fastRcp(floatN f) {
+	floatN y = floatN(b__WIDE(rcp)(f.simd));
+	return y * (2.0f - f * y);
+}
+
+inline floatN fastInverseSqrt(floatN f) {
+	floatN y = floatN(b__WIDE(rsqrt)(f.simd));
+	return y * (1.5f - 0.5f * f * y * y);
+}
+
+#ifdef BMATH_HAS_SSE41
+
+inline floatN floor(floatN f) {
+	return floatN(b__WIDE(floor)(f.simd));
+}
+
+inline floatN ceil(floatN f) {
+	return floatN(b__WIDE(ceil)(f.simd));
+}
+
+#endif // BMATH_HAS_SSE41
+
+inline vector<floatN, 2> abs(vector<floatN, 2> v) {
+	return vector<floatN, 2>(
+		abs(v.x),
+		abs(v.y));
+}
+
+inline vector<floatN, 3> abs(vector<floatN, 3> v) {
+	return vector<floatN, 3>(
+		abs(v.x),
+		abs(v.y),
+		abs(v.z));
+}
+
+inline vector<floatN, 4> abs(vector<floatN, 4> v) {
+	return vector<floatN, 4>(
+		abs(v.x),
+		abs(v.y),
+		abs(v.z),
+		abs(v.w));
+}
+
+inline vector<boolN, 2> operator ==(vector<floatN, 2> left, vector<floatN, 2> right) {
+	return vector<boolN, 2>(
+		left.x == right.x,
+		left.y == right.y);
+}
+
+inline vector<boolN, 3> operator ==(vector<floatN, 3> left, vector<floatN, 3> right) {
+	return vector<boolN, 3>(
+		left.x == right.x,
+		left.y == right.y,
+		left.z == right.z);
+}
+
+inline vector<boolN, 4> operator ==(vector<floatN, 4> left, vector<floatN, 4> right) {
+	return vector<boolN, 4>(
+		left.x == right.x,
+		left.y == right.y,
+		left.z == right.z,
+		left.w == right.w);
+}
+
+inline vector<boolN, 2> operator !=(vector<floatN, 2> left, vector<floatN, 2> right) {
+	return vector<boolN, 2>(
+		left.x != right.x,
+		left.y != right.y);
+}
+
+inline vector<boolN, 3> operator !=(vector<floatN, 3> left, vector<floatN, 3> right) {
+	return vector<boolN, 3>(
+		left.x != right.x,
+		left.y != right.y,
+		left.z != right.z);
+}
+
+inline vector<boolN, 4> operator !=(vector<floatN, 4> left, vector<floatN, 4> right) {
+	return vector<boolN, 4>(
+		left.x != right.x,
+		left.y != right.y,
+		left.z != right.z,
+		left.w != right.w);
+}
+
+inline vector<boolN, 2> operator >=(vector<floatN, 2> left, vector<floatN, 2> right) {
+	return vector<boolN, 2>(
+		left.x >= right.x,
+		left.y >= right.y);
+}
+
+inline vector<boolN, 3> operator >=(vector<floatN, 3> left, vector<floatN, 3> right) {
+	return vector<boolN, 3>(
+		left.x >= right.x,
+		left.y >= right.y,
+		left.z >= right.z);
+}
+
+inline vector<boolN, 4> operator >=(vector<floatN, 4> left, vector<floatN, 4> right) {
+	return vector<boolN, 4>(
+		left.x >= right.x,
+		left.y >= right.y,
+		left.z >= right.z,
+		left.w >= right.w);
+}
+
+inline vector<boolN, 2> operator <=(vector<floatN, 2> left, vector<floatN, 2> right) {
+	return vector<boolN, 2>(
+		left.x <= right.x,
+		left.y <= right.y);
+}
+
+inline vector<boolN, 3> operator <=(vector<floatN, 3> left, vector<floatN, 3> right) {
+	return vector<boolN, 3>(
+		left.x <= right.x,
+		left.y <= right.y,
+		left.z <= right.z);
+}
+
+inline vector<boolN, 4> operator <=(vector<floatN, 4> left, vector<floatN, 4> right) {
+	return vector<boolN, 4>(
+		left.x <= right.x,
+		left.y <= right.y,
+		left.z <= right.z,
+		left.w <= right.w);
+}
+
+inline vector<boolN, 2> operator >(vector<floatN, 2> left, vector<floatN, 2> right) {
+	return vector<boolN, 2>(
+		left.x > right.x,
+		left.y > right.y);
+}
+
+inline vector<boolN, 3> operator >(vector<floatN, 3> left, vector<floatN, 3> right) {
+	return vector<boolN, 3>(
+		left.x > right.x,
+		left.y > right.y,
+		left.z > right.z);
+}
+
+inline vector<boolN, 4> operator >(vector<floatN, 4> left, vector<floatN, 4> right) {
+	return vector<boolN, 4>(
+		left.x > right.x,
+		left.y > right.y,
+		left.z > right.z,
+		left.w > right.w);
+}
+
+inline vector<boolN, 2> operator <(vector<floatN, 2> left, vector<floatN, 2> right) {
+	return vector<boolN, 2>(
+		left.x < right.x,
+		left.y < right.y);
+}
+
+inline vector<boolN, 3> operator <(vector<floatN, 3> left, vector<floatN, 3> right) {
+	return vector<boolN, 3>(
+		left.x < right.x,
+		left.y < right.y,
+		left.z < right.z);
+}
+
+inline vector<boolN, 4> operator <(vector<floatN, 4> left, vector<floatN, 4> right) {
+	return vector<boolN, 4>(
+		left.x < right.x,
+		left.y < right.y,
+		left.z < right.z,
+		left.w < right.w);
+}
+
+template<int N>
+inline boolN all(vector<boolN, N> v) {
+	boolN result = v[0];
+	for (int i = 1; i < N; ++i)
+		result = result & v[i];
+	return result;
+}
+
+template<int N>
+inline boolN any(vector<boolN, N> v) {
+	boolN result = v[0];
+	for (int i = 1; i < N; ++i)
+		result = result | v[i];
+	return result;
+}
+
+template<int N>
+inline vector<floatN, N> select(vector<boolN, N> mask, vector<floatN, N> ifTrue, vector<floatN, N> ifFalse) {
+	vector<floatN, N> result;
+	for (int i = 0; i < N; ++i)
+		result[i] = select(mask[i], ifTrue[i], ifFalse[i]);
+	return result;
+}
+
+template<int N>
+inline vector<floatN, N> select(boolN mask, vector<floatN, N> ifTrue, vector<floatN, N> ifFalse) {
+	return select(vector<boolN, N>(mask), ifTrue, ifFalse);
+}
+
+template<int N>
+inline vector<floatN, N> faceforward(vector<floatN, N> normal, vector<floatN, N> incidence) {
+	return select(dot(incidence, normal) < floatN(0), normal, -normal);
+}
+
+template<int N>
+inline vector<floatN, N> refract(vector<floatN, N> incidence, vector<floatN, N> normal, floatN eta) {
+	floatN d = dot(incidence, normal);
+	floatN k = floatN(1) - eta * eta * (floatN(1) - d * d);
+	vector<floatN, N> refracted = eta * incidence - normal * (eta * d + sqrt(max(k, floatN(0))));
+	return select(k < floatN(0), vector<floatN, N>(floatN(0)), refracted);
+}
+
+template<int N>
+inline floatN fastInverseLength(vector<floatN, N> v) {
+	return fastInverseSqrt(dot(v, v));
+}
+
+template<int N>
+inline floatN fastLength(vector<floatN, N> v) {
+	floatN lengthSq = dot(v, v);
+	return lengthSq * fastInverseSqrt(max(lengthSq, floatN(1.17549435e-38f)));
+}
+
+template<int N>
+inline vector<floatN, N> fastNormalize(vector<floatN, N> v) {
+	return v * fastInverseSqrt(dot(v, v));
+}
+
+// The transcendental functions below evaluate polynomial approximations in all lanes
+// at once instead of calling the C library once per lane. With BMATH_SIMD the vec2,
+// vec3 and vec4 versions of fastSin, fastCos, .. also go through floatN, and so do
+// sin, cos, .. when BMATH_SIMD_MATH is defined. Otherwise those call the C library
+// per component, because the results differ from it (see below). There are two accuracy
+// tiers: sin, cos, .. use the Cephes polynomials and are within a few ulp of the C
+// library, while fastSin, fastCos, .. use lower degree polynomials. The maximum
+// errors measured over a few million random inputs (absolute where noted) are:
+//                    precise                     fast
+//   sin, cos         8e-8 abs                    1.4e-6 abs
+//   tan              14 ulp (3 away from k*pi)   4.2e-6
+//   atan2            3.2 ulp                     8.4e-7
+//   exp              1 ulp                       5.4e-6
+//   log              1 ulp                       7.1e-6 abs
+//   pow              2 ulp * (1 + |y log(x)|)    1.3e-5 * (1 + |y log(x)|)
+// sin, cos and tan were measured for |x| < 8192 (tan for |x| < 10). Their error
+// slowly grows for larger x. exp flushes results below FLT_MIN to zero. pow is
+// exp(y * log(x)), so unlike the C library it gives NaN for any negative x, even
+// when y is an integer.
+
+// converts the lanes to int32 (rounding to nearest) and reinterprets the bits as float
+inline floatN b__intBitsN(floatN f) {
+	#ifdef BMATH_HAS_AVX
+		return floatN(_mm256_castsi256_ps(_mm256_cvtps_epi32(f.simd)));
+	#else
+		return floatN(_mm_castsi128_ps(_mm_cvtps_epi32(f.simd)));
+	#endif
+}
+
+// reinterprets the bits of the lanes as int32 and converts them to float
+inline floatN b__fromIntBitsN(floatN f) {
+	#ifdef BMATH_HAS_AVX
+		return floatN(_mm256_cvtepi32_ps(_mm256_castps_si256(f.simd)));
+	#else
+		return floatN(_mm_cvtepi32_ps(_mm_castps_si128(f.simd)));
+	#endif
+}
+
+inline floatN b__andBitsN(floatN f, unsigned mask) {
+	#ifdef BMATH_HAS_AVX
+		return floatN(_mm256_and_ps(f.simd, _mm256_castsi256_ps(_mm256_set1_epi32(int(mask)))));
+	#else
+		return floatN(_mm_and_ps(f.simd, _mm_castsi128_ps(_mm_set1_epi32(int(mask)))));
+	#endif
+}
+
+inline floatN b__orBitsN(floatN f, unsigned bits) {
+	#ifdef BMATH_HAS_AVX
+		return floatN(_mm256_or_ps(f.simd, _mm256_castsi256_ps(_mm256_set1_epi32(int(bits)))));
+	#else
+		return floatN(_mm_or_ps(f.simd, _mm_castsi128_ps(_mm_set1_epi32(int(bits)))));
+	#endif
+}
+
+// |x| < 2^31
+inline floatN b__roundN(floatN x) {
+	return b__fromIntBitsN(b__intBitsN(x));
+}
+
+// magnitude of the first argument with the sign of the second
+inline floatN b__copySignN(floatN magnitude, floatN sign) {
+	return floatN(b__WIDE(or)(
+		b__andBitsN(magnitude, 0x7FFFFFFF).simd,
+		b__andBitsN(sign, 0x80000000).simd));
+}
+
+// x * 2^n for integral n in [-126, 127]
+inline floatN b__ldexpN(floatN x, floatN n) {
+	return x * b__intBitsN((n + 127.0f) * 8388608.0f);
+}
+
+// x = mantissa * 2^exponent with the mantissa in [0.5, 1) (for positive normal x)
+inline floatN b__frexpN(floatN x, floatN *exponent) {
+	*exponent = b__fromIntBitsN(b__andBitsN(x, 0x7F800000)) * (1.0f / 8388608.0f) - 126.0f;
+	return b__orBitsN(b__andBitsN(x, 0x807FFFFF), 0x3F000000);
+}
+
+// Reduces x to r in [-pi/4, pi/4] with x = r + j * pi/2, and splits j mod 4
+// into masks for where sin(x) = +-sin(r) or +-cos(r).
+inline floatN b__reduceQuadrantN(floatN x, boolN *odd, boolN *sinNegative, boolN *cosNegative) {
+	floatN j = b__roundN(x * 0.636619772f);
+	floatN r = ((x - j * 1.5703125f) - j * 4.837512969970703125e-4f) - j * 7.54978995489188216e-8f;
+
+	// (j mod 4) / 4 comes out as 0, 0.25, +-0.5 or -0.25
+	floatN q = j * 0.25f - b__roundN(j * 0.25f);
+	*odd = abs(q) == 0.25f;
+	*sinNegative = (q < -0.125f) | (q > 0.375f);
+	*cosNegative = (q > 0.125f) | (q < -0.375f);
+	// sin, cos and tan of infinity are NaN, like in the C library
+	return select(abs(x) < INFINITY, r, floatN(NAN));
+}
+
+// sin(r) and cos(r) for r in [-pi/4, pi/4]
+inline void b__sincosReducedN(floatN r, floatN *sine, floatN *cosine, bool fast) {
+	floatN z = r * r;
+	if (fast) {
+		*sine = (0.00816328205f * z - 0.166633904f) * z * r + r;
+		*cosine = (-0.00136487136f * z + 0.0416610713f) * z * z - 0.5f * z + 1.0f;
+	} else {
+		*sine = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+		*cosine = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+	}
+}
+
+inline void b__sincosN(floatN x, floatN *sine, floatN *cosine, bool fast) {
+	boolN odd, sinNegative, cosNegative;
+	floatN r = b__reduceQuadrantN(x, &odd, &sinNegative, &cosNegative);
+	floatN s, c;
+	b__sincosReducedN(r, &s, &c, fast);
+	floatN sinR = select(odd, c, s);
+	floatN cosR = select(odd, s, c);
+	*sine = select(sinNegative, -sinR, sinR);
+	*cosine = select(cosNegative, -cosR, cosR);
+}
+
+inline floatN b__atan2N(floatN y, floatN x, bool fast) {
+	floatN ax = abs(x);
+	floatN ay = abs(y);
+	floatN hi = max(ax, ay);
+	floatN lo = min(ax, ay);
+	// atan2(0, 0) = 0 and atan2(inf, inf) = pi/4
+	floatN a = select(hi == 0.0f, floatN(0.0f), select(lo == hi, floatN(1.0f), lo / hi));
+
+	// atan(a) = pi/4 + atan((a - 1) / (a + 1)) for a > tan(pi/8)
+	boolN big = a > 0.414213562f;
+	floatN t = select(big, (a - 1.0f) / (a + 1.0f), a);
+	floatN z = t * t;
+	floatN r;
+	if (fast)
+		r = ((-0.112251636f * z + 0.197141439f) * z - 0.333255078f) * z * t + t;
+	else
+		r = (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * t + t;
+	r = select(big, r + 0.785398163f, r);
+
+	r = select(ay > ax, 1.57079633f - r, r);
+	r = select(b__copySignN(1.0f, x) < 0.0f, 3.14159265f - r, r);
+	r = b__copySignN(r, y);
+	return select((x == x) & (y == y), r, x + y);
+}
+
+inline floatN b__expN(floatN v, bool fast) {
+	floatN x = min(floatN(88.7228394f), max(floatN(-87.3365479f), v));
+	floatN j = b__roundN(x * 1.44269504f);
+	floatN r = (x - j * 0.693359375f) + j * 2.12194440e-4f;
+	floatN z = r * r;
+	floatN p;
+	if (fast)
+		p = ((0.0412777353f * r + 0.167535144f) * r + 0.500051162f) * z + r + 1.0f;
+	else
+		p = (((((1.9875691500e-4f * r + 1.3981999507e-3f) * r + 8.3334519073e-3f) * r + 4.1665795894e-2f) * r + 1.6666665459e-1f) * r + 5.0000001201e-1f) * z + r + 1.0f;
+
+	// 2^128 doesn't fit in a float, so use 2^127 * 2 for the top of the range
+	floatN top = floatN(j > 127.0f);
+	floatN result = b__ldexpN(p, j - top) * (top + 1.0f);
+	result = select(v < -87.3365479f, floatN(0.0f), result);
+	return select(v > 88.7228394f, floatN(INFINITY), result);
+}
+
+inline floatN b__logN(floatN v, bool fast) {
+	// scale denormals up into the normal range
+	boolN denormal = v < 1.17549435e-38f;
+	floatN x = select(denormal, v * 8388608.0f, v);
+
+	floatN e;
+	floatN m = b__frexpN(x, &e);
+	e = e - select(denormal, floatN(23.0f), floatN(0.0f));
+
+	// m in [sqrt(0.5), sqrt(2)) - 1
+	boolN small = m < 0.707106781f;
+	e = e - floatN(small);
+	m = select(small, m + m, m) - 1.0f;
+	floatN z = m * m;
+	floatN y;
+	if (fast)
+		y = (((-0.147023694f * m + 0.219243804f) * m - 0.252521607f) * m + 0.332724872f) * m * z;
+	else
+		y = ((((((((7.0376836292e-2f * m - 1.1514610310e-1f) * m + 1.1676998740e-1f) * m - 1.2420140846e-1f) * m + 1.4249322787e-1f) * m - 1.6668057665e-1f) * m + 2.0000714765e-1f) * m - 2.4999993993e-1f) * m + 3.3333331174e-1f) * m * z;
+	y = y - e * 2.12194440e-4f - 0.5f * z;
+	floatN result = m + y + e * 0.693359375f;
+
+	result = select(v == INFINITY, v, result);
+	result = select(v == 0.0f, floatN(-INFINITY), result);
+	return select(v >= 0.0f, result, floatN(NAN));
+}
+
+inline floatN b__powN(floatN x, floatN y, bool fast) {
+	floatN result = b__expN(y * b__logN(x, fast), fast);
+	return select((y == 0.0f) | (x == 1.0f), floatN(1.0f), result);
+}
+
+inline floatN sin(floatN f) {
+	floatN s, c;
+	b__sincosN(f, &s, &c, false);
+	return s;
+}
+
+inline floatN cos(floatN f) {
+	floatN s, c;
+	b__sincosN(f, &s, &c, false);
+	return c;
+}
+
+inline void sincos(floatN f, floatN *sine, floatN *cosine) {
+	b__sincosN(f, sine, cosine, false);
+}
+
+inline floatN tan(floatN f) {
+	boolN odd, sinNegative, cosNegative;
+	floatN r = b__reduceQuadrantN(f, &odd, &sinNegative, &cosNegative);
+	floatN z = r * r;
+	floatN t = (((((9.38540185543e-3f * z + 3.11992232697e-3f) * z + 2.44301354525e-2f) * z + 5.34112807005e-2f) * z + 1.33387994085e-1f) * z + 3.33331568548e-1f) * z * r + r;
+	return select(odd, -1.0f / t, t);
+}
+
+inline floatN atan2(floatN y, floatN x) {
+	return b__atan2N(y, x, false);
+}
+
+inline floatN exp(floatN f) {
+	return b__expN(f, false);
+}
+
+inline floatN log(floatN f) {
+	return b__logN(f, false);
+}
+
+inline floatN pow(floatN x, floatN y) {
+	return b__powN(x, y, false);
+}
+
+inline floatN fastSin(floatN f) {
+	floatN s, c;
+	b__sincosN(f, &s, &c, true);
+	return s;
+}
+
+inline floatN fastCos(floatN f) {
+	floatN s, c;
+	b__sincosN(f, &s, &c, true);
+	return c;
+}
+
+inline void fastSincos(floatN f, floatN *sine, floatN *cosine) {
+	b__sincosN(f, sine, cosine, true);
+}
+
+inline floatN fastTan(floatN f) {
+	boolN odd, sinNegative, cosNegative;
+	floatN r = b__reduceQuadrantN(f, &odd, &sinNegative, &cosNegative);
+	floatN s, c;
+	b__sincosReducedN(r, &s, &c, true);
+	return select(odd, -c / s, s / c);
+}
+
+inline floatN fastAtan2(floatN y, floatN x) {
+	return b__atan2N(y, x, true);
+}
+
+inline floatN fastExp(floatN f) {
+	return b__expN(f, true);
+}
+
+inline floatN fastLog(floatN f) {
+	return b__logN(f, true);
+}
+
+inline floatN fastPow(floatN x, floatN y) {
+	return b__powN(x, y, true);
+}
+
+template<int N>
+inline void sincos(vector<floatN, N> v, vector<floatN, N> *sine, vector<floatN, N> *cosine) {
+	for (int i = 0; i < N; ++i)
+		sincos(v[i], &(*sine)[i], &(*cosine)[i]);
+}
+
+template<int N>
+inline void fastSincos(vector<floatN, N> v, vector<floatN, N> *sine, vector<floatN, N> *cosine) {
+	for (int i = 0; i < N; ++i)
+		fastSincos(v[i], &(*sine)[i], &(*cosine)[i]);
+}
+
+#define b__WIDE_FUNCTION(name) \
+	template<int N> \
+	inline vector<floatN, N> name(vector<floatN, N> v) { \
+		vector<floatN, N> result; \
+		for (int i = 0; i < N; ++i) \
+			result[i] = name(v[i]); \
+		return result; \
+	}
+#define b__WIDE_FUNCTION2(name) \
+	template<int N> \
+	inline vector<floatN, N> name(vector<floatN, N> a, vector<floatN, N> b) { \
+		vector<floatN, N> result; \
+		for (int i = 0; i < N; ++i) \
+			result[i] = name(a[i], b[i]); \
+		return result; \
+	}
+
+b__WIDE_FUNCTION(fastSin)
+b__WIDE_FUNCTION(fastCos)
+b__WIDE_FUNCTION(fastTan)
+b__WIDE_FUNCTION2(fastAtan2)
+b__WIDE_FUNCTION(fastExp)
+b__WIDE_FUNCTION(fastLog)
+b__WIDE_FUNCTION2(fastPow)
+
+#undef b__WIDE_FUNCTION
+#undef b__WIDE_FUNCTION2
+
+// vec2, vec3 and vec4 go through the lanes of a floatN.
+
+template<int N>
+inline floatN b__toLanes(vector<float, N> v) {
+	float lanes[floatN::width] = {};
+	for (int i = 0; i < N; ++i)
+		lanes[i] = v[i];
+	return loadN(lanes);
+}
+
+template<int N>
+inline vector<float, N> b__fromLanes(floatN f) {
+	float lanes[floatN::width];
+	storeN(lanes, f);
+	vector<float, N> result;
+	for (int i = 0; i < N; ++i)
+		result[i] = lanes[i];
+	return result;
+}
+
+#define b__VECTOR_FUNCTION(name) \
+	inline vec2 name(vec2 v) { return b__fromLanes<2>(name(b__toLanes(v))); } \
+	inline vec3 name(vec3 v) { return b__fromLanes<3>(name(b__toLanes(v))); } \
+	inline vec4 name(vec4 v) { return b__fromLanes<4>(name(b__toLanes(v))); }
+#define b__VECTOR_FUNCTION2(name) \
+	inline vec2 name(vec2 a, vec2 b) { return b__fromLanes<2>(name(b__toLanes(a), b__toLanes(b))); } \
+	inline vec3 name(vec3 a, vec3 b) { return b__fromLanes<3>(name(b__toLanes(a), b__toLanes(b))); } \
+	inline vec4 name(vec4 a, vec4 b) { return b__fromLanes<4>(name(b__toLanes(a), b__toLanes(b))); }
+#define b__VECTOR_SINCOS(name) \
+	template<int N> \
+	inline void name(vector<float, N> v, vector<float, N> *sine, vector<float, N> *cosine) { \
+		floatN s, c; \
+		name(b__toLanes(v), &s, &c); \
+		*sine = b__fromLanes<N>(s); \
+		*cosine = b__fromLanes<N>(c); \
+	}
+
+#ifdef BMATH_SIMD_MATH
+b__VECTOR_FUNCTION(sin)
+b__VECTOR_FUNCTION(cos)
+b__VECTOR_SINCOS(sincos)
+b__VECTOR_FUNCTION(tan)
+b__VECTOR_FUNCTION2(atan2)
+b__VECTOR_FUNCTION(exp)
+b__VECTOR_FUNCTION(log)
+b__VECTOR_FUNCTION2(pow)
+#endif
+b__VECTOR_FUNCTION(fastSin)
+b__VECTOR_FUNCTION(fastCos)
+b__VECTOR_SINCOS(fastSincos)
+b__VECTOR_FUNCTION(fastTan)
+b__VECTOR_FUNCTION2(fastAtan2)
+b__VECTOR_FUNCTION(fastExp)
+b__VECTOR_FUNCTION(fastLog)
+b__VECTOR_FUNCTION2(fastPow)
+
+#undef b__VECTOR_FUNCTION
+#undef b__VECTOR_FUNCTION2
+#undef b__VECTOR_SINCOS
+
+#undef b__WIDE
+
+#else
+
+// Without SIMD the fast versions are the same as the precise ones.
+
+template<class T, int N>
+inline vector<T, N> fastSin(vector<T, N> v) {
+	return sin(v);
+}
+
+template<class T, int N>
+inline vector<T, N> fastCos(vector<T, N> v) {
+	return cos(v);
+}
+
+template<class T, int N>
+inline void fastSincos(vector<T, N> v, vector<T, N> *sine, vector<T, N> *cosine) {
+	sincos(v, sine, cosine);
+}
+
+template<class T, int N>
+inline vector<T, N> fastTan(vector<T, N> v) {
+	return tan(v);
+}
+
+template<class T, int N>
+inline vector<T, N> fastAtan2(vector<T, N> y, vector<T, N> x) {
+	return atan2(y, x);
+}
+
+template<class T, int N>
+inline vector<T, N> fastExp(vector<T, N> v) {
+	return exp(v);
+}
+
+template<class T, int N>
+inline vector<T, N> fastLog(vector<T, N> v) {
+	return log(v);
+}
+
+template<class T, int N>
+inline vector<T, N> fastPow(vector<T, N> left, vector<T, N> right) {
+	return pow(left, right);
+}
+
+#endif // BMATH_HAS_SSE2
+
+// Quaternion Functions
+
+template<class T>
+inline vector<T, 3> axis(quaternion<T> q) {
+	T s = T(1) - q.w * q.w;
+	if (s <= T(0))
+		return vector<T, 3>(0, 0, 1);
+	return q.xyz / sqrt(s);
+}
+
+template<class T>
+inline T angle(quaternion<T> q) {
+	return acos(q.w) * T(2);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR quaternion<T> conjugate(quaternion<T> q) {
+	return quaternion<T>(-q.x, -q.y, -q.z, q.w);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR T lengthSq(quaternion<T> q) {
+	return q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+}
+
+template<class T>
+inline BMATH_CONSTEXPR_MATH T length(quaternion<T> q) {
+	return b__sqrt(lengthSq(q));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR_MATH quaternion<T> normalize(quaternion<T> q) {
 	return q / length(q);
 }
 
-template<class T>
-inline BMATH_CONSTEXPR quaternion<T> inverse(quaternion<T> q) {
-	return conjugate(q) / dot(q.xyzw, q.xyzw);
+inline float fastInverseLength(quat q) {
+	return fastInverseLength(q.xyzw);
+}
+
+inline float fastLength(quat q) {
+	return fastLength(q.xyzw);
+}
+
+inline quat fastNormalize(quat q) {
+	return quat(fastNormalize(q.xyzw));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR quaternion<T> inverse(quaternion<T> q) {
+	return conjugate(q) / dot(q.xyzw, q.xyzw);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR_MATH quaternion<T> slerp(quaternion<T> from, quaternion<T> to, T amount) {
+	quaternion<T> z = to;
+
+	// not dot(from.xyzw, to.xyzw), which reads an inactive union member in constant expressions
+	T cosTheta = from.x * to.x + from.y * to.y + from.z * to.z + from.w * to.w;
+	// if cosTheta < 0, the interpolation will take the long way around the sphere.
+	if (cosTheta < T(0)) {
+		z = -to;
+		cosTheta = -cosTheta;
+	}
+
+	// sin(angle) -> 0! too close for comfort - do a lerp instead.
+	if (cosTheta > T(0.99999))
+		return from + (z - from) * amount;
+
+	// Essential Mathematics, page 467.
+	T angle = b__acos(cosTheta);
+	return (b__sin((T(1) - amount) * angle) * from + b__sin(amount * angle) * z) / b__sin(angle);
+}
+
+template<class T>
+inline quaternion<T> nlerp(quaternion<T> from, quaternion<T> to, T amount) {
+	return normalize(from + (to - from) * amount);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR_MATH quaternion<T> rotationQuat(vector<T, 3> axis, T angleRad) {
+	T a = angleRad / 2;
+	axis = normalize(axis);
+	return quaternion<T>(b__sin(a) * axis, b__cos(a));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR_MATH quaternion<T> rotationQuat(vector<T, 3> from, vector<T, 3> to) {
+	T cosTheta = dot(from, to);
+	vector<T, 3> axis(T(0));
+
+	if (cosTheta >= T(0.99999))
+		return quaternion<T>(T(0), T(0), T(0), T(1));
+
+	if (cosTheta < T(-0.99999)) {
+		// special case when vectors in opposite directions :
+		// there is no "ideal" rotation axis
+		// so guess one; any will do as long as it's perpendicular to start
+		// this implementation favors a rotation around the Up axis (Y),
+		// since it's often what you want to do.
+		axis = cross(vector<T, 3>(0, 0, 1), from);
+		if (lengthSq(axis) < T(0.00001)) // bad luck, they were parallel, try again!
+			axis = cross(vector<T, 3>(1, 0, 0), from);
+
+		axis = normalize(axis);
+		return rotationQuat(axis, T(3.141592653589793));
+	}
+
+	// from Stan Melax's Game Programming Gems 1 article.
+	axis = cross(from, to);
+
+	T s = b__sqrt((T(1) + cosTheta) * T(2));
+	T invs = T(1) / s;
+
+	return quaternion<T>(
+		axis.x * invs,
+		axis.y * invs,
+		axis.z * invs,
+		s * T(0.5f));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR quaternion<T> rotate(quaternion<T> q, quaternion<T> rot) {
+	return rot * q * inverse(rot);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR quaternion<T> rotate(vector<T, 3> v, quaternion<T> rot) {
+	return rot * quaternion<T>(v, T(0)) * inverse(rot);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR quaternion<T> rotate(vector<T, 3> v, vector<T, 3> axis, T angleRad) {
+	quaternion<T> rot = rotationQuat(axis, angleRad);
+	return rotate(v, rot);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR matrix<T, 4, 4> quatToMat(quaternion<T> q) {
+	return matrix<T, 4, 4>(
+		T(1) - T(2) * (q.y * q.y + q.z * q.z),
+		T(2) * (q.x * q.y + q.w * q.z),
+		T(2) * (q.x * q.z - q.w * q.y),
+		T(0),
+
+		T(2) * (q.x * q.y - q.w * q.z),
+		T(1) - T(2) * (q.x * q.x + q.z * q.z),
+		T(2) * (q.y * q.z + q.w * q.x),
+		T(0),
+
+		T(2) * (q.x * q.z + q.w * q.y),
+		T(2) * (q.y * q.z - q.w * q.x),
+		T(1) - T(2) * (q.x * q.x + q.y * q.y),
+		T(0),
+
+		T(0), T(0), T(0), T(1));
+}
+
+template<class T>
+inline quaternion<T> matToQuat(matrix<T, 4, 4> m) {
+	T x = m.col[0].x - m.col[1].y - m.col[2].z;
+	T y = m.col[1].y - m.col[0].x - m.col[2].z;
+	T z = m.col[2].z - m.col[0].x - m.col[1].y;
+	T w = m.col[0].x + m.col[1].y + m.col[2].z;
+
+	T maxVal = w;
+	int maxIdx = 0;
+	if (x > maxVal) {
+		maxVal = x;
+		maxIdx = 1;
+	}
+	if (y > maxVal) {
+		maxVal = y;
+		maxIdx = 2;
+	}
+	if (z > maxVal) {
+		maxVal = z;
+		maxIdx = 3;
+	}
+
+	maxVal = sqrt(maxVal + T(1)) / T(2);
+	T mult = T(0.25) / maxVal;
+
+	switch (maxIdx) {
+		case 0:
+			return quaternion<T>(
+				(m.col[1].z - m.col[2].y) * mult,
+				(m.col[2].x - m.col[0].z) * mult,
+				(m.col[0].y - m.col[1].x) * mult,
+				maxVal);
+		case 1:
+			return quaternion<T>(
+				maxVal,
+				(m.col[0].y + m.col[1].x) * mult,
+				(m.col[2].x + m.col[0].z) * mult,
+				(m.col[1].z - m.col[2].y) * mult);
+		case 2:
+			return quaternion<T>(
+				(m.col[0].y + m.col[1].x) * mult,
+				maxVal,
+				(m.col[1].z + m.col[2].y) * mult,
+				(m.col[2].x - m.col[0].z) * mult);
+		case 3:
+			return quaternion<T>(
+				(m.col[2].x + m.col[0].z) * mult,
+				(m.col[1].z + m.col[2].y) * mult,
+				maxVal,
+				(m.col[0].y - m.col[1].x) * mult);
+		default: return quaternion<T>(0, 0, 0, 0);
+	}
+}
+
+template<class T>
+inline quaternion<T> matToQuat(matrix<T, 4, 3> m) {
+	return matToQuat(matrix<T, 4, 4>(m));
+}
+
+// Splits an affine transform into a translation, rotation and scale, so that
+// trsMat(translation, rotation, scale) gives it back. The rotation is the orthogonal
+// factor of the polar decomposition of the upper 3x3 - the rotation closest to it, also
+// when it's sheared. The shear is then lost, and the scale is measured along the rotated
+// axes. A mirroring transform (negative determinant) gets a negative scale.x.
+// The upper 3x3 must not be singular.
+template<class T>
+inline void decompose(matrix<T, 4, 4> m, vector<T, 3> *translation, quaternion<T> *rotation, vector<T, 3> *scale) {
+	vector<T, 3> c0(m.col[0]);
+	vector<T, 3> c1(m.col[1]);
+	vector<T, 3> c2(m.col[2]);
+
+	// a mirroring transform becomes a rotation when its first column is flipped
+	T sign = dot(c0, cross(c1, c2)) < T(0) ? T(-1) : T(1);
+	vector<T, 3> r0 = c0 * sign;
+	vector<T, 3> r1 = c1;
+	vector<T, 3> r2 = c2;
+
+	// without shear (columns orthogonal to precision) the rotation is the normalized columns
+	T invLength0 = T(1) / sqrt(lengthSq(r0));
+	T invLength1 = T(1) / sqrt(lengthSq(r1));
+	T invLength2 = T(1) / sqrt(lengthSq(r2));
+	T shear =
+		abs(dot(r0, r1)) * invLength0 * invLength1 +
+		abs(dot(r1, r2)) * invLength1 * invLength2 +
+		abs(dot(r2, r0)) * invLength2 * invLength0;
+	if (T(1) + T(0.125) * shear == T(1)) {
+		r0 *= invLength0;
+		r1 *= invLength1;
+		r2 *= invLength2;
+	} else {
+		// Newton's method r = (g * r + inverse(transpose(g * r))) / 2 converges quadratically
+		// to the rotation, and the scaling g (Higham's Frobenius norm scaling) makes it take a
+		// few steps even when the scales are far apart.
+		for (int i = 0; i < 20; ++i) {
+			// the columns of inverse(transpose(r)) are its cofactors over the determinant
+			vector<T, 3> x0 = cross(r1, r2);
+			vector<T, 3> x1 = cross(r2, r0);
+			vector<T, 3> x2 = cross(r0, r1);
+			T invDet = T(1) / dot(r0, x0);
+			T normSq = lengthSq(r0) + lengthSq(r1) + lengthSq(r2);
+			T inverseNormSq = (lengthSq(x0) + lengthSq(x1) + lengthSq(x2)) * invDet * invDet;
+			T g = sqrt(sqrt(inverseNormSq / normSq));
+			T a = T(0.5) * g;
+			T b = T(0.5) / g * invDet;
+			x0 = r0 * a + x0 * b;
+			x1 = r1 * a + x1 * b;
+			x2 = r2 * a + x2 * b;
+			T change = lengthSq(x0 - r0) + lengthSq(x1 - r1) + lengthSq(x2 - r2);
+			r0 = x0;
+			r1 = x1;
+			r2 = x2;
+			// r is within about change^2 of the rotation, which is below precision
+			if (T(1) + change == T(1))
+				break;
+		}
+	}
+
+	*translation = vector<T, 3>(m.col[3]);
+	*rotation = matToQuat(matrix<T, 4, 3>(r0, r1, r2, vector<T, 3>(T(0))));
+	*scale = vector<T, 3>(dot(r0, c0), dot(r1, c1), dot(r2, c2));
+}
+
+template<class T>
+inline void decompose(matrix<T, 4, 3> m, vector<T, 3> *translation, quaternion<T> *rotation, vector<T, 3> *scale) {
+	decompose(matrix<T, 4, 4>(m), translation, rotation, scale);
+}
+
+// Dual Quaternion Functions
+
+// Rotation followed by translation. The rotation must be normalized.
+template<class T>
+inline BMATH_CONSTEXPR dualquaternion<T> rigidDualQuat(quaternion<T> rotation, vector<T, 3> translation) {
+	return dualquaternion<T>(rotation, quaternion<T>(translation, T(0)) * rotation * T(0.5));
+}
+
+template<class T>
+inline BMATH_CONSTEXPR vector<T, 3> dualQuatTranslation(dualquaternion<T> q) {
+	return (q.dual * conjugate(q.real)).xyz * T(2);
+}
+
+// Conjugates both parts - the inverse of a unit dual quaternion.
+template<class T>
+inline BMATH_CONSTEXPR dualquaternion<T> conjugate(dualquaternion<T> q) {
+	return dualquaternion<T>(conjugate(q.real), conjugate(q.dual));
+}
+
+template<class T>
+inline dualquaternion<T> inverse(dualquaternion<T> q) {
+	quaternion<T> real = inverse(q.real);
+	return dualquaternion<T>(real, -(real * q.dual * real));
+}
+
+// Scales to a unit real part and makes the dual part orthogonal to it,
+// which is what a sum of weighted unit dual quaternions needs to be a rigid transform.
+template<class T>
+inline dualquaternion<T> normalize(dualquaternion<T> q) {
+	T invLength = T(1) / length(q.real);
+	quaternion<T> real = q.real * invLength;
+	quaternion<T> dual = q.dual * invLength;
+	return dualquaternion<T>(real, dual - real * dot(real.xyzw, dual.xyzw));
+}
+
+template<class T>
+inline vector<T, 3> transformPoint(dualquaternion<T> q, vector<T, 3> point) {
+	vector<T, 3> r = q.real.xyz;
+	vector<T, 3> d = q.dual.xyz;
+	vector<T, 3> translation = (d * q.real.w - r * q.dual.w + cross(r, d)) * T(2);
+	return point + cross(r, cross(r, point) + point * q.real.w) * T(2) + translation;
+}
+
+// Only rotates.
+template<class T>
+inline vector<T, 3> transformDirection(dualquaternion<T> q, vector<T, 3> direction) {
+	vector<T, 3> r = q.real.xyz;
+	return direction + cross(r, cross(r, direction) + direction * q.real.w) * T(2);
+}
+
+// The dual quaternion must be normalized.
+template<class T>
+inline matrix<T, 4, 4> dualQuatToMat(dualquaternion<T> q) {
+	matrix<T, 4, 4> m = quatToMat(q.real);
+	m.col[3] = vector<T, 4>(dualQuatTranslation(q), T(1));
+	return m;
+}
+
+// The matrix must be a rotation and translation, without scale.
+template<class T>
+inline dualquaternion<T> matToDualQuat(matrix<T, 4, 4> m) {
+	return rigidDualQuat(matToQuat(m), vector<T, 3>(m.col[3]));
+}
+
+// Bounding Volume Functions
+
+template<class T>
+inline BMATH_CONSTEXPR vector<T, 3> center(aabb<T> box) {
+	return (box.min + box.max) * T(0.5);
+}
+
+// half of the size of the box along each axis
+template<class T>
+inline BMATH_CONSTEXPR vector<T, 3> extents(aabb<T> box) {
+	return (box.max - box.min) * T(0.5);
+}
+
+// smallest box that contains both boxes
+template<class T>
+inline BMATH_CONSTEXPR aabb<T> merge(aabb<T> a, aabb<T> b) {
+	return aabb<T>(min(a.min, b.min), max(a.max, b.max));
+}
+
+// Box around the transformed box. It's larger than the transformed box itself
+// unless the transform only translates and scales.
+template<class T>
+inline aabb<T> transformAABB(matrix<T, 4, 4> m, aabb<T> box) {
+	vector<T, 3> c = center(box);
+	vector<T, 3> e = extents(box);
+	vector<T, 3> newCenter = vector<T, 3>(m.col[0]) * c.x + vector<T, 3>(m.col[1]) * c.y + vector<T, 3>(m.col[2]) * c.z + vector<T, 3>(m.col[3]);
+	vector<T, 3> newExtents = abs(vector<T, 3>(m.col[0])) * e.x + abs(vector<T, 3>(m.col[1])) * e.y + abs(vector<T, 3>(m.col[2])) * e.z;
+	return aabb<T>(newCenter - newExtents, newCenter + newExtents);
+}
+
+template<class T>
+inline plane<T> normalize(plane<T> p) {
+	T invLength = T(1) / length(p.normal);
+	return plane<T>(p.normal * invLength, p.d * invLength);
+}
+
+// positive on the side of the plane that the normal points to
+template<class T>
+inline BMATH_CONSTEXPR T signedDistance(plane<T> p, vector<T, 3> point) {
+	return dot(p.normal, point) + p.d;
+}
+
+// Extracts the frustum planes from a projection or view-projection matrix
+// (Gribb & Hartmann). The planes are normalized. Whether the near plane is at
+// depth -1 or 0 depends on BMATH_DEPTH_CLIP_ZERO_TO_ONE, same as perspectiveMat.
+template<class T>
+inline frustum<T> matToFrustum(matrix<T, 4, 4> m) {
+	vector<T, 4> r0(m.col[0].x, m.col[1].x, m.col[2].x, m.col[3].x);
+	vector<T, 4> r1(m.col[0].y, m.col[1].y, m.col[2].y, m.col[3].y);
+	vector<T, 4> r2(m.col[0].z, m.col[1].z, m.col[2].z, m.col[3].z);
+	vector<T, 4> r3(m.col[0].w, m.col[1].w, m.col[2].w, m.col[3].w);
+	frustum<T> f;
+	f.planes[0] = normalize(plane<T>(r3 + r0));
+	f.planes[1] = normalize(plane<T>(r3 - r0));
+	f.planes[2] = normalize(plane<T>(r3 + r1));
+	f.planes[3] = normalize(plane<T>(r3 - r1));
+	#if defined BMATH_DEPTH_CLIP_ZERO_TO_ONE
+		f.planes[4] = normalize(plane<T>(r2));
+	#elif defined BMATH_DEPTH_CLIP_MINUS_ONE_TO_ONE
+		f.planes[4] = normalize(plane<T>(r3 + r2));
+	#endif
+	f.planes[5] = normalize(plane<T>(r3 - r2));
+	return f;
+}
+
+template<class T>
+inline BMATH_CONSTEXPR bool contains(aabb<T> box, vector<T, 3> point) {
+	return all(point >= box.min) && all(point <= box.max);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR bool contains(sphere<T> s, vector<T, 3> point) {
+	return distanceSq(s.center, point) <= s.radius * s.radius;
+}
+
+template<class T>
+inline BMATH_CONSTEXPR bool intersects(aabb<T> a, aabb<T> b) {
+	return all(a.min <= b.max) && all(b.min <= a.max);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR bool intersects(sphere<T> a, sphere<T> b) {
+	return distanceSq(a.center, b.center) <= (a.radius + b.radius) * (a.radius + b.radius);
+}
+
+template<class T>
+inline BMATH_CONSTEXPR bool intersects(aabb<T> box, sphere<T> s) {
+	return distanceSq(clamp(s.center, box.min, box.max), s.center) <= s.radius * s.radius;
+}
+
+template<class T>
+inline BMATH_CONSTEXPR bool intersects(sphere<T> s, aabb<T> box) {
+	return intersects(box, s);
+}
+
+// The frustum tests are conservative: they never reject anything that is inside, but
+// can accept boxes and spheres near the corners of the frustum that are just outside.
+
+template<class T>
+inline bool intersects(frustum<T> f, sphere<T> s) {
+	for (int i = 0; i < 6; ++i)
+		if (signedDistance(f.planes[i], s.center) < -s.radius)
+			return false;
+	return true;
+}
+
+template<class T>
+inline bool intersects(frustum<T> f, aabb<T> box) {
+	for (int i = 0; i < 6; ++i) {
+		// the corner furthest along the normal
+		plane<T> p = f.planes[i];
+		vector<T, 3> corner(
+			p.normal.x >= T(0) ? box.max.x : box.min.x,
+			p.normal.y >= T(0) ? box.max.y : box.min.y,
+			p.normal.z >= T(0) ? box.max.z : box.min.z);
+		if (signedDistance(p, corner) < T(0))
+			return false;
+	}
+	return true;
+}
+
+// Ray Functions
+
+// The raycast functions return whether the ray hits the shape at a distance t
+// in [0, maxDistance], and write the closest such t to *distance. Distances are in
+// multiples of the ray direction, so they're true distances if it's normalized.
+// Passing the closest hit so far as maxDistance only finds hits in front of it.
+
+// point on the ray at distance t
+template<class T>
+inline BMATH_CONSTEXPR vector<T, 3> pointAt(ray<T> r, T t) {
+	return r.origin + r.direction * t;
+}
+
+// Slab test. A ray starting inside the box hits it at distance 0. Axis-aligned rays
+// work as expected through infinite 1 / direction, except when the ray lies exactly
+// in the plane of a face, where it may or may not hit.
+template<class T>
+inline bool raycast(ray<T> r, aabb<T> box, T *distance, T maxDistance = T(HUGE_VAL)) {
+	vector<T, 3> invDirection = T(1) / r.direction;
+	vector<T, 3> t0 = (box.min - r.origin) * invDirection;
+	vector<T, 3> t1 = (box.max - r.origin) * invDirection;
+	T tNear = T(0);
+	T tFar = maxDistance;
+	// NaN (0 * inf) picks the second argument, so it's ignored
+	for (int i = 0; i < 3; ++i) {
+		tNear = max(min(t0[i], t1[i]), tNear);
+		tFar = min(max(t0[i], t1[i]), tFar);
+	}
+	if (tNear > tFar)
+		return false;
+	*distance = tNear;
+	return true;
+}
+
+// A ray starting inside the sphere hits it where it exits.
+template<class T>
+inline bool raycast(ray<T> r, sphere<T> s, T *distance, T maxDistance = T(HUGE_VAL)) {
+	vector<T, 3> offset = r.origin - s.center;
+	T a = dot(r.direction, r.direction);
+	T b = dot(offset, r.direction);
+	T c = dot(offset, offset) - s.radius * s.radius;
+	T discriminant = b * b - a * c;
+	if (discriminant < T(0))
+		return false;
+	T root = sqrt(discriminant);
+	T t = (-b - root) / a;
+	if (t < T(0))
+		t = (-b + root) / a;
+	if (!(t >= T(0) && t <= maxDistance))
+		return false;
+	*distance = t;
+	return true;
+}
+
+// Moller-Trumbore ray-triangle test. Hits both sides of the triangle. The barycentric
+// coordinates (u, v) are the weights of v1 and v2, the hit point is
+// v0 * (1 - u - v) + v1 * u + v2 * v, and can be used to interpolate vertex attributes.
+template<class T>
+inline bool raycast(ray<T> r, vector<T, 3> v0, vector<T, 3> v1, vector<T, 3> v2, T *distance, vector<T, 2> *barycentric, T maxDistance = T(HUGE_VAL)) {
+	vector<T, 3> edge1 = v1 - v0;
+	vector<T, 3> edge2 = v2 - v0;
+	vector<T, 3> p = cross(r.direction, edge2);
+	T det = dot(edge1, p);
+	if (det == T(0))
+		return false;
+	T invDet = T(1) / det;
+	vector<T, 3> s = r.origin - v0;
+	T u = dot(s, p) * invDet;
+	vector<T, 3> q = cross(s, edge1);
+	T v = dot(r.direction, q) * invDet;
+	T t = dot(edge2, q) * invDet;
+	if (!(u >= T(0) && v >= T(0) && u + v <= T(1) && t >= T(0) && t <= maxDistance))
+		return false;
+	*distance = t;
+	*barycentric = vector<T, 2>(u, v);
+	return true;
+}
+
+#ifdef BMATH_HAS_SSE2
+
+// Packet versions - test 4 (SSE) or 8 (AVX) rays at once and return which lanes hit.
+// Each lane can have its own shape, or broadcast a single one to all lanes with
+// aabb<floatN>(box). Lanes that miss get unspecified distances and barycentrics.
+
+inline vector<floatN, 3> pointAt(ray<floatN> r, floatN t) {
+	return r.origin + r.direction * t;
+}
+
+inline boolN raycast(ray<floatN> r, aabb<floatN> box, floatN *distance, floatN maxDistance = floatN(float(HUGE_VAL))) {
+	vector<floatN, 3> invDirection = floatN(1.0f) / r.direction;
+	vector<floatN, 3> t0 = (box.min - r.origin) * invDirection;
+	vector<floatN, 3> t1 = (box.max - r.origin) * invDirection;
+	floatN tNear = floatN(0.0f);
+	floatN tFar = maxDistance;
+	for (int i = 0; i < 3; ++i) {
+		tNear = max(min(t0[i], t1[i]), tNear);
+		tFar = min(max(t0[i], t1[i]), tFar);
+	}
+	*distance = tNear;
+	return tNear <= tFar;
+}
+
+inline boolN raycast(ray<floatN> r, sphere<floatN> s, floatN *distance, floatN maxDistance = floatN(float(HUGE_VAL))) {
+	vector<floatN, 3> offset = r.origin - s.center;
+	floatN a = dot(r.direction, r.direction);
+	floatN b = dot(offset, r.direction);
+	floatN c = dot(offset, offset) - s.radius * s.radius;
+	floatN discriminant = b * b - a * c;
+	floatN root = sqrt(max(discriminant, floatN(0.0f)));
+	floatN t = (-b - root) / a;
+	t = select(t < floatN(0.0f), (-b + root) / a, t);
+	*distance = t;
+	return (discriminant >= floatN(0.0f)) & (t >= floatN(0.0f)) & (t <= maxDistance);
+}
+
+inline boolN raycast(ray<floatN> r, vector<floatN, 3> v0, vector<floatN, 3> v1, vector<floatN, 3> v2, floatN *distance, vector<floatN, 2> *barycentric, floatN maxDistance = floatN(float(HUGE_VAL))) {
+	vector<floatN, 3> edge1 = v1 - v0;
+	vector<floatN, 3> edge2 = v2 - v0;
+	vector<floatN, 3> p = cross(r.direction, edge2);
+	floatN det = dot(edge1, p);
+	floatN invDet = floatN(1.0f) / det;
+	vector<floatN, 3> s = r.origin - v0;
+	floatN u = dot(s, p) * invDet;
+	vector<floatN, 3> q = cross(s, edge1);
+	floatN v = dot(r.direction, q) * invDet;
+	floatN t = dot(edge2, q) * invDet;
+	*distance = t;
+	*barycentric = vector<floatN, 2>(u, v);
+	floatN zero = floatN(0.0f);
+	return (det != zero) & (u >= zero) & (v >= zero) & (u + v <= floatN(1.0f)) & (t >= zero) & (t <= maxDistance);
+}
+
+#endif // BMATH_HAS_SSE2
+
+// Packing Functions
+
+// The unorm and snorm functions pack x into the lowest bits, like the GLSL pack
+// functions, which matches the GPU vertex formats (R8G8B8A8_UNORM, A2B10G10R10_SNORM, ..)
+// on little endian machines. Values are clamped to [0, 1] (unorm) or [-1, 1] (snorm)
+// and rounded to the nearest step, so the round-trip error is at most half a step:
+//   unorm  0.5 / (2^bits - 1)        8 bit: 2.0e-3   10 bit: 4.9e-4   16 bit: 7.6e-6
+//   snorm  0.5 / (2^(bits-1) - 1)    8 bit: 3.9e-3   10 bit: 9.8e-4   16 bit: 1.5e-5
+// The 3x10_1x2 formats hold w in the top 2 bits.
+
+inline BMATH_CONSTEXPR uint b__packUnorm(float x, int bits) {
+	return uint(clamp(x, 0.0f, 1.0f) * float((1u << bits) - 1) + 0.5f);
+}
+
+// rounds half away from zero
+inline BMATH_CONSTEXPR int b__roundToInt(float x) {
+	return int(x < 0 ? x - 0.5f : x + 0.5f);
+}
+
+inline BMATH_CONSTEXPR uint b__packSnorm(float x, int bits) {
+	return uint(b__roundToInt(clamp(x, -1.0f, 1.0f) * float((1u << (bits - 1)) - 1))) & ((1u << bits) - 1);
+}
+
+inline BMATH_CONSTEXPR float b__unpackUnorm(uint x, int bits) {
+	return float(x & ((1u << bits) - 1)) / float((1u << bits) - 1);
+}
+
+// sign extends the lowest bits of x
+inline BMATH_CONSTEXPR int b__signExtend(uint x, int bits) {
+	return int((x & ((1u << bits) - 1)) ^ (1u << (bits - 1))) - int(1u << (bits - 1));
+}
+
+inline BMATH_CONSTEXPR float b__unpackSnorm(uint x, int bits) {
+	return max(float(b__signExtend(x, bits)) / float((1u << (bits - 1)) - 1), -1.0f);
+}
+
+inline BMATH_CONSTEXPR unsigned short packUnorm2x8(vec2 v) {
+	return (unsigned short)(b__packUnorm(v.x, 8) | b__packUnorm(v.y, 8) << 8);
+}
+
+inline BMATH_CONSTEXPR uint packUnorm3x8(vec3 v) {
+	return b__packUnorm(v.x, 8) | b__packUnorm(v.y, 8) << 8 | b__packUnorm(v.z, 8) << 16;
+}
+
+inline BMATH_CONSTEXPR uint packUnorm4x8(vec4 v) {
+	return b__packUnorm(v.x, 8) | b__packUnorm(v.y, 8) << 8 | b__packUnorm(v.z, 8) << 16 | b__packUnorm(v.w, 8) << 24;
+}
+
+inline BMATH_CONSTEXPR uint packUnorm3x10(vec3 v) {
+	return b__packUnorm(v.x, 10) | b__packUnorm(v.y, 10) << 10 | b__packUnorm(v.z, 10) << 20;
+}
+
+inline BMATH_CONSTEXPR uint packUnorm3x10_1x2(vec4 v) {
+	return b__packUnorm(v.x, 10) | b__packUnorm(v.y, 10) << 10 | b__packUnorm(v.z, 10) << 20 | b__packUnorm(v.w, 2) << 30;
+}
+
+inline BMATH_CONSTEXPR uint packUnorm2x16(vec2 v) {
+	return b__packUnorm(v.x, 16) | b__packUnorm(v.y, 16) << 16;
+}
+
+inline BMATH_CONSTEXPR unsigned long long packUnorm3x16(vec3 v) {
+	return
+		(unsigned long long)b__packUnorm(v.x, 16) |
+		(unsigned long long)b__packUnorm(v.y, 16) << 16 |
+		(unsigned long long)b__packUnorm(v.z, 16) << 32;
+}
+
+inline BMATH_CONSTEXPR unsigned long long packUnorm4x16(vec4 v) {
+	return
+		(unsigned long long)b__packUnorm(v.x, 16) |
+		(unsigned long long)b__packUnorm(v.y, 16) << 16 |
+		(unsigned long long)b__packUnorm(v.z, 16) << 32 |
+		(unsigned long long)b__packUnorm(v.w, 16) << 48;
+}
+
+inline BMATH_CONSTEXPR unsigned short packSnorm2x8(vec2 v) {
+	return (unsigned short)(b__packSnorm(v.x, 8) | b__packSnorm(v.y, 8) << 8);
+}
+
+inline BMATH_CONSTEXPR uint packSnorm3x8(vec3 v) {
+	return b__packSnorm(v.x, 8) | b__packSnorm(v.y, 8) << 8 | b__packSnorm(v.z, 8) << 16;
+}
+
+inline BMATH_CONSTEXPR uint packSnorm4x8(vec4 v) {
+	return b__packSnorm(v.x, 8) | b__packSnorm(v.y, 8) << 8 | b__packSnorm(v.z, 8) << 16 | b__packSnorm(v.w, 8) << 24;
+}
+
+inline BMATH_CONSTEXPR uint packSnorm3x10(vec3 v) {
+	return b__packSnorm(v.x, 10) | b__packSnorm(v.y, 10) << 10 | b__packSnorm(v.z, 10) << 20;
+}
+
+inline BMATH_CONSTEXPR uint packSnorm3x10_1x2(vec4 v) {
+	return b__packSnorm(v.x, 10) | b__packSnorm(v.y, 10) << 10 | b__packSnorm(v.z, 10) << 20 | b__packSnorm(v.w, 2) << 30;
+}
+
+inline BMATH_CONSTEXPR uint packSnorm2x16(vec2 v) {
+	return b__packSnorm(v.x, 16) | b__packSnorm(v.y, 16) << 16;
+}
+
+inline BMATH_CONSTEXPR unsigned long long packSnorm3x16(vec3 v) {
+	return
+		(unsigned long long)b__packSnorm(v.x, 16) |
+		(unsigned long long)b__packSnorm(v.y, 16) << 16 |
+		(unsigned long long)b__packSnorm(v.z, 16) << 32;
+}
+
+inline BMATH_CONSTEXPR unsigned long long packSnorm4x16(vec4 v) {
+	return
+		(unsigned long long)b__packSnorm(v.x, 16) |
+		(unsigned long long)b__packSnorm(v.y, 16) << 16 |
+		(unsigned long long)b__packSnorm(v.z, 16) << 32 |
+		(unsigned long long)b__packSnorm(v.w, 16) << 48;
+}
+
+inline BMATH_CONSTEXPR vec2 unpackUnorm2x8(unsigned short p) {
+	return vec2(b__unpackUnorm(p, 8), b__unpackUnorm(p >> 8, 8));
+}
+
+inline BMATH_CONSTEXPR vec3 unpackUnorm3x8(uint p) {
+	return vec3(b__unpackUnorm(p, 8), b__unpackUnorm(p >> 8, 8), b__unpackUnorm(p >> 16, 8));
+}
+
+inline BMATH_CONSTEXPR vec4 unpackUnorm4x8(uint p) {
+	return vec4(b__unpackUnorm(p, 8), b__unpackUnorm(p >> 8, 8), b__unpackUnorm(p >> 16, 8), b__unpackUnorm(p >> 24, 8));
+}
+
+inline BMATH_CONSTEXPR vec3 unpackUnorm3x10(uint p) {
+	return vec3(b__unpackUnorm(p, 10), b__unpackUnorm(p >> 10, 10), b__unpackUnorm(p >> 20, 10));
+}
+
+inline BMATH_CONSTEXPR vec4 unpackUnorm3x10_1x2(uint p) {
+	return vec4(b__unpackUnorm(p, 10), b__unpackUnorm(p >> 10, 10), b__unpackUnorm(p >> 20, 10), b__unpackUnorm(p >> 30, 2));
+}
+
+inline BMATH_CONSTEXPR vec2 unpackUnorm2x16(uint p) {
+	return vec2(b__unpackUnorm(p, 16), b__unpackUnorm(p >> 16, 16));
+}
+
+inline BMATH_CONSTEXPR vec3 unpackUnorm3x16(unsigned long long p) {
+	return vec3(b__unpackUnorm(uint(p), 16), b__unpackUnorm(uint(p >> 16), 16), b__unpackUnorm(uint(p >> 32), 16));
+}
+
+inline BMATH_CONSTEXPR vec4 unpackUnorm4x16(unsigned long long p) {
+	return vec4(b__unpackUnorm(uint(p), 16), b__unpackUnorm(uint(p >> 16), 16), b__unpackUnorm(uint(p >> 32), 16), b__unpackUnorm(uint(p >> 48), 16));
+}
+
+inline BMATH_CONSTEXPR vec2 unpackSnorm2x8(unsigned short p) {
+	return vec2(b__unpackSnorm(p, 8), b__unpackSnorm(p >> 8, 8));
+}
+
+inline BMATH_CONSTEXPR vec3 unpackSnorm3x8(uint p) {
+	return vec3(b__unpackSnorm(p, 8), b__unpackSnorm(p >> 8, 8), b__unpackSnorm(p >> 16, 8));
+}
+
+inline BMATH_CONSTEXPR vec4 unpackSnorm4x8(uint p) {
+	return vec4(b__unpackSnorm(p, 8), b__unpackSnorm(p >> 8, 8), b__unpackSnorm(p >> 16, 8), b__unpackSnorm(p >> 24, 8));
+}
+
+inline BMATH_CONSTEXPR vec3 unpackSnorm3x10(uint p) {
+	return vec3(b__unpackSnorm(p, 10), b__unpackSnorm(p >> 10, 10), b__unpackSnorm(p >> 20, 10));
+}
+
+inline BMATH_CONSTEXPR vec4 unpackSnorm3x10_1x2(uint p) {
+	return vec4(b__unpackSnorm(p, 10), b__unpackSnorm(p >> 10, 10), b__unpackSnorm(p >> 20, 10), b__unpackSnorm(p >> 30, 2));
+}
+
+inline BMATH_CONSTEXPR vec2 unpackSnorm2x16(uint p) {
+	return vec2(b__unpackSnorm(p, 16), b__unpackSnorm(p >> 16, 16));
+}
+
+inline BMATH_CONSTEXPR vec3 unpackSnorm3x16(unsigned long long p) {
+	return vec3(b__unpackSnorm(uint(p), 16), b__unpackSnorm(uint(p >> 16), 16), b__unpackSnorm(uint(p >> 32), 16));
+}
+
+inline BMATH_CONSTEXPR vec4 unpackSnorm4x16(unsigned long long p) {
+	return vec4(b__unpackSnorm(uint(p), 16), b__unpackSnorm(uint(p >> 16), 16), b__unpackSnorm(uint(p >> 32), 16), b__unpackSnorm(uint(p >> 48), 16));
+}
+
+// Octahedral encoding of a direction - the unit sphere is projected onto an octahedron
+// which is unfolded into a square and stored as 2 snorms. Much more accurate than
+// storing xyz with the same number of bits. The direction doesn't have to be
+// normalized but must not be 0. The maximum angle between a normalized direction and
+// its round trip, measured over 10^7 random directions, is:
+//   2x8   1.7e-2 rad (0.96 deg)
+//   2x16  6.5e-5 rad (0.0037 deg)
+
+inline vec2 b__octahedralEncode(vec3 n) {
+	vec2 p = vec2(n.x, n.y) * (1.0f / (abs(n.x) + abs(n.y) + abs(n.z)));
+	if (n.z < 0) {
+		// fold the lower half over the diagonals
+		float x = (1.0f - abs(p.y)) * (p.x >= 0 ? 1.0f : -1.0f);
+		float y = (1.0f - abs(p.x)) * (p.y >= 0 ? 1.0f : -1.0f);
+		p = vec2(x, y);
+	}
+	return p;
+}
+
+inline vec3 b__octahedralDecode(float x, float y) {
+	float z = 1.0f - abs(x) - abs(y);
+	float t = max(-z, 0.0f);
+	x += x >= 0 ? -t : t;
+	y += y >= 0 ? -t : t;
+	return normalize(vec3(x, y, z));
+}
+
+inline unsigned short packOctahedral2x8(vec3 direction) {
+	vec2 p = b__octahedralEncode(direction);
+	return (unsigned short)(b__packSnorm(p.x, 8) | b__packSnorm(p.y, 8) << 8);
+}
+
+inline uint packOctahedral2x16(vec3 direction) {
+	vec2 p = b__octahedralEncode(direction);
+	return b__packSnorm(p.x, 16) | b__packSnorm(p.y, 16) << 16;
+}
+
+inline vec3 unpackOctahedral2x8(unsigned short p) {
+	return b__octahedralDecode(b__unpackSnorm(p, 8), b__unpackSnorm(p >> 8, 8));
+}
+
+inline vec3 unpackOctahedral2x16(uint p) {
+	return b__octahedralDecode(b__unpackSnorm(p, 16), b__unpackSnorm(p >> 16, 16));
+}
+
+// "Smallest three" quaternion compression - the largest component is dropped and
+// recomputed from the other three, which are all within [-1/sqrt(2), 1/sqrt(2)]. Its
+// index takes 2 bits, and the rest are split evenly between the other three: 10 bits
+// each in 32 bits, 15 in 48 bits and 20 in 64 bits. The quaternion must be normalized.
+// The unpacked quaternion may be the negation of the packed one (which is the same
+// rotation). The maximum rotation angle between a quaternion and its round trip,
+// measured over 10^7 random rotations, is:
+//   32 bit  4.3e-3 rad (0.25 deg)
+//   48 bit  1.4e-4 rad (0.0078 deg)
+//   64 bit  4.7e-6 rad (0.00027 deg)
+
+inline unsigned long long b__packSmallestThree(quat q, int bits) {
+	int largest = 0;
+	for (int i = 1; i < 4; ++i)
+		if (abs(q[i]) > abs(q[largest]))
+			largest = i;
+
+	// negate q if needed so the dropped component is positive
+	float scale = (q[largest] < 0 ? -1.0f : 1.0f) * 0.707106781f;
+	unsigned long long packed = (unsigned long long)largest;
+	for (int i = 0; i < 4; ++i)
+		if (i != largest)
+			packed = packed << bits | b__packUnorm(q[i] * scale + 0.5f, bits);
+	return packed;
+}
+
+inline quat b__unpackSmallestThree(unsigned long long packed, int bits) {
+	int largest = int(packed >> (3 * bits)) & 3;
+	quat q;
+	float sumSq = 0;
+	for (int i = 3; i >= 0; --i) {
+		if (i != largest) {
+			q[i] = (b__unpackUnorm(uint(packed), bits) - 0.5f) * 1.414213562f;
+			sumSq += q[i] * q[i];
+			packed >>= bits;
+		}
+	}
+	q[largest] = sqrt(max(1.0f - sumSq, 0.0f));
+	return q;
+}
+
+inline uint packQuat32(quat q) {
+	return uint(b__packSmallestThree(q, 10));
+}
+
+inline unsigned long long packQuat48(quat q) {
+	return b__packSmallestThree(q, 15);
+}
+
+inline unsigned long long packQuat64(quat q) {
+	return b__packSmallestThree(q, 20);
+}
+
+inline quat unpackQuat32(uint p) {
+	return b__unpackSmallestThree(p, 10);
+}
+
+inline quat unpackQuat48(unsigned long long p) {
+	return b__unpackSmallestThree(p, 15);
+}
+
+inline quat unpackQuat64(unsigned long long p) {
+	return b__unpackSmallestThree(p, 20);
+}
+
+// Array versions of the packing functions: pack(src[i]) is stored in dst[i]. The
+// 3x8, 3x16 and Quat48 formats are stored tightly as 3 bytes or 3 shorts each
+// (x first) instead of in a whole uint or unsigned long long.
+
+#define b__PACK_ARRAY(pack, unpack, Unpacked, Packed)\
+	inline void pack(const Unpacked *src, Packed *dst, size_t count) {\
+		for (size_t i = 0; i < count; ++i)\
+			dst[i] = pack(src[i]);\
+	}\
+	inline void unpack(const Packed *src, Unpacked *dst, size_t count) {\
+		for (size_t i = 0; i < count; ++i)\
+			dst[i] = unpack(src[i]);\
+	}
+
+#define b__PACK_ARRAY3(pack, unpack, Unpacked, Packed, Word)\
+	inline void pack(const Unpacked *src, Word *dst, size_t count) {\
+		for (size_t i = 0; i < count; ++i) {\
+			Packed p = pack(src[i]);\
+			dst[3 * i + 0] = (Word)p;\
+			dst[3 * i + 1] = (Word)(p >> (8 * sizeof(Word)));\
+			dst[3 * i + 2] = (Word)(p >> (16 * sizeof(Word)));\
+		}\
+	}\
+	inline void unpack(const Word *src, Unpacked *dst, size_t count) {\
+		for (size_t i = 0; i < count; ++i) {\
+			Packed p =\
+				(Packed)src[3 * i + 0] |\
+				(Packed)src[3 * i + 1] << (8 * sizeof(Word)) |\
+				(Packed)src[3 * i + 2] << (16 * sizeof(Word));\
+			dst[i] = unpack(p);\
+		}\
+	}
+
+b__PACK_ARRAY (packUnorm2x8,       unpackUnorm2x8,       vec2, unsigned short)
+b__PACK_ARRAY3(packUnorm3x8,       unpackUnorm3x8,       vec3, uint, unsigned char)
+b__PACK_ARRAY (packUnorm4x8,       unpackUnorm4x8,       vec4, uint)
+b__PACK_ARRAY (packUnorm3x10,      unpackUnorm3x10,      vec3, uint)
+b__PACK_ARRAY (packUnorm3x10_1x2,  unpackUnorm3x10_1x2,  vec4, uint)
+b__PACK_ARRAY (packUnorm2x16,      unpackUnorm2x16,      vec2, uint)
+b__PACK_ARRAY3(packUnorm3x16,      unpackUnorm3x16,      vec3, unsigned long long, unsigned short)
+b__PACK_ARRAY (packUnorm4x16,      unpackUnorm4x16,      vec4, unsigned long long)
+b__PACK_ARRAY (packSnorm2x8,       unpackSnorm2x8,       vec2, unsigned short)
+b__PACK_ARRAY3(packSnorm3x8,       unpackSnorm3x8,       vec3, uint, unsigned char)
+b__PACK_ARRAY (packSnorm4x8,       unpackSnorm4x8,       vec4, uint)
+b__PACK_ARRAY (packSnorm3x10,      unpackSnorm3x10,      vec3, uint)
+b__PACK_ARRAY (packSnorm3x10_1x2,  unpackSnorm3x10_1x2,  vec4, uint)
+b__PACK_ARRAY (packSnorm2x16,      unpackSnorm2x16,      vec2, uint)
+b__PACK_ARRAY3(packSnorm3x16,      unpackSnorm3x16,      vec3, unsigned long long, unsigned short)
+b__PACK_ARRAY (packSnorm4x16,      unpackSnorm4x16,      vec4, unsigned long long)
+b__PACK_ARRAY (packOctahedral2x8,  unpackOctahedral2x8,  vec3, unsigned short)
+b__PACK_ARRAY (packOctahedral2x16, unpackOctahedral2x16, vec3, uint)
+b__PACK_ARRAY (packQuat32,         unpackQuat32,         quat, uint)
+b__PACK_ARRAY3(packQuat48,         unpackQuat48,         quat, unsigned long long, unsigned short)
+b__PACK_ARRAY (packQuat64,         unpackQuat64,         quat, unsigned long long)
+
+#undef b__PACK_ARRAY
+#undef b__PACK_ARRAY3
+
+// Batch Functions
+
+// These transform whole arrays at once. The input and output arrays may be the
+// same array (in-place), but must not otherwise overlap.
+
+template<class T>
+inline void transformPoints(matrix<T, 4, 4> m, const vector<T, 3> *points, vector<T, 3> *result, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		vector<T, 3> p = points[i];
+		result[i] = m.col[0].xyz * p.x + m.col[1].xyz * p.y + m.col[2].xyz * p.z + m.col[3].xyz;
+	}
+}
+
+template<class T>
+inline void transformDirections(matrix<T, 4, 4> m, const vector<T, 3> *directions, vector<T, 3> *result, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		vector<T, 3> d = directions[i];
+		result[i] = m.col[0].xyz * d.x + m.col[1].xyz * d.y + m.col[2].xyz * d.z;
+	}
+}
+
+// Transforms points by a projection matrix and divides by w.
+template<class T>
+inline void transformPointsProjective(matrix<T, 4, 4> m, const vector<T, 3> *points, vector<T, 3> *result, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		vector<T, 3> p = points[i];
+		vector<T, 4> h = m.col[0] * p.x + m.col[1] * p.y + m.col[2] * p.z + m.col[3];
+		result[i] = h.xyz / h.w;
+	}
+}
+
+template<class T>
+inline void transformPoints(matrix<T, 4, 3> m, const vector<T, 3> *points, vector<T, 3> *result, size_t count) {
+	transformPoints(matrix<T, 4, 4>(m), points, result, count);
+}
+
+template<class T>
+inline void transformDirections(matrix<T, 4, 3> m, const vector<T, 3> *directions, vector<T, 3> *result, size_t count) {
+	transformDirections(matrix<T, 4, 4>(m), directions, result, count);
+}
+
+// Blends each pair of transforms: both are decomposed, their translations and scales
+// are lerped and their rotations nlerped along the shorter arc, and the result is put
+// back together with trsMat. amount 0 gives from[i] and 1 gives to[i] (up to rounding,
+// and without any shear they had). result may be the same array as from or to.
+template<class T>
+inline void blendTransforms(const matrix<T, 4, 4> *from, const matrix<T, 4, 4> *to, T amount, matrix<T, 4, 4> *result, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		vector<T, 3> t0, t1, s0, s1;
+		quaternion<T> r0, r1;
+		decompose(from[i], &t0, &r0, &s0);
+		decompose(to[i], &t1, &r1, &s1);
+		if (r0.x * r1.x + r0.y * r1.y + r0.z * r1.z + r0.w * r1.w < T(0))
+			r1 = -r1;
+		result[i] = trsMat(lerp(t0, t1, amount), nlerp(r0, r1, amount), lerp(s0, s1, amount));
+	}
+}
+
+// The SSE2, AVX2 and AVX-512 batch kernels below all do the same operations in the
+// same order as the scalar kernel, so they give bit-identical results. The exception
+// is when the compiler contracts multiplies and adds into fused multiply-adds, which
+// GCC does by default whenever FMA is available - so also in the AVX-512 kernel.
+// Compile with -ffp-contract=off if the levels must agree exactly.
+
+enum simdLevel {
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	SIMD_AVX512
+};
+
+inline void b__floatToHalfScalar(const float *src, half *dst, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		dst[i].bits = b__floatToHalfBits(src[i]);
+}
+
+inline void b__halfToFloatScalar(const half *src, float *dst, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = b__halfBitsToFloat(src[i].bits);
+}
+
+#ifdef BMATH_KERNEL_SSE2
+
+inline void b__transformVec3Scalar(mat4 m, const vec3 *points, vec3 *result, size_t count, bool projective) {
+	for (size_t i = 0; i < count; ++i) {
+		vec3 p = points[i];
+		vec3 r = m.col[0].xyz * p.x + m.col[1].xyz * p.y + m.col[2].xyz * p.z + m.col[3].xyz;
+		if (projective)
+			r = r / (m.col[0].w * p.x + m.col[1].w * p.y + m.col[2].w * p.z + m.col[3].w);
+		result[i] = r;
+	}
+}
+
+// The vector kernels load 4 vec3s into each 128-bit lane as
+//   a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+// and transpose them into x, y, z registers with in-lane shuffles (and back).
+#define b__TRANSPOSE_IN(shuffle, type, a, b, c, x, y, z) \
+	type x, y, z; { \
+		type t0 = shuffle(b, c, _MM_SHUFFLE(2, 1, 3, 2)); /* x2 y2 x3 y3 */ \
+		type t1 = shuffle(a, b, _MM_SHUFFLE(1, 0, 2, 1)); /* y0 z0 y1 z1 */ \
+		x = shuffle(a,  t0, _MM_SHUFFLE(2, 0, 3, 0)); \
+		y = shuffle(t1, t0, _MM_SHUFFLE(3, 1, 2, 0)); \
+		z = shuffle(t1, c,  _MM_SHUFFLE(3, 0, 3, 1)); }
+
+#define b__TRANSPOSE_OUT(shuffle, type, x, y, z, a, b, c) \
+	type a, b, c; { \
+		type x0x1y0y1 = shuffle(x, y, _MM_SHUFFLE(1, 0, 1, 0)); \
+		type z0z0x1x1 = shuffle(z, x, _MM_SHUFFLE(1, 1, 0, 0)); \
+		type y1y2z1z2 = shuffle(y, z, _MM_SHUFFLE(2, 1, 2, 1)); \
+		type x2x3y2y3 = shuffle(x, y, _MM_SHUFFLE(3, 2, 3, 2)); \
+		type z2z2x3x3 = shuffle(z, x, _MM_SHUFFLE(3, 3, 2, 2)); \
+		type y3y3z3z3 = shuffle(y, z, _MM_SHUFFLE(3, 3, 3, 3)); \
+		a = shuffle(x0x1y0y1, z0z0x1x1, _MM_SHUFFLE(2, 0, 2, 0)); \
+		b = shuffle(y1y2z1z2, x2x3y2y3, _MM_SHUFFLE(2, 0, 2, 0)); \
+		c = shuffle(z2z2x3x3, y3y3z3z3, _MM_SHUFFLE(2, 0, 2, 0)); }
+
+// x * c0 + y * c1 + z * c2 + c3 (+ w divide) for one register of each component
+#define b__TRANSFORM(add, mul, div, type, cx, cy, cz, cw, x, y, z, projective, rx, ry, rz) \
+	type rx = add(add(add(mul(cx[0], x), mul(cx[1], y)), mul(cx[2], z)), cx[3]); \
+	type ry = add(add(add(mul(cy[0], x), mul(cy[1], y)), mul(cy[2], z)), cy[3]); \
+	type rz = add(add(add(mul(cz[0], x), mul(cz[1], y)), mul(cz[2], z)), cz[3]); \
+	if (projective) { \
+		type rw = add(add(add(mul(cw[0], x), mul(cw[1], y)), mul(cw[2], z)), cw[3]); \
+		rx = div(rx, rw); \
+		ry = div(ry, rw); \
+		rz = div(rz, rw); \
+	}
+
+template<bool Aligned>
+inline void b__transformVec3Sse2Loop(const __m128 *cx, const __m128 *cy, const __m128 *cz, const __m128 *cw, const vec3 *points, vec3 *result, size_t wideCount, bool projective) {
+	for (size_t i = 0; i < wideCount; i += 4) {
+		const float *in = &points[i].x;
+		__m128 a = Aligned ? _mm_load_ps(in + 0) : _mm_loadu_ps(in + 0);
+		__m128 b = Aligned ? _mm_load_ps(in + 4) : _mm_loadu_ps(in + 4);
+		__m128 c = Aligned ? _mm_load_ps(in + 8) : _mm_loadu_ps(in + 8);
+		b__TRANSPOSE_IN(_mm_shuffle_ps, __m128, a, b, c, x, y, z)
+		b__TRANSFORM(_mm_add_ps, _mm_mul_ps, _mm_div_ps, __m128, cx, cy, cz, cw, x, y, z, projective, rx, ry, rz)
+		b__TRANSPOSE_OUT(_mm_shuffle_ps, __m128, rx, ry, rz, ra, rb, rc)
+		float *out = &result[i].x;
+		if (Aligned) {
+			_mm_store_ps(out + 0, ra);
+			_mm_store_ps(out + 4, rb);
+			_mm_store_ps(out + 8, rc);
+		} else {
+			_mm_storeu_ps(out + 0, ra);
+			_mm_storeu_ps(out + 4, rb);
+			_mm_storeu_ps(out + 8, rc);
+		}
+	}
+}
+
+inline void b__transformVec3Sse2(mat4 m, const vec3 *points, vec3 *result, size_t count, bool projective) {
+	__m128 cx[4], cy[4], cz[4], cw[4];
+	for (int i = 0; i < 4; ++i) {
+		cx[i] = _mm_set1_ps(m.col[i].x);
+		cy[i] = _mm_set1_ps(m.col[i].y);
+		cz[i] = _mm_set1_ps(m.col[i].z);
+		cw[i] = _mm_set1_ps(m.col[i].w);
+	}
+
+	// 4 vec3s are 48 bytes, so when both arrays start on a 16 byte boundary (like an
+	// alignedArray) every load and store is aligned, and without AVX the loads can then
+	// be folded into the shuffles instead of going through separate unaligned moves.
+	size_t wideCount = count - count % 4;
+	if (((size_t(points) | size_t(result)) & 15) == 0)
+		b__transformVec3Sse2Loop<true>(cx, cy, cz, cw, points, result, wideCount, projective);
+	else
+		b__transformVec3Sse2Loop<false>(cx, cy, cz, cw, points, result, wideCount, projective);
+	b__transformVec3Scalar(m, points + wideCount, result + wideCount, count - wideCount, projective);
+}
+
+#endif // BMATH_KERNEL_SSE2
+
+#ifdef BMATH_KERNEL_AVX2
+
+// vec3s 0-3 go in the low 128-bit lane and 4-7 in the high lane.
+BMATH_TARGET_AVX2
+inline __m256 b__load2x128(const float *lanes) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lanes)), _mm_loadu_ps(lanes + 12), 1);
+}
+
+BMATH_TARGET_AVX2
+inline void b__store2x128(float *lanes, __m256 v) {
+	_mm_storeu_ps(lanes, _mm256_castps256_ps128(v));
+	_mm_storeu_ps(lanes + 12, _mm256_extractf128_ps(v, 1));
+}
+
+BMATH_TARGET_AVX2
+inline void b__transformVec3Avx2(mat4 m, const vec3 *points, vec3 *result, size_t count, bool projective) {
+	__m256 cx[4], cy[4], cz[4], cw[4];
+	for (int i = 0; i < 4; ++i) {
+		cx[i] = _mm256_set1_ps(m.col[i].x);
+		cy[i] = _mm256_set1_ps(m.col[i].y);
+		cz[i] = _mm256_set1_ps(m.col[i].z);
+		cw[i] = _mm256_set1_ps(m.col[i].w);
+	}
+
+	size_t wideCount = count - count % 8;
+	for (size_t i = 0; i < wideCount; i += 8) {
+		const float *in = &points[i].x;
+		__m256 a = b__load2x128(in + 0);
+		__m256 b = b__load2x128(in + 4);
+		__m256 c = b__load2x128(in + 8);
+		b__TRANSPOSE_IN(_mm256_shuffle_ps, __m256, a, b, c, x, y, z)
+		b__TRANSFORM(_mm256_add_ps, _mm256_mul_ps, _mm256_div_ps, __m256, cx, cy, cz, cw, x, y, z, projective, rx, ry, rz)
+		b__TRANSPOSE_OUT(_mm256_shuffle_ps, __m256, rx, ry, rz, ra, rb, rc)
+		float *out = &result[i].x;
+		b__store2x128(out + 0, ra);
+		b__store2x128(out + 4, rb);
+		b__store2x128(out + 8, rc);
+	}
+	b__transformVec3Scalar(m, points + wideCount, result + wideCount, count - wideCount, projective);
+}
+
+#endif // BMATH_KERNEL_AVX2
+
+#ifdef BMATH_KERNEL_AVX512
+
+// vec3s 0-3 go in 128-bit lane 0, 4-7 in lane 1, 8-11 in lane 2 and 12-15 in lane 3.
+BMATH_TARGET_AVX512
+inline __m512 b__load4x128(const float *lanes) {
+	__m512 v = _mm512_castps128_ps512(_mm_loadu_ps(lanes));
+	v = _mm512_insertf32x4(v, _mm_loadu_ps(lanes + 12), 1);
+	v = _mm512_insertf32x4(v, _mm_loadu_ps(lanes + 24), 2);
+	return _mm512_insertf32x4(v, _mm_loadu_ps(lanes + 36), 3);
+}
+
+BMATH_TARGET_AVX512
+inline void b__store4x128(float *lanes, __m512 v) {
+	// (maskz because GCC warns about the uninitialized passthrough of the unmasked extract)
+	_mm_storeu_ps(lanes +  0, _mm512_maskz_extractf32x4_ps(0xF, v, 0));
+	_mm_storeu_ps(lanes + 12, _mm512_maskz_extractf32x4_ps(0xF, v, 1));
+	_mm_storeu_ps(lanes + 24, _mm512_maskz_extractf32x4_ps(0xF, v, 2));
+	_mm_storeu_ps(lanes + 36, _mm512_maskz_extractf32x4_ps(0xF, v, 3));
+}
+
+BMATH_TARGET_AVX512
+inline void b__transformVec3Avx512(mat4 m, const vec3 *points, vec3 *result, size_t count, bool projective) {
+	__m512 cx[4], cy[4], cz[4], cw[4];
+	for (int i = 0; i < 4; ++i) {
+		cx[i] = _mm512_set1_ps(m.col[i].x);
+		cy[i] = _mm512_set1_ps(m.col[i].y);
+		cz[i] = _mm512_set1_ps(m.col[i].z);
+		cw[i] = _mm512_set1_ps(m.col[i].w);
+	}
+
+	size_t wideCount = count - count % 16;
+	for (size_t i = 0; i < wideCount; i += 16) {
+		const float *in = &points[i].x;
+		__m512 a = b__load4x128(in + 0);
+		__m512 b = b__load4x128(in + 4);
+		__m512 c = b__load4x128(in + 8);
+		b__TRANSPOSE_IN(_mm512_shuffle_ps, __m512, a, b, c, x, y, z)
+		b__TRANSFORM(_mm512_add_ps, _mm512_mul_ps, _mm512_div_ps, __m512, cx, cy, cz, cw, x, y, z, projective, rx, ry, rz)
+		b__TRANSPOSE_OUT(_mm512_shuffle_ps, __m512, rx, ry, rz, ra, rb, rc)
+		float *out = &result[i].x;
+		b__store4x128(out + 0, ra);
+		b__store4x128(out + 4, rb);
+		b__store4x128(out + 8, rc);
+	}
+	b__transformVec3Scalar(m, points + wideCount, result + wideCount, count - wideCount, projective);
+}
+
+#endif // BMATH_KERNEL_AVX512
+
+#ifdef BMATH_KERNEL_SSE2
+
+// The cull kernels load 4 aabbs (24 floats) into each 128-bit lane as
+//   a0 = n0 n0 n0 x0, a1 = x0 x0 n1 n1, a2 = n1 x1 x1 x1 (boxes 0 and 1, n = min, x = max)
+// and a3, a4, a5 for boxes 2 and 3, and transpose them into min/max x, y, z registers.
+#define b__TRANSPOSE_AABB(shuffle, type, a0, a1, a2, a3, a4, a5, minX, minY, minZ, maxX, maxY, maxZ) \
+	type minX, minY, minZ, maxX, maxY, maxZ; { \
+		type t = shuffle(a0, a1, _MM_SHUFFLE(3, 2, 1, 0)); /* minX0 minY0 minX1 minY1 */ \
+		type u = shuffle(a3, a4, _MM_SHUFFLE(3, 2, 1, 0)); \
+		minX = shuffle(t, u, _MM_SHUFFLE(2, 0, 2, 0)); \
+		minY = shuffle(t, u, _MM_SHUFFLE(3, 1, 3, 1)); \
+		t = shuffle(a0, a2, _MM_SHUFFLE(1, 0, 3, 2)); /* minZ0 maxX0 minZ1 maxX1 */ \
+		u = shuffle(a3, a5, _MM_SHUFFLE(1, 0, 3, 2)); \
+		minZ = shuffle(t, u, _MM_SHUFFLE(2, 0, 2, 0)); \
+		maxX = shuffle(t, u, _MM_SHUFFLE(3, 1, 3, 1)); \
+		t = shuffle(a1, a2, _MM_SHUFFLE(3, 2, 1, 0)); /* maxY0 maxZ0 maxY1 maxZ1 */ \
+		u = shuffle(a4, a5, _MM_SHUFFLE(3, 2, 1, 0)); \
+		maxY = shuffle(t, u, _MM_SHUFFLE(2, 0, 2, 0)); \
+		maxZ = shuffle(t, u, _MM_SHUFFLE(3, 1, 3, 1)); }
+
+// Sets the lanes of outside where the box is behind one of the planes, testing the
+// box corner that's furthest along each plane normal, the same as intersects(frustum, aabb).
+#define b__CULL(add, mul, lt, bitOr, type, f, minX, minY, minZ, maxX, maxY, maxZ, outside) \
+	for (int p = 0; p < 6; ++p) { \
+		vec3 n = f.planes[p].normal; \
+		type cx = n.x >= 0 ? maxX : minX; \
+		type cy = n.y >= 0 ? maxY : minY; \
+		type cz = n.z >= 0 ? maxZ : minZ; \
+		type dist = add(add(add(mul(nx[p], cx), mul(ny[p], cy)), mul(nz[p], cz)), d[p]); \
+		outside = bitOr(outside, lt(dist, zero)); \
+	}
+
+inline void b__cullAABBsScalar(frustum<float> f, const aabb<float> *boxes, size_t count, unsigned char *visible) {
+	for (size_t i = 0; i < count; ++i)
+		visible[i] = intersects(f, boxes[i]) ? 1 : 0;
+}
+
+inline void b__cullAABBsSse2(frustum<float> f, const aabb<float> *boxes, size_t count, unsigned char *visible) {
+	__m128 nx[6], ny[6], nz[6], d[6];
+	for (int p = 0; p < 6; ++p) {
+		nx[p] = _mm_set1_ps(f.planes[p].normal.x);
+		ny[p] = _mm_set1_ps(f.planes[p].normal.y);
+		nz[p] = _mm_set1_ps(f.planes[p].normal.z);
+		d[p] = _mm_set1_ps(f.planes[p].d);
+	}
+	__m128 zero = _mm_setzero_ps();
+
+	size_t wideCount = count - count % 4;
+	for (size_t i = 0; i < wideCount; i += 4) {
+		const float *in = &boxes[i].min.x;
+		__m128 a0 = _mm_loadu_ps(in + 0);
+		__m128 a1 = _mm_loadu_ps(in + 4);
+		__m128 a2 = _mm_loadu_ps(in + 8);
+		__m128 a3 = _mm_loadu_ps(in + 12);
+		__m128 a4 = _mm_loadu_ps(in + 16);
+		__m128 a5 = _mm_loadu_ps(in + 20);
+		b__TRANSPOSE_AABB(_mm_shuffle_ps, __m128, a0, a1, a2, a3, a4, a5, minX, minY, minZ, maxX, maxY, maxZ)
+		__m128 outside = zero;
+		b__CULL(_mm_add_ps, _mm_mul_ps, _mm_cmplt_ps, _mm_or_ps, __m128, f, minX, minY, minZ, maxX, maxY, maxZ, outside)
+		int mask = _mm_movemask_ps(outside);
+		for (int k = 0; k < 4; ++k)
+			visible[i + k] = (unsigned char)(~mask >> k & 1);
+	}
+	b__cullAABBsScalar(f, boxes + wideCount, count - wideCount, visible + wideCount);
+}
+
+#ifdef BMATH_KERNEL_AVX2
+
+// boxes 0-3 go in the low 128-bit lane and 4-7 in the high lane
+BMATH_TARGET_AVX2
+inline __m256 b__loadAABB2x128(const float *lanes) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lanes)), _mm_loadu_ps(lanes + 24), 1);
+}
+
+BMATH_TARGET_AVX2
+inline __m256 b__cmpltAvx(__m256 a, __m256 b) {
+	return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+
+BMATH_TARGET_AVX2
+inline void b__cullAABBsAvx2(frustum<float> f, const aabb<float> *boxes, size_t count, unsigned char *visible) {
+	__m256 nx[6], ny[6], nz[6], d[6];
+	for (int p = 0; p < 6; ++p) {
+		nx[p] = _mm256_set1_ps(f.planes[p].normal.x);
+		ny[p] = _mm256_set1_ps(f.planes[p].normal.y);
+		nz[p] = _mm256_set1_ps(f.planes[p].normal.z);
+		d[p] = _mm256_set1_ps(f.planes[p].d);
+	}
+	__m256 zero = _mm256_setzero_ps();
+
+	size_t wideCount = count - count % 8;
+	for (size_t i = 0; i < wideCount; i += 8) {
+		const float *in = &boxes[i].min.x;
+		__m256 a0 = b__loadAABB2x128(in + 0);
+		__m256 a1 = b__loadAABB2x128(in + 4);
+		__m256 a2 = b__loadAABB2x128(in + 8);
+		__m256 a3 = b__loadAABB2x128(in + 12);
+		__m256 a4 = b__loadAABB2x128(in + 16);
+		__m256 a5 = b__loadAABB2x128(in + 20);
+		b__TRANSPOSE_AABB(_mm256_shuffle_ps, __m256, a0, a1, a2, a3, a4, a5, minX, minY, minZ, maxX, maxY, maxZ)
+		__m256 outside = zero;
+		b__CULL(_mm256_add_ps, _mm256_mul_ps, b__cmpltAvx, _mm256_or_ps, __m256, f, minX, minY, minZ, maxX, maxY, maxZ, outside)
+		int mask = _mm256_movemask_ps(outside);
+		for (int k = 0; k < 8; ++k)
+			visible[i + k] = (unsigned char)(~mask >> k & 1);
+	}
+	b__cullAABBsScalar(f, boxes + wideCount, count - wideCount, visible + wideCount);
+}
+
+#endif // BMATH_KERNEL_AVX2
+
+#undef b__TRANSPOSE_AABB
+#undef b__CULL
+
+// Branchless versions of HSVtoRGB and RGBtoHSV. They do the same operations as the
+// scalar functions, and select the results with masks instead of branching on them.
+
+inline void b__HSVtoRGBSse2(const vec3 *hsv, vec3 *rgb, size_t count) {
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 six = _mm_set1_ps(6.0f);
+	size_t wideCount = count - count % 4;
+	for (size_t i = 0; i < wideCount; i += 4) {
+		const float *in = &hsv[i].x;
+		__m128 a = _mm_loadu_ps(in + 0);
+		__m128 b = _mm_loadu_ps(in + 4);
+		__m128 c = _mm_loadu_ps(in + 8);
+		b__TRANSPOSE_IN(_mm_shuffle_ps, __m128, a, b, c, h, s, v)
+
+		__m128i sector = _mm_cvttps_epi32(_mm_mul_ps(h, six));
+		__m128 fsector = _mm_cvtepi32_ps(sector);
+		__m128 f = _mm_sub_ps(_mm_mul_ps(h, six), fsector);
+		__m128 p = _mm_mul_ps(v, _mm_sub_ps(one, s));
+		__m128 q = _mm_mul_ps(v, _mm_sub_ps(one, _mm_mul_ps(f, s)));
+		__m128 t = _mm_mul_ps(v, _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(one, f), s)));
+
+		// sector % 6 - negative remainders go to the default case, same as 5
+		__m128 quotient = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(fsector, six)));
+		__m128i rem = _mm_cvttps_epi32(_mm_sub_ps(fsector, _mm_mul_ps(quotient, six)));
+		__m128 s1 = _mm_castsi128_ps(_mm_cmpeq_epi32(rem, _mm_set1_epi32(1)));
+		__m128 s2 = _mm_castsi128_ps(_mm_cmpeq_epi32(rem, _mm_set1_epi32(2)));
+		__m128 s3 = _mm_castsi128_ps(_mm_cmpeq_epi32(rem, _mm_set1_epi32(3)));
+		__m128 s4 = _mm_castsi128_ps(_mm_cmpeq_epi32(rem, _mm_set1_epi32(4)));
+		__m128 s0 = _mm_castsi128_ps(_mm_cmpeq_epi32(rem, _mm_setzero_si128()));
+		__m128 s23 = _mm_or_ps(s2, s3);
+		__m128 s12 = _mm_or_ps(s1, s2);
+		__m128 s34 = _mm_or_ps(s3, s4);
+		__m128 s01 = _mm_or_ps(s0, s1);
+
+		//        0  1  2  3  4  default
+		//   r    v  q  p  p  t  v
+		//   g    t  v  v  q  p  p
+		//   b    p  p  t  v  v  q
+		#define b__SELECT(mask, ifTrue, ifFalse) _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse))
+		__m128 r = b__SELECT(s1, q, b__SELECT(s23, p, b__SELECT(s4, t, v)));
+		__m128 g = b__SELECT(s0, t, b__SELECT(s12, v, b__SELECT(s3, q, p)));
+		__m128 bl = b__SELECT(s01, p, b__SELECT(s2, t, b__SELECT(s34, v, q)));
+		#undef b__SELECT
+
+		b__TRANSPOSE_OUT(_mm_shuffle_ps, __m128, r, g, bl, ra, rb, rc)
+		float *out = &rgb[i].x;
+		_mm_storeu_ps(out + 0, ra);
+		_mm_storeu_ps(out + 4, rb);
+		_mm_storeu_ps(out + 8, rc);
+	}
+	for (size_t i = wideCount; i < count; ++i)
+		rgb[i] = HSVtoRGB(hsv[i]);
+}
+
+inline void b__RGBtoHSVSse2(const vec3 *rgb, vec3 *hsv, size_t count) {
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 six = _mm_set1_ps(6.0f);
+	size_t wideCount = count - count % 4;
+	for (size_t i = 0; i < wideCount; i += 4) {
+		const float *in = &rgb[i].x;
+		__m128 a = _mm_loadu_ps(in + 0);
+		__m128 b = _mm_loadu_ps(in + 4);
+		__m128 c = _mm_loadu_ps(in + 8);
+		b__TRANSPOSE_IN(_mm_shuffle_ps, __m128, a, b, c, r, g, bl)
+
+		__m128 max = _mm_max_ps(r, _mm_max_ps(g, bl));
+		__m128 min = _mm_min_ps(r, _mm_min_ps(g, bl));
+		__m128 delta = _mm_sub_ps(max, min);
+		__m128 s = _mm_div_ps(delta, max);
+		__m128 delta6 = _mm_mul_ps(six, delta);
+		__m128 hr = _mm_add_ps(_mm_div_ps(_mm_sub_ps(g, bl), delta6), zero);
+		__m128 hg = _mm_add_ps(_mm_div_ps(_mm_sub_ps(bl, r), delta6), _mm_set1_ps(1 / 3.0f));
+		__m128 hb = _mm_add_ps(_mm_div_ps(_mm_sub_ps(r, g), delta6), _mm_set1_ps(2 / 3.0f));
+
+		#define b__SELECT(mask, ifTrue, ifFalse) _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse))
+		__m128 h = b__SELECT(_mm_cmpeq_ps(r, max), hr, b__SELECT(_mm_cmpeq_ps(g, max), hg, hb));
+		h = b__SELECT(_mm_cmplt_ps(h, zero), _mm_add_ps(one, h), h);
+		#undef b__SELECT
+
+		// black is all 0, and grays have 0 hue
+		__m128 notBlack = _mm_cmpneq_ps(max, zero);
+		h = _mm_and_ps(h, _mm_and_ps(notBlack, _mm_cmpneq_ps(delta, zero)));
+		s = _mm_and_ps(s, notBlack);
+		__m128 v = _mm_and_ps(max, notBlack);
+
+		b__TRANSPOSE_OUT(_mm_shuffle_ps, __m128, h, s, v, ra, rb, rc)
+		float *out = &hsv[i].x;
+		_mm_storeu_ps(out + 0, ra);
+		_mm_storeu_ps(out + 4, rb);
+		_mm_storeu_ps(out + 8, rc);
+	}
+	for (size_t i = wideCount; i < count; ++i)
+		hsv[i] = RGBtoHSV(rgb[i]);
+}
+
+#endif // BMATH_KERNEL_SSE2
+
+#undef b__TRANSPOSE_IN
+#undef b__TRANSPOSE_OUT
+#undef b__TRANSFORM
+
+#ifdef BMATH_KERNEL_SSE2
+
+#ifdef BMATH_KERNEL_F16C
+
+// The last partial register goes through a buffer, so that every element
+// is converted by the same instruction.
+BMATH_TARGET_F16C inline void b__floatToHalfF16c(const float *src, half *dst, size_t count) {
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i h0 = _mm256_cvtps_ph(_mm256_loadu_ps(src + i + 0), _MM_FROUND_TO_NEAREST_INT);
+		__m128i h1 = _mm256_cvtps_ph(_mm256_loadu_ps(src + i + 8), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128((__m128i *)(dst + i + 0), h0);
+		_mm_storeu_si128((__m128i *)(dst + i + 8), h1);
+	}
+	for (; i < count; i += 8) {
+		size_t n = count - i < 8 ? count - i : 8;
+		float f[8] = {};
+		half h[8];
+		memcpy(f, src + i, n * sizeof(float));
+		_mm_storeu_si128((__m128i *)h, _mm256_cvtps_ph(_mm256_loadu_ps(f), _MM_FROUND_TO_NEAREST_INT));
+		memcpy(dst + i, h, n * sizeof(half));
+	}
+}
+
+BMATH_TARGET_F16C inline void b__halfToFloatF16c(const half *src, float *dst, size_t count) {
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256 f0 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i + 0)));
+		__m256 f1 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i + 8)));
+		_mm256_storeu_ps(dst + i + 0, f0);
+		_mm256_storeu_ps(dst + i + 8, f1);
+	}
+	for (; i < count; i += 8) {
+		size_t n = count - i < 8 ? count - i : 8;
+		half h[8] = {};
+		float f[8];
+		memcpy(h, src + i, n * sizeof(half));
+		_mm256_storeu_ps(f, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)h)));
+		memcpy(dst + i, f, n * sizeof(float));
+	}
+}
+
+#endif // BMATH_KERNEL_F16C
+
+// Function pointer table of the batch kernels for one simdLevel.
+struct b__batchKernels {
+	simdLevel level;
+	void (*transformVec3)(mat4 m, const vec3 *points, vec3 *result, size_t count, bool projective);
+	void (*cullAABBs)(frustum<float> f, const aabb<float> *boxes, size_t count, unsigned char *visible);
+	void (*floatToHalf)(const float *src, half *dst, size_t count);
+	void (*halfToFloat)(const half *src, float *dst, size_t count);
+};
+
+#ifdef BMATH_HAS_DISPATCH
+
+// The register state that the OS saves on context switches (XCR0), or 0 without OSXSAVE.
+// The cpuid feature flags only say what the cpu can do - the AVX registers can't be used
+// unless the OS also saves them. Bits 1 and 2 are the XMM and YMM registers, bits 5 to 7
+// the AVX-512 mask registers and the upper halves and upper 16 of the ZMM registers.
+inline unsigned b__osRegisterState() {
+	#ifdef _MSC_VER
+		int registers[4];
+		__cpuid(registers, 1);
+		if ((registers[2] & (1 << 27)) == 0)
+			return 0;
+		return (unsigned)_xgetbv(0);
+	#else
+		unsigned eax, ebx, ecx, edx;
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & (1u << 27)) == 0)
+			return 0;
+		__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return eax;
+	#endif
+}
+
+#endif // BMATH_HAS_DISPATCH
+
+// F16C is a separate cpuid flag from the simdLevel - every cpu with AVX2 has it,
+// and so do some with only AVX. The F16C kernels are VEX encoded and use YMM registers,
+// so the half conversions only use them at SIMD_AVX2 and above, and only if the OS
+// saves the YMM registers.
+inline bool b__hasF16c() {
+	#if defined BMATH_HAS_DISPATCH
+		static bool hasF16c = (get_CPUID().feature_flags & CPUID_F16C) != 0 && (b__osRegisterState() & 0x6) == 0x6;
+		return hasF16c;
+	#elif defined BMATH_KERNEL_F16C
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+// The highest level supported by the cpu and OS (BMATH_DISPATCH) or by the compiler flags.
+inline simdLevel b__maxSimdLevel() {
+	#if defined BMATH_HAS_DISPATCH
+	{
+		static int features = get_CPUID().feature_flags;
+		static unsigned osState = b__osRegisterState();
+		if ((features & CPUID_AVX512_f) && (osState & 0xE6) == 0xE6)
+			return SIMD_AVX512;
+		if ((features & CPUID_AVX2) && (osState & 0x6) == 0x6)
+			return SIMD_AVX2;
+		if (features & CPUID_SSE2)
+			return SIMD_SSE2;
+		return SIMD_SCALAR;
+	}
+	#elif defined BMATH_KERNEL_AVX512
+		return SIMD_AVX512;
+	#elif defined BMATH_KERNEL_AVX2
+		return SIMD_AVX2;
+	#else
+		return SIMD_SSE2;
+	#endif
+}
+
+inline b__batchKernels b__selectKernels(simdLevel level) {
+	b__batchKernels kernels;
+	kernels.level = level;
+	switch (level) {
+		#ifdef BMATH_KERNEL_AVX512
+		case SIMD_AVX512:
+			kernels.transformVec3 = b__transformVec3Avx512;
+			kernels.cullAABBs = b__cullAABBsAvx2;
+			break;
+		#endif
+		#ifdef BMATH_KERNEL_AVX2
+		case SIMD_AVX2:
+			kernels.transformVec3 = b__transformVec3Avx2;
+			kernels.cullAABBs = b__cullAABBsAvx2;
+			break;
+		#endif
+		case SIMD_SSE2:
+			kernels.transformVec3 = b__transformVec3Sse2;
+			kernels.cullAABBs = b__cullAABBsSse2;
+			break;
+		default:
+			kernels.level = SIMD_SCALAR;
+			kernels.transformVec3 = b__transformVec3Scalar;
+			kernels.cullAABBs = b__cullAABBsScalar;
+			break;
+	}
+	kernels.floatToHalf = b__floatToHalfScalar;
+	kernels.halfToFloat = b__halfToFloatScalar;
+	#ifdef BMATH_KERNEL_F16C
+	if (kernels.level >= SIMD_AVX2 && b__hasF16c()) {
+		kernels.floatToHalf = b__floatToHalfF16c;
+		kernels.halfToFloat = b__halfToFloatF16c;
+	}
+	#endif
+	return kernels;
+}
+
+inline b__batchKernels &b__kernels() {
+	static b__batchKernels kernels = b__selectKernels(b__maxSimdLevel());
+	return kernels;
+}
+
+// The instruction set used by the batch functions.
+inline simdLevel getSimdLevel() {
+	return b__kernels().level;
+}
+
+// Forces the batch functions to use a lower instruction set, e.g. to test that all
+// versions agree. Levels that the cpu doesn't support are clamped to the highest
+// supported one. Returns the level that is now used. Not safe to call while other
+// threads are running batch functions.
+inline simdLevel setSimdLevel(simdLevel level) {
+	simdLevel maxLevel = b__maxSimdLevel();
+	b__kernels() = b__selectKernels(level < maxLevel ? level : maxLevel);
+	return b__kernels().level;
+}
+
+inline void transformPoints(mat4 m, const vec3 *points, vec3 *result, size_t count) {
+	b__kernels().transformVec3(m, points, result, count, false);
+}
+
+inline void transformDirections(mat4 m, const vec3 *directions, vec3 *result, size_t count) {
+	m.col[3] = vec4(0, 0, 0, 1);
+	b__kernels().transformVec3(m, directions, result, count, false);
+}
+
+inline void transformPointsProjective(mat4 m, const vec3 *points, vec3 *result, size_t count) {
+	b__kernels().transformVec3(m, points, result, count, true);
+}
+
+#endif // BMATH_KERNEL_SSE2
+
+// Tests which boxes are (at least partly) inside the frustum, and sets visible[i]
+// to 1 for those and 0 for the rest. Gives the same results as intersects(f, boxes[i]),
+// but tests 4 (SSE2) or 8 (AVX2 and AVX-512) boxes at a time.
+template<class T>
+inline void cullAABBs(frustum<T> f, const aabb<T> *boxes, size_t count, unsigned char *visible) {
+	for (size_t i = 0; i < count; ++i)
+		visible[i] = intersects(f, boxes[i]) ? 1 : 0;
+}
+
+#ifdef BMATH_KERNEL_SSE2
+inline void cullAABBs(frustum<float> f, const aabb<float> *boxes, size_t count, unsigned char *visible) {
+	b__kernels().cullAABBs(f, boxes, count, visible);
+}
+#endif
+
+// alignedArray versions of the batch functions. The result array is resized to the
+// size of the input (it may also be the input array itself). Return false if out of memory.
+template<class T, size_t A, size_t B>
+inline bool transformPoints(matrix<T, 4, 4> m, const alignedArray<vector<T, 3>, A> &points, alignedArray<vector<T, 3>, B> *result) {
+	if (!result->resize(points.count))
+		return false;
+	transformPoints(m, points.data, result->data, points.count);
+	return true;
+}
+
+template<class T, size_t A, size_t B>
+inline bool transformPoints(matrix<T, 4, 3> m, const alignedArray<vector<T, 3>, A> &points, alignedArray<vector<T, 3>, B> *result) {
+	return transformPoints(matrix<T, 4, 4>(m), points, result);
+}
+
+template<class T, size_t A, size_t B>
+inline bool transformDirections(matrix<T, 4, 4> m, const alignedArray<vector<T, 3>, A> &directions, alignedArray<vector<T, 3>, B> *result) {
+	if (!result->resize(directions.count))
+		return false;
+	transformDirections(m, directions.data, result->data, directions.count);
+	return true;
+}
+
+template<class T, size_t A, size_t B>
+inline bool transformDirections(matrix<T, 4, 3> m, const alignedArray<vector<T, 3>, A> &directions, alignedArray<vector<T, 3>, B> *result) {
+	return transformDirections(matrix<T, 4, 4>(m), directions, result);
+}
+
+template<class T, size_t A, size_t B>
+inline bool transformPointsProjective(matrix<T, 4, 4> m, const alignedArray<vector<T, 3>, A> &points, alignedArray<vector<T, 3>, B> *result) {
+	if (!result->resize(points.count))
+		return false;
+	transformPointsProjective(m, points.data, result->data, points.count);
+	return true;
+}
+
+template<class T, size_t A, size_t B>
+inline bool cullAABBs(frustum<T> f, const alignedArray<aabb<T>, A> &boxes, alignedArray<unsigned char, B> *visible) {
+	if (!visible->resize(boxes.count))
+		return false;
+	cullAABBs(f, boxes.data, boxes.count, visible->data);
+	return true;
 }
 
-template<class T>
-inline quaternion<T> slerp(quaternion<T> from, quaternion<T> to, T amount) {
-	quaternion<T> z = to;
+// Converts count floats to half floats (rounding to nearest even) and back. These
+// use F16C when the cpu has it and the simdLevel is at least SIMD_AVX2, and then run
+// at memory speed, otherwise they convert one value at a time. Both give bit-identical
+// results either way.
+inline void convertFloatToHalf(const float *src, half *dst, size_t count) {
+	#ifdef BMATH_KERNEL_SSE2
+		b__kernels().floatToHalf(src, dst, count);
+	#else
+		b__floatToHalfScalar(src, dst, count);
+	#endif
+}
 
-	T cosTheta = dot(from.xyzw, to.xyzw);
-	// if cosTheta < 0, the interpolation will take the long way around the sphere.
-	if (cosTheta < T(0)) {
-		z = -to;
-		cosTheta = -cosTheta;
+inline void convertHalfToFloat(const half *src, float *dst, size_t count) {
+	#ifdef BMATH_KERNEL_SSE2
+		b__kernels().halfToFloat(src, dst, count);
+	#else
+		b__halfToFloatScalar(src, dst, count);
+	#endif
+}
+
+template<int N>
+inline void convertFloatToHalf(const vector<float, N> *src, vector<half, N> *dst, size_t count) {
+	convertFloatToHalf((const float *)src, (half *)dst, count * N);
+}
+
+template<int N>
+inline void convertHalfToFloat(const vector<half, N> *src, vector<float, N> *dst, size_t count) {
+	convertHalfToFloat((const half *)src, (float *)dst, count * N);
+}
+
+// Array versions of the color functions, for whole images. With SSE2, all of them
+// but unpackSRGBA8 (which is just table lookups) process 4 pixels at a time, and
+// HSVtoRGB and RGBtoHSV select their results with masks instead of branching, so they
+// don't suffer from branch mispredictions on real images. All of them give
+// bit-identical results to the single pixel versions (for finite inputs).
+
+inline void unpackRGBA8(const uint *src, vec4 *dst, size_t count) {
+	size_t i = 0;
+	#ifdef BMATH_KERNEL_SSE2
+	{
+		__m128i zero = _mm_setzero_si128();
+		__m128 scale = _mm_set1_ps(1.0f / 255.0f);
+		for (; i + 4 <= count; i += 4) {
+			// widen the bytes to 32 bits, then reverse them since r is in the top byte
+			__m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+			__m128i p01 = _mm_unpacklo_epi8(p, zero);
+			__m128i p23 = _mm_unpackhi_epi8(p, zero);
+			__m128i p0 = _mm_shuffle_epi32(_mm_unpacklo_epi16(p01, zero), _MM_SHUFFLE(0, 1, 2, 3));
+			__m128i p1 = _mm_shuffle_epi32(_mm_unpackhi_epi16(p01, zero), _MM_SHUFFLE(0, 1, 2, 3));
+			__m128i p2 = _mm_shuffle_epi32(_mm_unpacklo_epi16(p23, zero), _MM_SHUFFLE(0, 1, 2, 3));
+			__m128i p3 = _mm_shuffle_epi32(_mm_unpackhi_epi16(p23, zero), _MM_SHUFFLE(0, 1, 2, 3));
+			_mm_storeu_ps((float *)(dst + i + 0), _mm_mul_ps(_mm_cvtepi32_ps(p0), scale));
+			_mm_storeu_ps((float *)(dst + i + 1), _mm_mul_ps(_mm_cvtepi32_ps(p1), scale));
+			_mm_storeu_ps((float *)(dst + i + 2), _mm_mul_ps(_mm_cvtepi32_ps(p2), scale));
+			_mm_storeu_ps((float *)(dst + i + 3), _mm_mul_ps(_mm_cvtepi32_ps(p3), scale));
+		}
 	}
+	#endif
+	for (; i < count; ++i)
+		dst[i] = unpackRGBA8(src[i]);
+}
 
-	// sin(angle) -> 0! too close for comfort - do a lerp instead.
-	if (cosTheta > T(0.99999))
-		return lerp(from, to, amount);
+#ifdef BMATH_KERNEL_SSE2
+// clamps the pixel to [0, 1], scales it to [0, 255] and reverses it so r goes in the top byte
+inline __m128i b__quantizeRGBA8(const vec4 *pixel) {
+	__m128 x = _mm_loadu_ps((const float *)pixel);
+	x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	__m128i i = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(255.5f)));
+	return _mm_shuffle_epi32(i, _MM_SHUFFLE(0, 1, 2, 3));
+}
+#endif
 
-	// Essential Mathematics, page 467.
-	T angle = acos(cosTheta);
-	return (sin((T(1) - amount) * angle) * from + sin(amount * angle) * z) / sin(angle);
+inline void packRGBA8(const vec4 *src, uint *dst, size_t count) {
+	size_t i = 0;
+	#ifdef BMATH_KERNEL_SSE2
+	{
+		for (; i + 4 <= count; i += 4) {
+			__m128i p01 = _mm_packs_epi32(b__quantizeRGBA8(src + i + 0), b__quantizeRGBA8(src + i + 1));
+			__m128i p23 = _mm_packs_epi32(b__quantizeRGBA8(src + i + 2), b__quantizeRGBA8(src + i + 3));
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(p01, p23));
+		}
+	}
+	#endif
+	for (; i < count; ++i)
+		dst[i] = packRGBA8(src[i]);
 }
 
-template<class T>
-inline quaternion<T> nlerp(quaternion<T> from, quaternion<T> to, T amount) {
-	return normalize(from + (to - from) * amount);
+inline void unpackSRGBA8(const uint *src, vec4 *dst, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = unpackSRGBA8(src[i]);
 }
 
-template<class T>
-inline quaternion<T> rotationQuat(vector<T, 3> axis, T angleRad) {
-	T a = angleRad / 2;
-	axis = normalize(axis);
-	return quaternion<T>(sin(a) * axis, cos(a));
+inline void packSRGBA8(const vec4 *src, uint *dst, size_t count) {
+	size_t i = 0;
+	#ifdef BMATH_KERNEL_SSE2
+	{
+		const b__srgbTables &tables = b__srgb();
+		// the clamping, bucket indices and packing are done in SSE on 4 pixels at once,
+		// only the table lookups aren't
+		__m128 minLinear = _mm_set1_ps(1.220703125e-4f);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128i minBits = _mm_set1_epi32(int(b__srgbTables::minBits));
+		for (; i + 4 <= count; i += 4) {
+			__m128 r = _mm_loadu_ps((const float *)(src + i + 0));
+			__m128 g = _mm_loadu_ps((const float *)(src + i + 1));
+			__m128 b = _mm_loadu_ps((const float *)(src + i + 2));
+			__m128 a = _mm_loadu_ps((const float *)(src + i + 3));
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+
+			__m128 c[3];
+			c[0] = _mm_min_ps(_mm_max_ps(r, minLinear), one);
+			c[1] = _mm_min_ps(_mm_max_ps(g, minLinear), one);
+			c[2] = _mm_min_ps(_mm_max_ps(b, minLinear), one);
+			__m128i k[3];
+			for (int j = 0; j < 3; ++j) {
+				uint index[4];
+				_mm_storeu_si128((__m128i *)index, _mm_srli_epi32(_mm_sub_epi32(_mm_castps_si128(c[j]), minBits), 16));
+				uint k0 = tables.bucket[index[0]];
+				uint k1 = tables.bucket[index[1]];
+				uint k2 = tables.bucket[index[2]];
+				uint k3 = tables.bucket[index[3]];
+				__m128 thresholds = _mm_setr_ps(tables.threshold[k0 + 1], tables.threshold[k1 + 1], tables.threshold[k2 + 1], tables.threshold[k3 + 1]);
+				k[j] = _mm_sub_epi32(_mm_setr_epi32(int(k0), int(k1), int(k2), int(k3)), _mm_castps_si128(_mm_cmpge_ps(c[j], thresholds)));
+			}
+			a = _mm_min_ps(_mm_max_ps(a, _mm_setzero_ps()), one);
+			__m128i alpha = _mm_cvttps_epi32(_mm_mul_ps(a, _mm_set1_ps(255.5f)));
+
+			__m128i p = _mm_or_si128(
+				_mm_or_si128(_mm_slli_epi32(k[0], 24), _mm_slli_epi32(k[1], 16)),
+				_mm_or_si128(_mm_slli_epi32(k[2], 8), alpha));
+			_mm_storeu_si128((__m128i *)(dst + i), p);
+		}
+	}
+	#endif
+	for (; i < count; ++i)
+		dst[i] = packSRGBA8(src[i]);
 }
 
-template<class T>
-inline quaternion<T> rotationQuat(vector<T, 3> from, vector<T, 3> to) {
-	T cosTheta = dot(from, to);
-	vector<T, 3> axis;
+inline void HSVtoRGB(const vec3 *hsv, vec3 *rgb, size_t count) {
+	#ifdef BMATH_KERNEL_SSE2
+		b__HSVtoRGBSse2(hsv, rgb, count);
+	#else
+		for (size_t i = 0; i < count; ++i)
+			rgb[i] = HSVtoRGB(hsv[i]);
+	#endif
+}
 
-	if (cosTheta >= T(0.99999))
-		return quat(T(0), T(0), T(0), T(1));
+inline void RGBtoHSV(const vec3 *rgb, vec3 *hsv, size_t count) {
+	#ifdef BMATH_KERNEL_SSE2
+		b__RGBtoHSVSse2(rgb, hsv, count);
+	#else
+		for (size_t i = 0; i < count; ++i)
+			hsv[i] = RGBtoHSV(rgb[i]);
+	#endif
+}
 
-	if (cosTheta < T(-0.99999)) {
-		// special case when vectors in opposite directions :
-		// there is no "ideal" rotation axis
-		// so guess one; any will do as long as it's perpendicular to start
-		// this implementation favors a rotation around the Up axis (Y),
-		// since it's often what you want to do.
-		axis = cross(vector<T, 3>(0, 0, 1), from);
-		if (lengthSq(axis) < T(0.00001)) // bad luck, they were parallel, try again!
-			axis = cross(vector<T, 3>(1, 0, 0), from);
+inline void premultiplyAlpha(const vec4 *src, vec4 *dst, size_t count) {
+	size_t i = 0;
+	#ifdef BMATH_KERNEL_SSE2
+	{
+		for (; i + 4 <= count; i += 4) {
+			__m128 r = _mm_loadu_ps((const float *)(src + i + 0));
+			__m128 g = _mm_loadu_ps((const float *)(src + i + 1));
+			__m128 b = _mm_loadu_ps((const float *)(src + i + 2));
+			__m128 a = _mm_loadu_ps((const float *)(src + i + 3));
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			r = _mm_mul_ps(r, a);
+			g = _mm_mul_ps(g, a);
+			b = _mm_mul_ps(b, a);
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			_mm_storeu_ps((float *)(dst + i + 0), r);
+			_mm_storeu_ps((float *)(dst + i + 1), g);
+			_mm_storeu_ps((float *)(dst + i + 2), b);
+			_mm_storeu_ps((float *)(dst + i + 3), a);
+		}
+	}
+	#endif
+	for (; i < count; ++i)
+		dst[i] = premultiplyAlpha(src[i]);
+}
 
-		axis = normalize(axis);
-		return rotationQuat(axis, T(3.141592653589793));
+inline void unpremultiplyAlpha(const vec4 *src, vec4 *dst, size_t count) {
+	size_t i = 0;
+	#ifdef BMATH_KERNEL_SSE2
+	{
+		for (; i + 4 <= count; i += 4) {
+			__m128 r = _mm_loadu_ps((const float *)(src + i + 0));
+			__m128 g = _mm_loadu_ps((const float *)(src + i + 1));
+			__m128 b = _mm_loadu_ps((const float *)(src + i + 2));
+			__m128 a = _mm_loadu_ps((const float *)(src + i + 3));
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			// pixels with a = 0 become 0
+			__m128 nonZero = _mm_cmpneq_ps(a, _mm_setzero_ps());
+			r = _mm_and_ps(_mm_div_ps(r, a), nonZero);
+			g = _mm_and_ps(_mm_div_ps(g, a), nonZero);
+			b = _mm_and_ps(_mm_div_ps(b, a), nonZero);
+			a = _mm_and_ps(a, nonZero);
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			_mm_storeu_ps((float *)(dst + i + 0), r);
+			_mm_storeu_ps((float *)(dst + i + 1), g);
+			_mm_storeu_ps((float *)(dst + i + 2), b);
+			_mm_storeu_ps((float *)(dst + i + 3), a);
+		}
 	}
+	#endif
+	for (; i < count; ++i)
+		dst[i] = unpremultiplyAlpha(src[i]);
+}
 
-	// from Stan Melax's Game Programming Gems 1 article.
-	axis = cross(from, to);
+// Skinning Functions
 
-	T s = sqrt((T(1) + cosTheta) * T(2));
-	T invs = T(1) / s;
+// The skinning functions transform count vertices by up to 4 bones each. Vertex i is
+// skinned by bones[boneIndices[4i + k]] with weight boneWeights[4i + k] for k = 0..3;
+// unused bones get weight 0. The indices can be any integer type (unsigned char,
+// unsigned short, ..) and the weights floats, or unorm bytes or shorts (255 or 65535
+// is 1). normals and tangents can be NULL - then the skinned ones aren't written.
+// Tangents keep their w (the bitangent sign). The outputs must not overlap the inputs.
+// Vertices are independent of each other, so skinning can be split across threads:
+// the versions taking begin and count only skin vertices begin to begin + count - 1,
+// indexing all of the arrays from their start as usual.
 
-	return quaternion<T>(
-		axis.x * invs,
-		axis.y * invs,
-		axis.z * invs,
-		s * T(0.5f));
+inline float b__boneWeight(float w) {
+	return w;
 }
 
-template<class T>
-inline BMATH_CONSTEXPR quaternion<T> rotate(quaternion<T> q, quaternion<T> rot) {
-	return rot * q * inverse(rot);
+inline float b__boneWeight(unsigned char w) {
+	return float(w) * (1.0f / 255);
 }
 
-template<class T>
-inline BMATH_CONSTEXPR quaternion<T> rotate(vector<T, 3> v, quaternion<T> rot) {
-	return rot * quaternion<T>(v, T(0)) * inverse(rot);
+inline float b__boneWeight(unsigned short w) {
+	return float(w) * (1.0f / 65535);
 }
 
-template<class T>
-inline BMATH_CONSTEXPR quaternion<T> rotate(vector<T, 3> v, vector<T, 3> axis, T angleRad) {
-	quaternion<T> rot = rotationQuat(axis, angleRad);
-	return rotate(v, rot);
+// Weighted sum of the bones, with the weights of those in the opposite hemisphere
+// to the first one negated, as q and -q are the same transform.
+template<class Index, class Weight>
+inline dualquat b__blendDualQuats(const dualquat *bones, const Index *indices, const Weight *weights) {
+	dualquat first = bones[indices[0]];
+	dualquat sum = first * b__boneWeight(weights[0]);
+	for (int k = 1; k < 4; ++k) {
+		dualquat bone = bones[indices[k]];
+		float w = b__boneWeight(weights[k]);
+		if (dot(bone.real.xyzw, first.real.xyzw) < 0)
+			w = -w;
+		sum += bone * w;
+	}
+	return sum;
 }
 
-template<class T>
-inline BMATH_CONSTEXPR matrix<T, 4, 4> quatToMat(quaternion<T> q) {
-	return matrix<T, 4, 4>(
-		T(1) - T(2) * (q.y * q.y + q.z * q.z),
-		T(2) * (q.x * q.y + q.w * q.z),
-		T(2) * (q.x * q.z - q.w * q.y),
-		T(0),
+#ifdef BMATH_KERNEL_SSE2
+// cross product of the xyz parts, with w = 0
+inline __m128 b__crossSse2(__m128 a, __m128 b) {
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
 
-		T(2) * (q.x * q.y - q.w * q.z),
-		T(1) - T(2) * (q.x * q.x + q.z * q.z),
-		T(2) * (q.y * q.z + q.w * q.x),
-		T(0),
+inline __m128 b__loadVec3(const vec3 *v) {
+	return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double *)v)), _mm_load_ss(&v->z));
+}
 
-		T(2) * (q.x * q.z + q.w * q.y),
-		T(2) * (q.y * q.z - q.w * q.x),
-		T(1) - T(2) * (q.x * q.x + q.y * q.y),
-		T(0),
+inline void b__storeVec3(vec3 *v, __m128 xyz) {
+	_mm_store_sd((double *)v, _mm_castps_pd(xyz));
+	_mm_store_ss(&v->z, _mm_movehl_ps(xyz, xyz));
+}
+#endif
 
-		T(0), T(0), T(0), T(1));
+// Dual quaternion skinning: blends the bones' dual quaternions, which keeps the volume
+// of twisting joints that linear blend skinning collapses ("candy wrapper"). With SSE2
+// each vertex is blended and transformed in registers, several times faster than
+// blending with the dualquat operators.
+template<class Index, class Weight>
+inline void skinVertices(
+	const dualquat *bones, const Index *boneIndices, const Weight *boneWeights,
+	const vec3 *positions, const vec3 *normals, const vec4 *tangents,
+	vec3 *skinnedPositions, vec3 *skinnedNormals, vec4 *skinnedTangents, size_t begin, size_t count) {
+	size_t end = begin + count;
+	size_t i = begin;
+	#ifdef BMATH_KERNEL_SSE2
+	{
+		__m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 two = _mm_set1_ps(2);
+		for (; i < end; ++i) {
+			const Index *indices = boneIndices + 4 * i;
+			const Weight *weights = boneWeights + 4 * i;
+			const float *first = &bones[indices[0]].real.x;
+			__m128 firstReal = _mm_loadu_ps(first);
+			__m128 w = _mm_set1_ps(b__boneWeight(weights[0]));
+			__m128 real = _mm_mul_ps(firstReal, w);
+			__m128 dual = _mm_mul_ps(_mm_loadu_ps(first + 4), w);
+			for (int k = 1; k < 4; ++k) {
+				const float *bone = &bones[indices[k]].real.x;
+				__m128 boneReal = _mm_loadu_ps(bone);
+				__m128 d = _mm_mul_ps(boneReal, firstReal);
+				d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+				d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+				w = _mm_xor_ps(_mm_set1_ps(b__boneWeight(weights[k])), _mm_and_ps(d, signMask));
+				real = _mm_add_ps(real, _mm_mul_ps(boneReal, w));
+				dual = _mm_add_ps(dual, _mm_mul_ps(_mm_loadu_ps(bone + 4), w));
+			}
+
+			// normalize, and split into xyz parts with w = 0 and broadcast w's
+			__m128 lengthSq = _mm_mul_ps(real, real);
+			lengthSq = _mm_add_ps(lengthSq, _mm_shuffle_ps(lengthSq, lengthSq, _MM_SHUFFLE(2, 3, 0, 1)));
+			lengthSq = _mm_add_ps(lengthSq, _mm_shuffle_ps(lengthSq, lengthSq, _MM_SHUFFLE(1, 0, 3, 2)));
+			__m128 invLength = _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(lengthSq));
+			real = _mm_mul_ps(real, invLength);
+			dual = _mm_mul_ps(dual, invLength);
+			__m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+			__m128 r = _mm_and_ps(real, xyz);
+			__m128 rw = _mm_shuffle_ps(real, real, _MM_SHUFFLE(3, 3, 3, 3));
+			__m128 d = _mm_and_ps(dual, xyz);
+			__m128 dw = _mm_shuffle_ps(dual, dual, _MM_SHUFFLE(3, 3, 3, 3));
+
+			__m128 translation = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(d, rw), _mm_mul_ps(r, dw)), b__crossSse2(r, d)));
+			__m128 p = b__loadVec3(positions + i);
+			p = _mm_add_ps(p, _mm_mul_ps(two, b__crossSse2(r, _mm_add_ps(b__crossSse2(r, p), _mm_mul_ps(p, rw)))));
+			b__storeVec3(skinnedPositions + i, _mm_add_ps(p, translation));
+			if (normals) {
+				__m128 n = b__loadVec3(normals + i);
+				n = _mm_add_ps(n, _mm_mul_ps(two, b__crossSse2(r, _mm_add_ps(b__crossSse2(r, n), _mm_mul_ps(n, rw)))));
+				b__storeVec3(skinnedNormals + i, n);
+			}
+			if (tangents) {
+				// w stays as it is, since the cross products have w = 0
+				__m128 t = _mm_loadu_ps((const float *)(tangents + i));
+				__m128 tXYZ = _mm_and_ps(t, xyz);
+				t = _mm_add_ps(t, _mm_mul_ps(two, b__crossSse2(r, _mm_add_ps(b__crossSse2(r, tXYZ), _mm_mul_ps(tXYZ, rw)))));
+				_mm_storeu_ps((float *)(skinnedTangents + i), t);
+			}
+		}
+	}
+	#endif
+	for (; i < end; ++i) {
+		dualquat q = normalize(b__blendDualQuats(bones, boneIndices + 4 * i, boneWeights + 4 * i));
+		skinnedPositions[i] = transformPoint(q, positions[i]);
+		if (normals)
+			skinnedNormals[i] = transformDirection(q, normals[i]);
+		if (tangents)
+			skinnedTangents[i] = vec4(transformDirection(q, vec3(tangents[i])), tangents[i].w);
+	}
+}
+
+template<class Index, class Weight>
+inline void skinVertices(
+	const dualquat *bones, const Index *boneIndices, const Weight *boneWeights,
+	const vec3 *positions, const vec3 *normals, const vec4 *tangents,
+	vec3 *skinnedPositions, vec3 *skinnedNormals, vec4 *skinnedTangents, size_t count) {
+	skinVertices(bones, boneIndices, boneWeights, positions, normals, tangents, skinnedPositions, skinnedNormals, skinnedTangents, 0, count);
+}
+
+#ifdef BMATH_KERNEL_SSE2
+// Transforms vertex i by the blended matrix with columns c0, c1, c2 and c3. Only
+// the xyz lanes of the columns are used.
+inline void b__skinVertexSse2(__m128 c0, __m128 c1, __m128 c2, __m128 c3, size_t i,
+	const vec3 *positions, const vec3 *normals, const vec4 *tangents,
+	vec3 *skinnedPositions, vec3 *skinnedNormals, vec4 *skinnedTangents) {
+	const float *p = &positions[i].x;
+	__m128 result = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(c0, _mm_set1_ps(p[0])),
+		_mm_mul_ps(c1, _mm_set1_ps(p[1]))), _mm_add_ps(
+		_mm_mul_ps(c2, _mm_set1_ps(p[2])), c3));
+	b__storeVec3(skinnedPositions + i, result);
+	if (normals) {
+		const float *n = &normals[i].x;
+		result = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(c0, _mm_set1_ps(n[0])),
+			_mm_mul_ps(c1, _mm_set1_ps(n[1]))),
+			_mm_mul_ps(c2, _mm_set1_ps(n[2])));
+		b__storeVec3(skinnedNormals + i, result);
+	}
+	if (tangents) {
+		__m128 t = _mm_loadu_ps((const float *)(tangents + i));
+		result = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(c0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0))),
+			_mm_mul_ps(c1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1)))),
+			_mm_mul_ps(c2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2))));
+		// keep w from the tangent
+		__m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+		result = _mm_or_ps(_mm_and_ps(result, xyz), _mm_andnot_ps(xyz, t));
+		_mm_storeu_ps((float *)(skinnedTangents + i), result);
+	}
+}
+#endif
+
+template<class Matrix, class Index, class Weight>
+inline void b__skinVerticesLinear(
+	const Matrix *bones, const Index *boneIndices, const Weight *boneWeights,
+	const vec3 *positions, const vec3 *normals, const vec4 *tangents,
+	vec3 *skinnedPositions, vec3 *skinnedNormals, vec4 *skinnedTangents, size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i) {
+		const Index *indices = boneIndices + 4 * i;
+		const Weight *weights = boneWeights + 4 * i;
+		Matrix m =
+			bones[indices[0]] * b__boneWeight(weights[0]) +
+			bones[indices[1]] * b__boneWeight(weights[1]) +
+			bones[indices[2]] * b__boneWeight(weights[2]) +
+			bones[indices[3]] * b__boneWeight(weights[3]);
+		skinnedPositions[i] = vec3(m * vec4(positions[i], 1));
+		if (normals)
+			skinnedNormals[i] = vec3(m * vec4(normals[i], 0));
+		if (tangents)
+			skinnedTangents[i] = vec4(vec3(m * vec4(vec3(tangents[i]), 0)), tangents[i].w);
+	}
+}
+
+// Linear blend skinning (matrix palette skinning): each vertex is transformed by
+// the weighted sum of its bones' matrices. The normals and tangents are transformed
+// by the upper 3x3 part of the sum, so the bones shouldn't scale non-uniformly,
+// and they aren't renormalized. The weights should add up to 1. With SSE2 the
+// matrices are blended and applied in registers, about twice as fast as blending
+// them with the matrix operators.
+template<class Index, class Weight>
+inline void skinVertices(
+	const mat4 *bones, const Index *boneIndices, const Weight *boneWeights,
+	const vec3 *positions, const vec3 *normals, const vec4 *tangents,
+	vec3 *skinnedPositions, vec3 *skinnedNormals, vec4 *skinnedTangents, size_t begin, size_t count) {
+	size_t end = begin + count;
+	size_t i = begin;
+	#ifdef BMATH_KERNEL_SSE2
+	{
+		for (; i < end; ++i) {
+			const Index *indices = boneIndices + 4 * i;
+			const Weight *weights = boneWeights + 4 * i;
+			__m128 c0 = _mm_setzero_ps();
+			__m128 c1 = _mm_setzero_ps();
+			__m128 c2 = _mm_setzero_ps();
+			__m128 c3 = _mm_setzero_ps();
+			for (int k = 0; k < 4; ++k) {
+				const float *m = &bones[indices[k]].col[0].x;
+				__m128 w = _mm_set1_ps(b__boneWeight(weights[k]));
+				c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(m + 0), w));
+				c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(m + 4), w));
+				c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(m + 8), w));
+				c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_loadu_ps(m + 12), w));
+			}
+			b__skinVertexSse2(c0, c1, c2, c3, i, positions, normals, tangents, skinnedPositions, skinnedNormals, skinnedTangents);
+		}
+	}
+	#endif
+	b__skinVerticesLinear(bones, boneIndices, boneWeights, positions, normals, tangents, skinnedPositions, skinnedNormals, skinnedTangents, i, end);
+}
+
+template<class Index, class Weight>
+inline void skinVertices(
+	const mat4 *bones, const Index *boneIndices, const Weight *boneWeights,
+	const vec3 *positions, const vec3 *normals, const vec4 *tangents,
+	vec3 *skinnedPositions, vec3 *skinnedNormals, vec4 *skinnedTangents, size_t count) {
+	skinVertices(bones, boneIndices, boneWeights, positions, normals, tangents, skinnedPositions, skinnedNormals, skinnedTangents, 0, count);
+}
+
+template<class Index, class Weight>
+inline void skinVertices(
+	const mat4x3 *bones, const Index *boneIndices, const Weight *boneWeights,
+	const vec3 *positions, const vec3 *normals, const vec4 *tangents,
+	vec3 *skinnedPositions, vec3 *skinnedNormals, vec4 *skinnedTangents, size_t begin, size_t count) {
+	size_t end = begin + count;
+	size_t i = begin;
+	#ifdef BMATH_KERNEL_SSE2
+	{
+		for (; i < end; ++i) {
+			const Index *indices = boneIndices + 4 * i;
+			const Weight *weights = boneWeights + 4 * i;
+			__m128 c0 = _mm_setzero_ps();
+			__m128 c1 = _mm_setzero_ps();
+			__m128 c2 = _mm_setzero_ps();
+			__m128 c3 = _mm_setzero_ps();
+			for (int k = 0; k < 4; ++k) {
+				// the columns are 3 floats apart, the last one is loaded from 8 to stay inside the matrix
+				const float *m = &bones[indices[k]].col[0].x;
+				__m128 w = _mm_set1_ps(b__boneWeight(weights[k]));
+				__m128 last = _mm_loadu_ps(m + 8);
+				c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(m + 0), w));
+				c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(m + 3), w));
+				c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(m + 6), w));
+				c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_shuffle_ps(last, last, _MM_SHUFFLE(0, 3, 2, 1)), w));
+			}
+			b__skinVertexSse2(c0, c1, c2, c3, i, positions, normals, tangents, skinnedPositions, skinnedNormals, skinnedTangents);
+		}
+	}
+	#endif
+	b__skinVerticesLinear(bones, boneIndices, boneWeights, positions, normals, tangents, skinnedPositions, skinnedNormals, skinnedTangents, i, end);
+}
+
+template<class Index, class Weight>
+inline void skinVertices(
+	const mat4x3 *bones, const Index *boneIndices, const Weight *boneWeights,
+	const vec3 *positions, const vec3 *normals, const vec4 *tangents,
+	vec3 *skinnedPositions, vec3 *skinnedNormals, vec4 *skinnedTangents, size_t count) {
+	skinVertices(bones, boneIndices, boneWeights, positions, normals, tangents, skinnedPositions, skinnedNormals, skinnedTangents, 0, count);
+}
+
+// Bounding Volume Hierarchy
+
+// A 4-wide BVH over an array of boxes, built with binned SAH (surface area heuristic).
+// Each node holds the bounds of its 4 children in SoA form, so that all 4 are tested
+// at once with SSE. The caller provides the memory: bvhNodeCapacity(count) nodes and
+// count primitive indices. For triangle meshes, build over triangleBounds of each
+// triangle. buildBVH stores the nodes depth first, so the first child follows its
+// parent. Big trees can also be built on several threads, see buildBVHTop.
+struct bvhNode {
+
+	// bounds of the 4 children
+	float minX[4], minY[4], minZ[4];
+	float maxX[4], maxY[4], maxZ[4];
+
+	// An inner child has count 0 and the index of its node. A leaf child has the
+	// number of its primitives, and the index of the first one in bvh::primitives.
+	// Unused children have count 0, index -1 and empty (inverted) bounds.
+	int index[4];
+	uint count[4];
+};
+
+struct bvh {
+	bvhNode *nodes; // nodes[0] is the root
+	size_t nodeCount;
+	uint *primitives; // indices of the boxes the bvh was built from, in leaf order
+	size_t primitiveCount;
+	aabb<float> bounds;
+};
+
+// Each leaf has 4 primitives at most, and every node except the root has 2 children at least.
+inline BMATH_CONSTEXPR size_t bvhNodeCapacity(size_t primitiveCount) {
+	return primitiveCount > 1 ? primitiveCount - 1 : 1;
 }
 
 template<class T>
-inline quaternion<T> matToQuat(matrix<T, 4, 4> m) {
-	T x = m.col[0].x - m.col[1].y - m.col[2].z;
-	T y = m.col[1].y - m.col[0].x - m.col[2].z;
-	T z = m.col[2].z - m.col[0].x - m.col[1].y;
-	T w = m.col[0].x + m.col[1].y + m.col[2].z;
+inline BMATH_CONSTEXPR aabb<T> triangleBounds(vector<T, 3> v0, vector<T, 3> v1, vector<T, 3> v2) {
+	return aabb<T>(min(min(v0, v1), v2), max(max(v0, v1), v2));
+}
 
-	T maxVal = w;
-	int maxIdx = 0;
-	if (x > maxVal) {
-		maxVal = x;
-		maxIdx = 1;
+// A subtree that buildBVHTop left to be built separately by buildBVHTask.
+struct bvhBuildTask {
+	uint begin; // range of bvh::primitives
+	uint end;
+	aabb<float> bounds;
+	uint parent; // the node whose child the subtree is
+	int child;
+	int depth;
+	uint firstNode; // the subtree's nodes go from here on
+	uint nodeCount; // set by buildBVHTask
+};
+
+// a range of bvh::primitives that's not a node yet
+struct b__bvhRange {
+	uint begin;
+	uint end;
+	aabb<float> bounds;
+	bool leaf;
+};
+
+struct b__bvhBuilder {
+	const aabb<float> *boxes;
+	bvhNode *nodes;
+	size_t nodeCount;
+	uint *primitives;
+	// ranges of more than 4 and at most taskSize primitives become tasks, while there's room
+	size_t taskSize;
+	bvhBuildTask *tasks;
+	size_t maxTasks;
+	size_t taskCount;
+};
+
+// Half of the surface area - SAH costs only need to be proportional to it.
+inline float b__halfArea(aabb<float> box) {
+	vec3 size = box.max - box.min;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+inline aabb<float> b__emptyAABB() {
+	return aabb<float>(vec3(float(HUGE_VAL)), vec3(-float(HUGE_VAL)));
+}
+
+inline aabb<float> b__bvhRangeBounds(const b__bvhBuilder &b, uint begin, uint end) {
+	aabb<float> bounds = b__emptyAABB();
+	for (uint i = begin; i < end; ++i)
+		bounds = merge(bounds, b.boxes[b.primitives[i]]);
+	return bounds;
+}
+
+// Splits the range in two at the plane with the lowest SAH cost, out of 16 bins of the
+// centroids along each axis. Returns false if the range is cheaper to keep as a leaf.
+// The median split halves the range instead, which bounds the depth of the tree.
+inline bool b__splitBVH(b__bvhBuilder &b, b__bvhRange range, bool median, b__bvhRange *left, b__bvhRange *right) {
+	const int BINS = 16;
+	uint count = range.end - range.begin;
+	if (count <= 1 || (median && count <= 4))
+		return false;
+
+	vec3 centroidMin = vec3(float(HUGE_VAL));
+	vec3 centroidMax = vec3(-float(HUGE_VAL));
+	for (uint i = range.begin; i < range.end; ++i) {
+		vec3 c = center(b.boxes[b.primitives[i]]);
+		centroidMin = min(centroidMin, c);
+		centroidMax = max(centroidMax, c);
 	}
-	if (y > maxVal) {
-		maxVal = y;
-		maxIdx = 2;
+	vec3 extent = centroidMax - centroidMin;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+	uint mid = range.begin;
+	if (!median && extent[axis] > 0) {
+		aabb<float> binBounds[3][BINS];
+		uint binCount[3][BINS];
+		vec3 scale;
+		for (int a = 0; a < 3; ++a) {
+			scale[a] = extent[a] > 0 ? float(BINS) / extent[a] : 0;
+			for (int i = 0; i < BINS; ++i) {
+				binBounds[a][i] = b__emptyAABB();
+				binCount[a][i] = 0;
+			}
+		}
+		for (uint i = range.begin; i < range.end; ++i) {
+			aabb<float> box = b.boxes[b.primitives[i]];
+			vec3 c = center(box);
+			for (int a = 0; a < 3; ++a) {
+				int bin = min(int((c[a] - centroidMin[a]) * scale[a]), BINS - 1);
+				binBounds[a][bin] = merge(binBounds[a][bin], box);
+				++binCount[a][bin];
+			}
+		}
+
+		// cost of splitting before bin i, for the bins that have primitives on both sides
+		float bestCost = float(HUGE_VAL);
+		int bestAxis = axis;
+		int bestBin = 0;
+		for (int a = 0; a < 3; ++a) {
+			float rightArea[BINS];
+			uint rightCount[BINS];
+			aabb<float> bounds = b__emptyAABB();
+			uint n = 0;
+			for (int i = BINS - 1; i > 0; --i) {
+				bounds = merge(bounds, binBounds[a][i]);
+				n += binCount[a][i];
+				rightArea[i] = n > 0 ? b__halfArea(bounds) : 0;
+				rightCount[i] = n;
+			}
+			bounds = b__emptyAABB();
+			n = 0;
+			for (int i = 1; i < BINS; ++i) {
+				bounds = merge(bounds, binBounds[a][i - 1]);
+				n += binCount[a][i - 1];
+				if (n == 0 || rightCount[i] == 0)
+					continue;
+				float cost = b__halfArea(bounds) * float(n) + rightArea[i] * float(rightCount[i]);
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = a;
+					bestBin = i;
+				}
+			}
+		}
+
+		// a node costs about as much to visit as a primitive to test
+		float area = b__halfArea(range.bounds);
+		if (count <= 4 && area * float(count) <= area + bestCost)
+			return false;
+
+		uint *first = b.primitives + range.begin;
+		uint *last = b.primitives + range.end;
+		while (first < last) {
+			float c = center(b.boxes[*first])[bestAxis];
+			if (int((c - centroidMin[bestAxis]) * scale[bestAxis]) < bestBin)
+				++first;
+			else {
+				uint temp = *first;
+				*first = *--last;
+				*last = temp;
+			}
+		}
+		mid = uint(first - b.primitives);
+	} else {
+		// quickselect the centroid in the middle of the longest axis
+		uint *p = b.primitives;
+		int lo = int(range.begin);
+		int hi = int(range.end) - 1;
+		int k = int(range.begin + count / 2);
+		while (lo < hi) {
+			float pivot = center(b.boxes[p[lo + (hi - lo) / 2]])[axis];
+			int i = lo;
+			int j = hi;
+			while (i <= j) {
+				while (center(b.boxes[p[i]])[axis] < pivot)
+					++i;
+				while (center(b.boxes[p[j]])[axis] > pivot)
+					--j;
+				if (i <= j) {
+					uint temp = p[i];
+					p[i++] = p[j];
+					p[j--] = temp;
+				}
+			}
+			if (k <= j)
+				hi = j;
+			else if (k >= i)
+				lo = i;
+			else
+				break;
+		}
+		mid = uint(k);
 	}
-	if (z > maxVal) {
-		maxVal = z;
-		maxIdx = 3;
+
+	// all centroids in the same place, so any split is as good as another
+	if (mid == range.begin || mid == range.end)
+		mid = range.begin + count / 2;
+
+	left->begin = range.begin;
+	left->end = mid;
+	left->bounds = b__bvhRangeBounds(b, range.begin, mid);
+	left->leaf = false;
+	right->begin = mid;
+	right->end = range.end;
+	right->bounds = b__bvhRangeBounds(b, mid, range.end);
+	right->leaf = false;
+	return true;
+}
+
+// Builds a node from 2 already split ranges, by splitting the largest of them until
+// there are 4, and recursing into the children that don't become leaves. Past depth 32
+// the splits switch to median splits, which at least halve the primitives per level.
+inline int b__buildBVHNode(b__bvhBuilder &b, b__bvhRange *children, int childCount, int depth) {
+	bool median = depth >= 32;
+	while (childCount < 4) {
+		int largest = -1;
+		float largestArea = -1;
+		for (int i = 0; i < childCount; ++i) {
+			float area = b__halfArea(children[i].bounds);
+			if (!children[i].leaf && area > largestArea) {
+				largest = i;
+				largestArea = area;
+			}
+		}
+		if (largest < 0)
+			break;
+		if (b__splitBVH(b, children[largest], median, &children[largest], &children[childCount]))
+			++childCount;
+		else
+			children[largest].leaf = true;
 	}
 
-	maxVal = sqrt(maxVal + T(1)) / T(2);
-	T mult = T(0.25) / maxVal;
+	int nodeIndex = int(b.nodeCount++);
+	for (int i = 0; i < 4; ++i) {
+		bvhNode &node = b.nodes[nodeIndex];
+		aabb<float> bounds = i < childCount ? children[i].bounds : b__emptyAABB();
+		node.minX[i] = bounds.min.x;
+		node.minY[i] = bounds.min.y;
+		node.minZ[i] = bounds.min.z;
+		node.maxX[i] = bounds.max.x;
+		node.maxY[i] = bounds.max.y;
+		node.maxZ[i] = bounds.max.z;
+		node.index[i] = -1;
+		node.count[i] = 0;
+		if (i >= childCount)
+			continue;
+
+		uint count = children[i].end - children[i].begin;
+		if (!children[i].leaf && count > 4 && count <= b.taskSize && b.taskCount < b.maxTasks) {
+			bvhBuildTask &task = b.tasks[b.taskCount++];
+			task.begin = children[i].begin;
+			task.end = children[i].end;
+			task.bounds = children[i].bounds;
+			task.parent = uint(nodeIndex);
+			task.child = i;
+			task.depth = depth;
+			task.nodeCount = 0;
+			continue;
+		}
 
-	switch (maxIdx) {
-		case 0:
-			return quaternion<T>(
-				(m.col[1].z - m.col[2].y) * mult,
-				(m.col[2].x - m.col[0].z) * mult,
-				(m.col[0].y - m.col[1].x) * mult,
-				maxVal);
-		case 1:
-			return quaternion<T>(
-				maxVal,
-				(m.col[0].y + m.col[1].x) * mult,
-				(m.col[2].x + m.col[0].z) * mult,
-				(m.col[1].z - m.col[2].y) * mult);
-		case 2:
-			return quaternion<T>(
-				(m.col[0].y + m.col[1].x) * mult,
-				maxVal,
-				(m.col[1].z + m.col[2].y) * mult,
-				(m.col[2].x - m.col[0].z) * mult);
-		case 3:
-			return quaternion<T>(
-				(m.col[2].x + m.col[0].z) * mult,
-				(m.col[1].z + m.col[2].y) * mult,
-				maxVal,
-				(m.col[0].y - m.col[1].x) * mult);
-		default: return quaternion<T>(0, 0, 0, 0);
+		b__bvhRange grandchildren[4];
+		if (!children[i].leaf && b__splitBVH(b, children[i], median, &grandchildren[0], &grandchildren[1])) {
+			int child = b__buildBVHNode(b, grandchildren, 2, depth + 1);
+			b.nodes[nodeIndex].index[i] = child;
+		} else {
+			node.index[i] = int(children[i].begin);
+			node.count[i] = children[i].end - children[i].begin;
+		}
+	}
+	return nodeIndex;
+}
+
+inline bvh b__buildBVH(b__bvhBuilder &b, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		b.primitives[i] = uint(i);
+
+	aabb<float> bounds = count > 0 ? b__bvhRangeBounds(b, 0, uint(count)) : b__emptyAABB();
+	b__bvhRange children[4];
+	children[0].begin = 0;
+	children[0].end = uint(count);
+	children[0].bounds = bounds;
+	children[0].leaf = count <= 1;
+	if (count == 0)
+		b__buildBVHNode(b, children, 0, 0);
+	else if (b__splitBVH(b, children[0], false, &children[0], &children[1]))
+		b__buildBVHNode(b, children, 2, 1);
+	else {
+		children[0].leaf = true;
+		b__buildBVHNode(b, children, 1, 0);
+	}
+
+	bvh tree;
+	tree.nodes = b.nodes;
+	tree.nodeCount = b.nodeCount;
+	tree.primitives = b.primitives;
+	tree.primitiveCount = count;
+	tree.bounds = bounds;
+	return tree;
+}
+
+// Builds a bvh over the boxes, using the nodes and primitives arrays for storage.
+// The nodes array needs room for bvhNodeCapacity(count) nodes, and primitives for
+// count indices. The boxes are only needed again for overlapping.
+inline bvh buildBVH(const aabb<float> *boxes, size_t count, bvhNode *nodes, uint *primitives) {
+	b__bvhBuilder b;
+	b.boxes = boxes;
+	b.nodes = nodes;
+	b.nodeCount = 0;
+	b.primitives = primitives;
+	b.taskSize = 0;
+	b.tasks = NULL;
+	b.maxTasks = 0;
+	b.taskCount = 0;
+	return b__buildBVH(b, count);
+}
+
+// Building a bvh on several threads, in three steps:
+//  1. buildBVHTop builds the top of the tree like buildBVH, but leaves the subtrees
+//     of at most taskSize primitives as tasks (up to maxTasks of them, the rest are
+//     built right away). taskSize = count / (4 * number of threads) or so works well.
+//  2. buildBVHTask builds the subtree of one task. The tasks only write to their own
+//     part of the arrays, so they can run on any threads at the same time.
+//  3. When all of them are done, finishBVH links the subtrees into the tree and moves
+//     them together. Only then can the tree be used.
+// The result is the same tree as from buildBVH, just with the nodes in another order.
+inline bvh buildBVHTop(const aabb<float> *boxes, size_t count, bvhNode *nodes, uint *primitives,
+	size_t taskSize, bvhBuildTask *tasks, size_t maxTasks, size_t *taskCount) {
+	b__bvhBuilder b;
+	b.boxes = boxes;
+	b.nodes = nodes;
+	b.nodeCount = 0;
+	b.primitives = primitives;
+	b.taskSize = taskSize;
+	b.tasks = tasks;
+	b.maxTasks = maxTasks;
+	b.taskCount = 0;
+	bvh tree = b__buildBVH(b, count);
+
+	// a subtree over n primitives has at most n - 1 nodes, and these add up to at
+	// most bvhNodeCapacity(count) together with the top of the tree
+	size_t firstNode = b.nodeCount;
+	for (size_t i = 0; i < b.taskCount; ++i) {
+		tasks[i].firstNode = uint(firstNode);
+		firstNode += tasks[i].end - tasks[i].begin - 1;
+	}
+	*taskCount = b.taskCount;
+	return tree;
+}
+
+inline void buildBVHTask(const bvh &tree, const aabb<float> *boxes, bvhBuildTask *task) {
+	b__bvhBuilder b;
+	b.boxes = boxes;
+	b.nodes = tree.nodes;
+	b.nodeCount = task->firstNode;
+	b.primitives = tree.primitives;
+	b.taskSize = 0;
+	b.tasks = NULL;
+	b.maxTasks = 0;
+	b.taskCount = 0;
+
+	b__bvhRange range;
+	range.begin = task->begin;
+	range.end = task->end;
+	range.bounds = task->bounds;
+	range.leaf = false;
+	b__bvhRange children[4];
+	if (b__splitBVH(b, range, task->depth >= 32, &children[0], &children[1]))
+		b__buildBVHNode(b, children, 2, task->depth + 1);
+	task->nodeCount = uint(b.nodeCount - task->firstNode);
+}
+
+inline void finishBVH(bvh *tree, const bvhBuildTask *tasks, size_t taskCount) {
+	size_t nodeCount = tree->nodeCount;
+	for (size_t i = 0; i < taskCount; ++i) {
+		const bvhBuildTask &task = tasks[i];
+		bvhNode &parent = tree->nodes[task.parent];
+		if (task.nodeCount == 0) {
+			// cheaper as a leaf
+			parent.index[task.child] = int(task.begin);
+			parent.count[task.child] = task.end - task.begin;
+			continue;
+		}
+
+		// the subtree's nodes only point to each other, so they all move by the same amount
+		int shift = int(task.firstNode) - int(nodeCount);
+		bvhNode *nodes = tree->nodes + nodeCount;
+		memmove((void *)nodes, (const void *)(tree->nodes + task.firstNode), task.nodeCount * sizeof(bvhNode));
+		for (uint n = 0; n < task.nodeCount; ++n)
+			for (int k = 0; k < 4; ++k)
+				if (nodes[n].count[k] == 0 && nodes[n].index[k] >= 0)
+					nodes[n].index[k] -= shift;
+		parent.index[task.child] = int(nodeCount);
+		nodeCount += task.nodeCount;
+	}
+	tree->nodeCount = nodeCount;
+}
+
+// Slab test of the ray against the 4 children of the node, the same as raycast(ray, aabb).
+// Returns a bit mask of the children that are hit, and their distances.
+inline int b__raycastBVHNode(const bvhNode &node, vec3 origin, vec3 invDirection, float maxDistance, float *distances) {
+	#if defined BMATH_KERNEL_SSE2
+	{
+		__m128 ox = _mm_set1_ps(origin.x);
+		__m128 oy = _mm_set1_ps(origin.y);
+		__m128 oz = _mm_set1_ps(origin.z);
+		__m128 ix = _mm_set1_ps(invDirection.x);
+		__m128 iy = _mm_set1_ps(invDirection.y);
+		__m128 iz = _mm_set1_ps(invDirection.z);
+		__m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ox), ix);
+		__m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), oy), iy);
+		__m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), oz), iz);
+		__m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ox), ix);
+		__m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), oy), iy);
+		__m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), oz), iz);
+		__m128 tNear = _mm_setzero_ps();
+		__m128 tFar = _mm_set1_ps(maxDistance);
+		tNear = _mm_max_ps(_mm_min_ps(x0, x1), tNear);
+		tFar = _mm_min_ps(_mm_max_ps(x0, x1), tFar);
+		tNear = _mm_max_ps(_mm_min_ps(y0, y1), tNear);
+		tFar = _mm_min_ps(_mm_max_ps(y0, y1), tFar);
+		tNear = _mm_max_ps(_mm_min_ps(z0, z1), tNear);
+		tFar = _mm_min_ps(_mm_max_ps(z0, z1), tFar);
+		__m128i unused = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)node.index), _mm_set1_epi32(-1));
+		__m128 hit = _mm_andnot_ps(_mm_castsi128_ps(unused), _mm_cmple_ps(tNear, tFar));
+		_mm_storeu_ps(distances, tNear);
+		return _mm_movemask_ps(hit);
+	}
+	#else
+	{
+		int mask = 0;
+		for (int i = 0; i < 4; ++i) {
+			vec3 t0 = (vec3(node.minX[i], node.minY[i], node.minZ[i]) - origin) * invDirection;
+			vec3 t1 = (vec3(node.maxX[i], node.maxY[i], node.maxZ[i]) - origin) * invDirection;
+			float tNear = 0;
+			float tFar = maxDistance;
+			for (int a = 0; a < 3; ++a) {
+				tNear = max(min(t0[a], t1[a]), tNear);
+				tFar = min(max(t0[a], t1[a]), tFar);
+			}
+			distances[i] = tNear;
+			if (tNear <= tFar && node.index[i] != -1)
+				mask |= 1 << i;
+		}
+		return mask;
+	}
+	#endif
+}
+
+inline int b__overlapBVHNode(const bvhNode &node, aabb<float> box) {
+	#if defined BMATH_KERNEL_SSE2
+	{
+		__m128 overlap = _mm_and_ps(
+			_mm_and_ps(
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(node.minX), _mm_set1_ps(box.max.x)), _mm_cmple_ps(_mm_set1_ps(box.min.x), _mm_loadu_ps(node.maxX))),
+				_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(node.minY), _mm_set1_ps(box.max.y)), _mm_cmple_ps(_mm_set1_ps(box.min.y), _mm_loadu_ps(node.maxY)))),
+			_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(node.minZ), _mm_set1_ps(box.max.z)), _mm_cmple_ps(_mm_set1_ps(box.min.z), _mm_loadu_ps(node.maxZ))));
+		return _mm_movemask_ps(overlap);
+	}
+	#else
+	{
+		int mask = 0;
+		for (int i = 0; i < 4; ++i) {
+			aabb<float> child(vec3(node.minX[i], node.minY[i], node.minZ[i]), vec3(node.maxX[i], node.maxY[i], node.maxZ[i]));
+			if (intersects(child, box))
+				mask |= 1 << i;
+		}
+		return mask;
+	}
+	#endif
+}
+
+inline void b__bvhTriangle(const vec3 *vertices, const uint *indices, uint triangle, vec3 *v0, vec3 *v1, vec3 *v2) {
+	if (indices) {
+		*v0 = vertices[indices[3 * triangle + 0]];
+		*v1 = vertices[indices[3 * triangle + 1]];
+		*v2 = vertices[indices[3 * triangle + 2]];
+	} else {
+		*v0 = vertices[3 * triangle + 0];
+		*v1 = vertices[3 * triangle + 1];
+		*v2 = vertices[3 * triangle + 2];
+	}
+}
+
+// The median splits past depth 32 keep the tree at most 64 nodes deep, and each
+// visited node pushes at most 3 more than it pops.
+#define b__BVH_STACK_SIZE 256
+
+// Closest hit of the ray with the triangles of a bvh built over their triangleBounds.
+// Triangle i is made of vertices[indices[3i]], vertices[indices[3i + 1]] and
+// vertices[indices[3i + 2]], or of vertices[3i], vertices[3i + 1] and vertices[3i + 2]
+// if indices is NULL. Writes the distance, triangle index and barycentrics of the hit
+// like raycast(ray, v0, v1, v2, ..). Children are visited nearest first.
+inline bool raycast(ray<float> r, const bvh &tree, const vec3 *vertices, const uint *indices, float *distance, uint *triangle, vec2 *barycentric, float maxDistance = float(HUGE_VAL)) {
+	vec3 invDirection = 1.0f / r.direction;
+	int stack[b__BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	bool hit = false;
+	while (top > 0) {
+		const bvhNode &node = tree.nodes[stack[--top]];
+		float distances[4];
+		int mask = b__raycastBVHNode(node, r.origin, invDirection, maxDistance, distances);
+
+		// sort the hit children by distance
+		int order[4];
+		int hitCount = 0;
+		for (int i = 0; i < 4; ++i) {
+			if (!(mask & (1 << i)))
+				continue;
+			int j = hitCount++;
+			for (; j > 0 && distances[order[j - 1]] > distances[i]; --j)
+				order[j] = order[j - 1];
+			order[j] = i;
+		}
+
+		// test the leaves right away, which can shorten maxDistance for the rest
+		int innerCount = 0;
+		for (int k = 0; k < hitCount; ++k) {
+			int i = order[k];
+			if (node.count[i] == 0) {
+				order[innerCount++] = i;
+				continue;
+			}
+			if (distances[i] > maxDistance)
+				continue;
+			for (uint p = 0; p < node.count[i]; ++p) {
+				uint primitive = tree.primitives[uint(node.index[i]) + p];
+				vec3 v0, v1, v2;
+				b__bvhTriangle(vertices, indices, primitive, &v0, &v1, &v2);
+				if (raycast(r, v0, v1, v2, distance, barycentric, maxDistance)) {
+					maxDistance = *distance;
+					*triangle = primitive;
+					hit = true;
+				}
+			}
+		}
+		for (int k = innerCount - 1; k >= 0; --k)
+			if (distances[order[k]] <= maxDistance)
+				stack[top++] = node.index[order[k]];
+	}
+	return hit;
+}
+
+// Whether the ray hits any of the triangles closer than maxDistance - for shadow
+// rays. Stops at the first hit found, which is usually not the closest one.
+inline bool raycastAny(ray<float> r, const bvh &tree, const vec3 *vertices, const uint *indices, float maxDistance = float(HUGE_VAL)) {
+	vec3 invDirection = 1.0f / r.direction;
+	int stack[b__BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const bvhNode &node = tree.nodes[stack[--top]];
+		float distances[4];
+		int mask = b__raycastBVHNode(node, r.origin, invDirection, maxDistance, distances);
+		for (int i = 0; i < 4; ++i) {
+			if (!(mask & (1 << i)))
+				continue;
+			if (node.count[i] == 0) {
+				stack[top++] = node.index[i];
+				continue;
+			}
+			for (uint p = 0; p < node.count[i]; ++p) {
+				vec3 v0, v1, v2;
+				b__bvhTriangle(vertices, indices, tree.primitives[uint(node.index[i]) + p], &v0, &v1, &v2);
+				float t;
+				vec2 barycentric;
+				if (raycast(r, v0, v1, v2, &t, &barycentric, maxDistance))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Finds the boxes (of the ones the bvh was built from) that intersect the given box.
+// Writes the first maxResults of their indices to results, and returns how many there are.
+inline size_t overlapping(const bvh &tree, const aabb<float> *boxes, aabb<float> box, uint *results, size_t maxResults) {
+	size_t found = 0;
+	int stack[b__BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const bvhNode &node = tree.nodes[stack[--top]];
+		int mask = b__overlapBVHNode(node, box);
+		for (int i = 0; i < 4; ++i) {
+			if (!(mask & (1 << i)))
+				continue;
+			if (node.count[i] == 0) {
+				stack[top++] = node.index[i];
+				continue;
+			}
+			for (uint p = 0; p < node.count[i]; ++p) {
+				uint primitive = tree.primitives[uint(node.index[i]) + p];
+				if (intersects(boxes[primitive], box)) {
+					if (found < maxResults)
+						results[found] = primitive;
+					++found;
+				}
+			}
+		}
+	}
+	return found;
+}
+
+#undef b__BVH_STACK_SIZE
+
+// Transform Hierarchy
+
+// Scene graph transforms in structure-of-arrays form, in arrays supplied by the caller.
+// Every node has a local translation, rotation and scale relative to its parent, and
+// parents[i] is the index of its parent, or -1 for a root. Parents must come before
+// their children (parents[i] < i), so that one pass in order can update all of them.
+// Changing a node only sets its dirty flag, and updateTransforms then recomputes the
+// world matrices of the dirty nodes and everything below them. inverseWorlds can be
+// NULL when the inverses aren't needed. Set every dirty flag when the nodes are first
+// filled in, or after changing parents.
+struct transformHierarchy {
+	size_t count;
+	const int *parents;
+	vec3 *translations;
+	quat *rotations;
+	vec3 *scales;
+	mat4 *worlds;
+	mat4 *inverseWorlds;
+	unsigned char *dirty;
+};
+
+inline void setLocalTransform(transformHierarchy &h, size_t node, vec3 translation, quat rotation, vec3 scale) {
+	h.translations[node] = translation;
+	h.rotations[node] = rotation;
+	h.scales[node] = scale;
+	h.dirty[node] = 1;
+}
+
+// Recomputes the world matrices - worlds[parent] * trsMat(..) - and their inverses
+// for the dirty nodes and their descendants, and clears the dirty flags. Returns
+// how many nodes were updated. Clean nodes cost only a check of their dirty flag
+// and that of their parent, so static nodes are almost free.
+inline size_t updateTransforms(transformHierarchy &h) {
+	size_t updated = 0;
+	for (size_t i = 0; i < h.count; ++i) {
+		int parent = h.parents[i];
+		if (parent >= 0)
+			h.dirty[i] |= h.dirty[parent];
+		if (!h.dirty[i])
+			continue;
+
+		mat4 local = trsMat(h.translations[i], h.rotations[i], h.scales[i]);
+		h.worlds[i] = parent >= 0 ? h.worlds[parent] * local : local;
+		if (h.inverseWorlds) {
+			mat4 inverseLocal = inverseTRS(h.translations[i], h.rotations[i], h.scales[i]);
+			h.inverseWorlds[i] = parent >= 0 ? inverseLocal * h.inverseWorlds[parent] : inverseLocal;
+		}
+		++updated;
 	}
+	memset(h.dirty, 0, h.count);
+	return updated;
 }
 
 BMATH_END
@@ -3426,6 +9176,24 @@ BMATH_END
 #undef BMATH_HAS_EXP2_LOG2
 #undef BMATH_HAS_DEFAULT_CONSTRUCTOR
 #undef BMATH_CONSTEXPR
+#undef BMATH_HAS_CONSTANT_EVALUATED
+#undef BMATH_CONSTEXPR_MATH
+#undef b__IS_CONSTANT_EVALUATED
+#undef BMATH_HAS_SSE2
+#undef BMATH_HAS_SSE41
+#undef BMATH_HAS_AVX
+#undef BMATH_HAS_AVX2
+#undef BMATH_HAS_AVX512
+#undef BMATH_HAS_F16C
+#undef BMATH_HAS_DISPATCH
+#undef BMATH_KERNEL_SSE2
+#undef BMATH_KERNEL_AVX2
+#undef BMATH_KERNEL_AVX512
+#undef BMATH_KERNEL_F16C
+#undef BMATH_TARGET_AVX2
+#undef BMATH_TARGET_AVX512
+#undef BMATH_TARGET_F16C
+#undef BMATH_ALIGN
 
 #endif // !BMATH_H
 
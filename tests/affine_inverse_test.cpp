@@ -0,0 +1,131 @@
+/*
+  Compares the SSE versions of inverseAffine(mat4), inverseTRS and inverseRigid(mat4)
+  against the scalar template versions, using double precision as the reference. They
+  must be about as accurate as the scalar versions, and their bottom row must be exactly
+  (0, 0, 0, 1). Returns 0 when everything passes.
+
+    g++ -O2 -DBMATH_SIMD -I.. affine_inverse_test.cpp -o affine_inverse_test && ./affine_inverse_test
+*/
+
+#include "test.h"
+#include <cfloat>
+
+#ifndef BMATH_SIMD
+#	error "compile with -DBMATH_SIMD, otherwise there is nothing to compare"
+#endif
+
+static vec3 randomVec3(RNG *rng, float min, float max) {
+	return vec3(randUniform(rng, min, max), randUniform(rng, min, max), randUniform(rng, min, max));
+}
+
+static double maxNorm(dmat4 m) {
+	double norm = 0;
+	for (int r = 0; r < 4; ++r)
+		norm = max(norm, abs(m.col[0][r]) + abs(m.col[1][r]) + abs(m.col[2][r]) + abs(m.col[3][r]));
+	return norm;
+}
+
+// Largest error relative to the largest element of the reference, divided by the
+// condition number, in units of FLT_EPSILON.
+static double inverseError(mat4 m, dmat4 reference, double condition) {
+	double scale = 0, worst = 0;
+	for (int c = 0; c < 4; ++c)
+		for (int r = 0; r < 4; ++r) {
+			scale = max(scale, abs(reference.col[c][r]));
+			worst = max(worst, abs(m.col[c][r] - reference.col[c][r]));
+		}
+	return worst / scale / condition / FLT_EPSILON;
+}
+
+static bool hasAffineBottomRow(mat4 m) {
+	return m.col[0].w == 0 && m.col[1].w == 0 && m.col[2].w == 0 && m.col[3].w == 1;
+}
+
+struct errorStats {
+	double sse, scalar;
+	void add(double sseError, double scalarError) {
+		sse = max(sse, sseError);
+		scalar = max(scalar, scalarError);
+	}
+};
+
+static void report(const char *name, errorStats e, double limit) {
+	printf("%-14s sse %5.2f scalar %5.2f eps\n", name, e.sse, e.scalar);
+	CHECK(e.sse <= limit, "%s error %g eps > %g", name, e.sse, limit);
+	CHECK(e.sse <= 2 * e.scalar + 1, "%s error %g eps vs scalar %g", name, e.sse, e.scalar);
+}
+
+int main() {
+	RNG rng = seedRNG(1234);
+	errorStats affine = {}, sheared = {}, trs = {}, rigid = {};
+
+	for (int i = 0; i < 200000; ++i) {
+		vec3 t = randomVec3(&rng, -100, 100);
+		quat q = randomRotation(&rng);
+		vec3 s = randomVec3(&rng, 0.1f, 10);
+		if (i & 1)
+			s.x = -s.x; // mirrored
+
+		// inverseAffine of a TRS matrix
+		mat4 m = trsMat(t, q, s);
+		dmat4 dm = dmat4(m);
+		dmat4 reference = inverse(dm);
+		double condition = maxNorm(dm) * maxNorm(reference);
+		mat4 sse = inverseAffine(m);
+		affine.add(inverseError(sse, reference, condition), inverseError(inverseAffine<float>(m), reference, condition));
+		CHECK(hasAffineBottomRow(sse), "inverseAffine bottom row");
+
+		// inverseAffine of a general affine matrix with shear
+		mat4 a = m;
+		for (int c = 0; c < 3; ++c)
+			a.col[c] += vec4(randomVec3(&rng, -1, 1), 0);
+		dmat4 da = dmat4(a);
+		dmat4 aReference = inverse(da);
+		double aCondition = maxNorm(da) * maxNorm(aReference);
+		sse = inverseAffine(a);
+		sheared.add(inverseError(sse, aReference, aCondition), inverseError(inverseAffine<float>(a), aReference, aCondition));
+		CHECK(hasAffineBottomRow(sse), "inverseAffine (sheared) bottom row");
+
+		// inverseTRS straight from the decomposed transform; the reference inverts the
+		// double precision TRS matrix so that the float matrix's rounding doesn't count
+		dmat4 dtrs = trsMat(dvec3(t), dquat(q.x, q.y, q.z, q.w), dvec3(s));
+		dmat4 trsReference = inverse(dtrs);
+		double trsCondition = maxNorm(dtrs) * maxNorm(trsReference);
+		sse = inverseTRS(t, q, s);
+		trs.add(inverseError(sse, trsReference, trsCondition), inverseError(inverseTRS<float>(t, q, s), trsReference, trsCondition));
+		CHECK(hasAffineBottomRow(sse), "inverseTRS bottom row");
+
+		// inverseRigid of a rotation and translation, with garbage in w that must be ignored
+		mat4 r = trsMat(t, q, vec3(1, 1, 1));
+		dmat4 dr = dmat4(r);
+		dmat4 rReference = inverse(dr);
+		double rCondition = maxNorm(dr) * maxNorm(rReference);
+		mat4 dirty = r;
+		dirty.col[0].w = 3;
+		dirty.col[1].w = -2;
+		dirty.col[2].w = 7;
+		sse = inverseRigid(dirty);
+		rigid.add(inverseError(sse, rReference, rCondition), inverseError(inverseRigid<float>(r), rReference, rCondition));
+		CHECK(hasAffineBottomRow(sse), "inverseRigid bottom row");
+	}
+
+	report("inverseAffine", affine, 4);
+	report("  sheared", sheared, 4);
+	report("inverseTRS", trs, 4);
+	report("inverseRigid", rigid, 4);
+
+	// exact cases
+	mat4 translation = translationMat(vec3(1, -2, 4));
+	mat4 it = inverseAffine(translation);
+	mat4 ir = inverseRigid(translation);
+	mat4 itrs = inverseTRS(vec3(1, -2, 4), quat(0, 0, 0, 1), vec3(2, 4, 0.5f));
+	CHECK(all(it.col[3] == vec4(-1, 2, -4, 1)), "inverseAffine(translation)");
+	CHECK(all(ir.col[3] == vec4(-1, 2, -4, 1)), "inverseRigid(translation)");
+	CHECK(all(itrs.col[0] == vec4(0.5f, 0, 0, 0)) && all(itrs.col[2] == vec4(0, 0, 2, 0)) && all(itrs.col[3] == vec4(-0.5f, 0.5f, -8, 1)), "inverseTRS(translation, scale)");
+
+	if (failures)
+		printf("%d checks failed\n", failures);
+	else
+		printf("all passed\n");
+	return failures != 0;
+}
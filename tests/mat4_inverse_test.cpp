@@ -0,0 +1,141 @@
+/*
+  Compares the SSE versions of inverse(mat4) and determinant(mat4) against the scalar
+  template versions, using a double precision inverse as the reference. The SSE versions
+  use a different (2x2 block) formula, so they aren't bit-identical, but they must not be
+  noticeably less accurate. Returns 0 when everything passes.
+
+    g++ -O2 -DBMATH_SIMD -I.. mat4_inverse_test.cpp -o mat4_inverse_test && ./mat4_inverse_test
+*/
+
+#include "test.h"
+#include <cfloat>
+
+#ifndef BMATH_SIMD
+#	error "compile with -DBMATH_SIMD, otherwise there is nothing to compare"
+#endif
+
+static mat4 randomMatrix(RNG *rng, float min, float max) {
+	mat4 m;
+	for (int c = 0; c < 4; ++c)
+		for (int r = 0; r < 4; ++r)
+			m.col[c][r] = randUniform(rng, min, max);
+	return m;
+}
+
+static double maxNorm(dmat4 m) {
+	double norm = 0;
+	for (int r = 0; r < 4; ++r)
+		norm = max(norm, abs(m.col[0][r]) + abs(m.col[1][r]) + abs(m.col[2][r]) + abs(m.col[3][r]));
+	return norm;
+}
+
+// Largest error relative to the largest element of the reference, divided by the
+// condition number, in units of FLT_EPSILON. Any inverse computed in float can be off
+// by about eps * condition number, so this doesn't grow for nearly singular matrices.
+static double inverseError(mat4 m, dmat4 reference, double condition) {
+	double scale = 0, worst = 0;
+	for (int c = 0; c < 4; ++c)
+		for (int r = 0; r < 4; ++r) {
+			scale = max(scale, abs(reference.col[c][r]));
+			worst = max(worst, abs(m.col[c][r] - reference.col[c][r]));
+		}
+	return worst / scale / condition / FLT_EPSILON;
+}
+
+static double determinantError(float d, double reference, dmat4 m) {
+	// relative to the size of the products that are summed, since the determinant
+	// itself can be arbitrarily small through cancellation
+	double scale = 1;
+	for (int c = 0; c < 4; ++c) {
+		double length = 0;
+		for (int r = 0; r < 4; ++r)
+			length += m.col[c][r] * m.col[c][r];
+		scale *= sqrt(length);
+	}
+	return abs(d - reference) / scale / FLT_EPSILON;
+}
+
+struct errorStats {
+	double sse, scalar;
+	void add(double sseError, double scalarError) {
+		sse = max(sse, sseError);
+		scalar = max(scalar, scalarError);
+	}
+};
+
+static void compare(mat4 m, errorStats *inv, errorStats *det) {
+	dmat4 dm = dmat4(m);
+	dmat4 reference = inverse(dm);
+	double condition = maxNorm(dm) * maxNorm(reference);
+	inv->add(inverseError(inverse(m), reference, condition), inverseError(inverse<float>(m), reference, condition));
+	double d = determinant(dm);
+	det->add(determinantError(determinant(m), d, dm), determinantError(determinant<float>(m), d, dm));
+}
+
+static void report(const char *name, errorStats inv, errorStats det, double invLimit, double detLimit) {
+	printf("%-16s inverse: sse %6.2f scalar %6.2f eps   determinant: sse %5.2f scalar %5.2f eps\n", name, inv.sse, inv.scalar, det.sse, det.scalar);
+	CHECK(inv.sse <= invLimit, "%s inverse error %g eps > %g", name, inv.sse, invLimit);
+	CHECK(det.sse <= detLimit, "%s determinant error %g eps > %g", name, det.sse, detLimit);
+	// not much worse than the scalar path either
+	CHECK(inv.sse <= 2 * inv.scalar + 4, "%s inverse error %g eps vs scalar %g", name, inv.sse, inv.scalar);
+	CHECK(det.sse <= 2 * det.scalar + 4, "%s determinant error %g eps vs scalar %g", name, det.sse, det.scalar);
+}
+
+int main() {
+	RNG rng = seedRNG(1234);
+
+	// well conditioned random matrices
+	errorStats inv = {}, det = {};
+	for (int i = 0; i < 200000; ++i)
+		compare(randomMatrix(&rng, -1, 1) + mat4(2.0f), &inv, &det);
+	report("random", inv, det, 4, 8);
+
+	// random matrices, some of them badly conditioned
+	inv = errorStats(), det = errorStats();
+	for (int i = 0; i < 200000; ++i)
+		compare(randomMatrix(&rng, -1, 1), &inv, &det);
+	report("ill-conditioned", inv, det, 4, 8);
+
+	// transforms: translation, rotation and non-uniform scale
+	inv = errorStats(), det = errorStats();
+	for (int i = 0; i < 200000; ++i) {
+		vec3 t = vec3(randUniform(&rng, -100, 100), randUniform(&rng, -100, 100), randUniform(&rng, -100, 100));
+		vec3 s = vec3(randUniform(&rng, 0.1f, 10), randUniform(&rng, 0.1f, 10), randUniform(&rng, 0.1f, 10));
+		compare(trsMat(t, randomRotation(&rng), s), &inv, &det);
+	}
+	report("trs", inv, det, 4, 8);
+
+	// projections composed with a view
+	inv = errorStats(), det = errorStats();
+	for (int i = 0; i < 100000; ++i) {
+		float fov = randUniform(&rng, 0.3f, 2.5f);
+		float aspect = randUniform(&rng, 0.5f, 2);
+		float zNear = randUniform(&rng, 0.05f, 1);
+		vec3 eye = vec3(randUniform(&rng, -10, 10), randUniform(&rng, -10, 10), randUniform(&rng, -10, 10));
+		mat4 view = lookAtMat(eye, vec3(0, 0, 0), vec3(0, 1, 0));
+		compare(perspectiveMat(fov, aspect, zNear, 100.0f) * view, &inv, &det);
+	}
+	report("perspective", inv, det, 4, 8);
+
+	// exact cases
+	mat4 identity = mat4(1.0f);
+	mat4 i = inverse(identity);
+	for (int c = 0; c < 4; ++c)
+		CHECK(all(i.col[c] == identity.col[c]), "inverse(identity) column %d", c);
+	CHECK(determinant(identity) == 1, "determinant(identity)");
+	mat4 diagonal = mat4(vec4(2, 0, 0, 0), vec4(0, 4, 0, 0), vec4(0, 0, 0.5f, 0), vec4(0, 0, 0, -8));
+	mat4 di = inverse(diagonal);
+	CHECK(di.col[0].x == 0.5f && di.col[1].y == 0.25f && di.col[2].z == 2 && di.col[3].w == -0.125f, "inverse(diagonal)");
+	CHECK(determinant(diagonal) == -32, "determinant(diagonal)");
+
+	// a singular matrix has determinant 0 on both paths
+	mat4 singular = randomMatrix(&rng, -1, 1);
+	singular.col[2] = singular.col[0] * 2.0f;
+	CHECK(abs(determinant(singular)) <= 1e-6f && abs(determinant<float>(singular)) <= 1e-6f, "determinant(singular) = %g, %g", determinant(singular), determinant<float>(singular));
+
+	if (failures)
+		printf("%d checks failed\n", failures);
+	else
+		printf("all passed\n");
+	return failures != 0;
+}
@@ -0,0 +1,228 @@
+/*
+  Round-trip tests for the packing functions in bmath.hpp: the unorm/snorm formats,
+  octahedral directions and the compressed quaternions, including the array versions.
+  Returns 0 when everything passes.
+
+    g++ -O2 -I.. pack_test.cpp -o pack_test && ./pack_test
+*/
+
+#include "test.h"
+
+#if __cplusplus >= 201103L || (defined _MSVC_LANG && _MSVC_LANG >= 201103L)
+static_assert(packUnorm4x8(vec4(0, 1, 0.5f, 2)) == 0xFF80FF00u, "packUnorm4x8");
+static_assert(packSnorm2x8(vec2(-1, 1)) == 0x7F81, "packSnorm2x8");
+static_assert(packSnorm3x10_1x2(vec4(0, -0.5f, 1, -1)) == 0xDFFC0000u, "packSnorm3x10_1x2");
+static_assert(unpackSnorm2x16(0x80007FFFu).x == 1 && unpackSnorm2x16(0x80007FFFu).y == -1, "unpackSnorm2x16");
+#endif
+
+static float randomFloat(RNG *rng, float min, float max) {
+	return randUniform(rng, min, max);
+}
+
+static vec4 randomVec4(RNG *rng, float min, float max) {
+	return vec4(randomFloat(rng, min, max), randomFloat(rng, min, max), randomFloat(rng, min, max), randomFloat(rng, min, max));
+}
+
+static vec3 randomDirection(RNG *rng) {
+	vec3 v;
+	do v = vec3(randGaussian(rng, 0, 1), randGaussian(rng, 0, 1), randGaussian(rng, 0, 1));
+	while (dot(v, v) < 1e-6f);
+	return normalize(v);
+}
+
+// Angle between two directions, in double so that tiny angles aren't lost.
+static double angleBetween(vec3 a, vec3 b) {
+	double cx = (double)a.y * b.z - (double)a.z * b.y;
+	double cy = (double)a.z * b.x - (double)a.x * b.z;
+	double cz = (double)a.x * b.y - (double)a.y * b.x;
+	double d = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+	return atan2(sqrt(cx * cx + cy * cy + cz * cz), d);
+}
+
+// Rotation angle between two unit quaternions, q and -q being the same rotation.
+static double rotationAngle(quat a, quat b) {
+	double d = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z + (double)a.w * b.w;
+	double s = 0;
+	for (int i = 0; i < 4; ++i) {
+		double e = (double)a[i] - (d < 0 ? -1.0 : 1.0) * b[i];
+		s += e * e;
+	}
+	// |a - b| = 2 sin(angle / 4) for unit quaternions
+	double half = sqrt(s) * 0.5;
+	return 4 * asin(half < 1 ? half : 1);
+}
+
+// Packs and unpacks N random components, some outside the valid range to test clamping,
+// and checks the error is within half a step. The 16 bit formats are a little over, as
+// x * 65535 is rounded to float before it is rounded to a step.
+#define ROUND_TRIP(pack, unpack, N, bits, lo, step)\
+	for (int i = 0; i < 100000; ++i) {\
+		vec4 v4 = randomVec4(&rng, lo - 0.25f, 1.25f);\
+		vector<float, N> v;\
+		for (int k = 0; k < N; ++k)\
+			v[k] = v4[k];\
+		vector<float, N> r = unpack(pack(v));\
+		for (int k = 0; k < N; ++k) {\
+			int b = (N == 4 && bits == 10 && k == 3) ? 2 : bits;\
+			float s = step(b);\
+			float expected = clamp(v[k], lo, 1.0f);\
+			CHECK(abs(r[k] - expected) <= 0.5f * s * 1.01f, #pack " %.9g -> %.9g", v[k], r[k]);\
+		}\
+	}
+
+static float unormStep(int bits) {
+	return 1.0f / float((1u << bits) - 1);
+}
+
+static float snormStep(int bits) {
+	return 1.0f / float((1u << (bits - 1)) - 1);
+}
+
+static void testUnormSnorm(RNG &rng) {
+	ROUND_TRIP(packUnorm2x8,      unpackUnorm2x8,      2, 8,  0.0f, unormStep)
+	ROUND_TRIP(packUnorm3x8,      unpackUnorm3x8,      3, 8,  0.0f, unormStep)
+	ROUND_TRIP(packUnorm4x8,      unpackUnorm4x8,      4, 8,  0.0f, unormStep)
+	ROUND_TRIP(packUnorm3x10,     unpackUnorm3x10,     3, 10, 0.0f, unormStep)
+	ROUND_TRIP(packUnorm3x10_1x2, unpackUnorm3x10_1x2, 4, 10, 0.0f, unormStep)
+	ROUND_TRIP(packUnorm2x16,     unpackUnorm2x16,     2, 16, 0.0f, unormStep)
+	ROUND_TRIP(packUnorm3x16,     unpackUnorm3x16,     3, 16, 0.0f, unormStep)
+	ROUND_TRIP(packUnorm4x16,     unpackUnorm4x16,     4, 16, 0.0f, unormStep)
+	ROUND_TRIP(packSnorm2x8,      unpackSnorm2x8,      2, 8,  -1.0f, snormStep)
+	ROUND_TRIP(packSnorm3x8,      unpackSnorm3x8,      3, 8,  -1.0f, snormStep)
+	ROUND_TRIP(packSnorm4x8,      unpackSnorm4x8,      4, 8,  -1.0f, snormStep)
+	ROUND_TRIP(packSnorm3x10,     unpackSnorm3x10,     3, 10, -1.0f, snormStep)
+	ROUND_TRIP(packSnorm3x10_1x2, unpackSnorm3x10_1x2, 4, 10, -1.0f, snormStep)
+	ROUND_TRIP(packSnorm2x16,     unpackSnorm2x16,     2, 16, -1.0f, snormStep)
+	ROUND_TRIP(packSnorm3x16,     unpackSnorm3x16,     3, 16, -1.0f, snormStep)
+	ROUND_TRIP(packSnorm4x16,     unpackSnorm4x16,     4, 16, -1.0f, snormStep)
+
+	// The endpoints and 0 are exact.
+	CHECK(all(unpackUnorm4x8(packUnorm4x8(vec4(0, 1, 0, 1))) == vec4(0, 1, 0, 1)), "unorm endpoints");
+	CHECK(all(unpackSnorm4x16(packSnorm4x16(vec4(-1, 0, 1, -0.0f))) == vec4(-1, 0, 1, 0)), "snorm endpoints");
+	CHECK(all(unpackSnorm3x10_1x2(packSnorm3x10_1x2(vec4(-1, 0, 1, -1))) == vec4(-1, 0, 1, -1)), "snorm 2 bit endpoints");
+
+	// Every code unpacks to a value that packs back to the same code. The most negative
+	// snorm code is the exception: it also means -1, which packs to the code above it.
+	for (uint p = 0; p < 0x10000u; ++p) {
+		CHECK(packUnorm2x8(unpackUnorm2x8((unsigned short)p)) == p, "unorm 2x8 code %x", p);
+		unsigned short s = packSnorm2x8(unpackSnorm2x8((unsigned short)p));
+		uint expected = p;
+		if ((p & 0xFF) == 0x80) expected += 1;
+		if ((p >> 8) == 0x80) expected += 0x100;
+		CHECK(s == expected, "snorm 2x8 code %x -> %x", p, (uint)s);
+	}
+	for (uint p = 0; p < 0x10000u; ++p) {
+		uint u = p | p << 16;
+		CHECK(packUnorm2x16(unpackUnorm2x16(u)) == u, "unorm 2x16 code %x", u);
+		uint expected = p == 0x8000 ? 0x80018001u : u;
+		CHECK(packSnorm2x16(unpackSnorm2x16(u)) == expected, "snorm 2x16 code %x", u);
+	}
+	for (uint p = 0; p < 1024; ++p) {
+		uint u = p | (1023 - p) << 10 | p << 20 | (p & 3) << 30;
+		CHECK(packUnorm3x10_1x2(unpackUnorm3x10_1x2(u)) == u, "unorm 3x10_1x2 code %x", u);
+	}
+}
+
+static void testOctahedral(RNG &rng) {
+	double max8 = 0, max16 = 0;
+	for (int i = 0; i < 1000000; ++i) {
+		vec3 d = randomDirection(&rng);
+		max8 = max(max8, angleBetween(d, unpackOctahedral2x8(packOctahedral2x8(d))));
+		max16 = max(max16, angleBetween(d, unpackOctahedral2x16(packOctahedral2x16(d))));
+		// the direction doesn't have to be normalized
+		vec3 r = unpackOctahedral2x16(packOctahedral2x16(d * 7.5f));
+		CHECK(angleBetween(d, r) <= 6.6e-5, "octahedral 2x16 of a scaled direction");
+	}
+	CHECK(max8 <= 1.7e-2, "octahedral 2x8 max error %g rad", max8);
+	CHECK(max16 <= 6.6e-5, "octahedral 2x16 max error %g rad", max16);
+
+	// The axes and the octahedron's edges and corners are exact.
+	vec3 exact[] = {
+		vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1),
+	};
+	for (size_t i = 0; i < sizeof exact / sizeof exact[0]; ++i) {
+		CHECK(all(unpackOctahedral2x8(packOctahedral2x8(exact[i])) == exact[i]), "octahedral 2x8 axis %d", (int)i);
+		CHECK(all(unpackOctahedral2x16(packOctahedral2x16(exact[i])) == exact[i]), "octahedral 2x16 axis %d", (int)i);
+	}
+	printf("octahedral   2x8 %.3g rad   2x16 %.3g rad\n", max8, max16);
+}
+
+static void testQuaternions(RNG &rng) {
+	double max32 = 0, max48 = 0, max64 = 0;
+	for (int i = 0; i < 1000000; ++i) {
+		quat q = randomRotation(&rng);
+		max32 = max(max32, rotationAngle(q, unpackQuat32(packQuat32(q))));
+		max48 = max(max48, rotationAngle(q, unpackQuat48(packQuat48(q))));
+		max64 = max(max64, rotationAngle(q, unpackQuat64(packQuat64(q))));
+	}
+	CHECK(max32 <= 4.4e-3, "quat32 max error %g rad", max32);
+	CHECK(max48 <= 1.5e-4, "quat48 max error %g rad", max48);
+	CHECK(max64 <= 5e-6, "quat64 max error %g rad", max64);
+
+	// Identity, negated identity, and ties for the largest component.
+	quat special[] = {
+		quat(0, 0, 0, 1), quat(0, 0, 0, -1), quat(1, 0, 0, 0), quat(0, -1, 0, 0),
+		quat(0.5f, 0.5f, 0.5f, 0.5f), quat(-0.5f, 0.5f, -0.5f, 0.5f),
+		quat(0.707106781f, 0, 0, 0.707106781f), quat(0, -0.707106781f, 0.707106781f, 0),
+	};
+	for (size_t i = 0; i < sizeof special / sizeof special[0]; ++i) {
+		quat q = special[i];
+		CHECK(rotationAngle(q, unpackQuat32(packQuat32(q))) <= 4.4e-3, "quat32 special %d", (int)i);
+		CHECK(rotationAngle(q, unpackQuat48(packQuat48(q))) <= 1.5e-4, "quat48 special %d", (int)i);
+		CHECK(rotationAngle(q, unpackQuat64(packQuat64(q))) <= 5e-6, "quat64 special %d", (int)i);
+	}
+	printf("quaternions  32 %.3g rad   48 %.3g rad   64 %.3g rad\n", max32, max48, max64);
+}
+
+// The array versions must give the same results as the single value versions,
+// including the tightly stored 3-word formats.
+static void testArrays(RNG &rng) {
+	const size_t count = 1001;
+	static vec3 v3[count], r3[count];
+	static quat q[count], rq[count];
+	static unsigned char bytes[3 * count];
+	static unsigned short shorts[3 * count];
+	static uint words[count];
+	for (size_t i = 0; i < count; ++i) {
+		v3[i] = vec3(randomVec4(&rng, -1, 1));
+		q[i] = randomRotation(&rng);
+	}
+
+	packSnorm3x8(v3, bytes, count);
+	unpackSnorm3x8(bytes, r3, count);
+	for (size_t i = 0; i < count; ++i) {
+		uint p = packSnorm3x8(v3[i]);
+		CHECK(bytes[3 * i] == (p & 0xFF) && bytes[3 * i + 1] == ((p >> 8) & 0xFF) && bytes[3 * i + 2] == (p >> 16), "packSnorm3x8 array %d", (int)i);
+		CHECK(all(r3[i] == unpackSnorm3x8(p)), "unpackSnorm3x8 array %d", (int)i);
+	}
+
+	packUnorm3x16(v3, shorts, count);
+	unpackUnorm3x16(shorts, r3, count);
+	for (size_t i = 0; i < count; ++i)
+		CHECK(all(r3[i] == unpackUnorm3x16(packUnorm3x16(v3[i]))), "unorm 3x16 array %d", (int)i);
+
+	packQuat48(q, shorts, count);
+	unpackQuat48(shorts, rq, count);
+	for (size_t i = 0; i < count; ++i) {
+		quat r = unpackQuat48(packQuat48(q[i]));
+		CHECK(rq[i].x == r.x && rq[i].y == r.y && rq[i].z == r.z && rq[i].w == r.w, "quat48 array %d", (int)i);
+	}
+
+	packOctahedral2x16(v3, words, count);
+	unpackOctahedral2x16(words, r3, count);
+	for (size_t i = 0; i < count; ++i)
+		CHECK(words[i] == packOctahedral2x16(v3[i]) && all(r3[i] == unpackOctahedral2x16(words[i])), "octahedral array %d", (int)i);
+}
+
+int main() {
+	RNG rng = seedRNG(1234);
+	testUnormSnorm(rng);
+	testOctahedral(rng);
+	testQuaternions(rng);
+	testArrays(rng);
+	if (failures)
+		printf("%d checks failed\n", failures);
+	else
+		printf("all passed\n");
+	return failures != 0;
+}
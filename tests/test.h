@@ -0,0 +1,43 @@
+/*
+  Shared by the tests in this directory, each of which is a single source file that
+  includes this first: the CHECK macro, the failure count it keeps, and random inputs
+  that more than one test needs. Compile with the bmath.hpp options under test defined
+  on the command line.
+*/
+
+#ifndef BMATH_TEST_H
+#define BMATH_TEST_H
+
+#define B_RNG_IMPLEMENTATION
+#include "bmath.hpp"
+#include "brng.h"
+#include <cstdio>
+
+static int failures = 0;
+
+// Counts a failure and prints the first 20, with a printf style message.
+#define CHECK(condition, ...)\
+	do {\
+		if (!(condition)) {\
+			if (failures < 20) {\
+				printf("FAIL %s:%d: ", __FILE__, __LINE__);\
+				printf(__VA_ARGS__);\
+				printf("\n");\
+			}\
+			++failures;\
+		}\
+	} while (0)
+
+// Uniformly distributed rotation: a normalized 4D gaussian, redrawn when it's too
+// short to normalize accurately.
+static inline quat randomRotation(RNG *rng) {
+	quat q;
+	float length2;
+	do {
+		q = quat(randGaussian(rng, 0, 1), randGaussian(rng, 0, 1), randGaussian(rng, 0, 1), randGaussian(rng, 0, 1));
+		length2 = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+	} while (length2 < 1e-6f);
+	return normalize(q);
+}
+
+#endif
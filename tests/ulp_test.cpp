@@ -0,0 +1,375 @@
+/*
+  Accuracy harness: runs the approximated and SIMD math functions of bmath.hpp over a
+  million random inputs each, plus edge cases (0, -0, denormals, FLT_MAX, inf, NaN), and
+  compares them against the C library in double precision (long double for the double
+  functions). For each function it reports the maximum and mean error in ulp, the
+  largest absolute error, and the inputs where NaN or infinity came out differently
+  from the reference. Fails when a function goes over its own threshold below.
+
+  Build it in every configuration the fast paths can be enabled in:
+
+    g++ -O2 -I.. ulp_test.cpp -o ulp_test && ./ulp_test
+    g++ -O2 -DBMATH_SIMD -I.. ulp_test.cpp -o ulp_test && ./ulp_test
+    g++ -O2 -DBMATH_SIMD -DBMATH_SIMD_MATH -I.. ulp_test.cpp -o ulp_test && ./ulp_test
+    g++ -O2 -DBMATH_SIMD -DBMATH_SIMD_MATH -mavx2 -mfma -I.. ulp_test.cpp -o ulp_test && ./ulp_test
+
+  Without BMATH_SIMD the fast versions are the precise ones, and without BMATH_SIMD_MATH
+  the precise ones call the C library, so those pass with room to spare.
+*/
+
+#include "test.h"
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+static const int SAMPLES = 1 << 20;
+
+// Error statistics of one function against its reference. A result is within the
+// threshold when it's at most maxUlps * scale ulp from the correctly rounded reference,
+// or at most maxAbs from the exact one (for the functions that have an absolute error
+// bound, like sin near its zeros). scale is for errors that grow with the input, like pow.
+template<class T, class Reference>
+struct ulpStats {
+	const char *name;
+	double maxUlps;
+	double maxAbs;
+	unsigned long long worstUlps;
+	double sumUlps;
+	double worstAbs;
+	size_t count;
+	size_t overThreshold;
+	size_t nanInfMismatches;
+	T worstX, worstY;
+	T mismatchX, mismatchY;
+	T mismatchResult;
+
+	ulpStats(const char *name, double maxUlps, double maxAbs = 0)
+		: name(name), maxUlps(maxUlps), maxAbs(maxAbs), worstUlps(0), sumUlps(0), worstAbs(0),
+		count(0), overThreshold(0), nanInfMismatches(0), worstX(0), worstY(0), mismatchX(0), mismatchY(0), mismatchResult(0) {}
+
+	void add(T result, Reference reference, T x, T y = 0, double scale = 1) {
+		T expected = T(reference);
+		bool mismatch;
+		if (reference != reference)
+			mismatch = result == result;
+		else if (expected - expected != 0) // infinite
+			mismatch = result != expected;
+		else
+			mismatch = result - result != 0; // NaN or infinite
+		if (mismatch) {
+			if (nanInfMismatches == 0) {
+				mismatchX = x;
+				mismatchY = y;
+				mismatchResult = result;
+			}
+			++nanInfMismatches;
+			return;
+		}
+		if (reference != reference || expected - expected != 0)
+			return;
+
+		unsigned long long ulps = ulpDistance(result, expected);
+		double error = double(abs(Reference(result) - reference));
+		++count;
+		sumUlps += double(ulps);
+		if (ulps > worstUlps) {
+			worstUlps = ulps;
+			worstX = x;
+			worstY = y;
+		}
+		if (error > worstAbs)
+			worstAbs = error;
+		if (!ulpEqual(result, expected, (unsigned long long)(maxUlps * scale)) && error > maxAbs)
+			++overThreshold;
+	}
+
+	void report() {
+		printf("%-24s max %6llu ulp  mean %6.3f ulp  max abs %9.3g  (worst at %g, %g)",
+			name, worstUlps, count ? sumUlps / double(count) : 0.0, worstAbs, double(worstX), double(worstY));
+		if (nanInfMismatches)
+			printf("  %zu NaN/inf mismatches (first: f(%g, %g) = %g)", nanInfMismatches, double(mismatchX), double(mismatchY), double(mismatchResult));
+		printf("\n");
+		CHECK(overThreshold == 0, "%s: %zu results over %g ulp / %g abs", name, overThreshold, maxUlps, maxAbs);
+		CHECK(nanInfMismatches == 0, "%s: %zu NaN/inf mismatches", name, nanInfMismatches);
+	}
+};
+
+typedef ulpStats<float, double> floatStats;
+typedef ulpStats<double, long double> doubleStats;
+
+static const float edgeCases[] = {
+	0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 2.0f, 1e-40f, -1e-40f, FLT_MIN, -FLT_MIN,
+	1.5707964f, 3.1415927f, -3.1415927f, 6.2831855f, 100.0f, -100.0f, 88.0f, -87.0f,
+	1e-20f, 1e20f, FLT_MAX, -FLT_MAX, float(HUGE_VAL), -float(HUGE_VAL), float(NAN),
+};
+static const int EDGE_CASES = sizeof edgeCases / sizeof edgeCases[0];
+
+// A float with random bits: every binade is equally likely, including denormals.
+static float randomBits(RNG *rng, bool negative) {
+	for (;;) {
+		uint bits = randu(rng) & 0x7FFFFFFF;
+		if (bits < 0x7F800000) {
+			bits |= negative ? 0x80000000 : 0;
+			float f;
+			memcpy(&f, &bits, sizeof f);
+			return f;
+		}
+	}
+}
+
+static bool inDomain(float f, float min, float max) {
+	return f != f || f - f != 0 || (f >= min && f <= max);
+}
+
+// Random inputs to test a function on: x in [min, max] (and y in [minY, maxY]), and
+// every fourth one with random bits within the same range to also cover the tiny ones.
+// The edge cases are only used when they're in the range too, or infinite or NaN -
+// the functions are only meant to be accurate within their range, but they should
+// still get the infinities and NaNs right.
+struct inputs {
+	float x[SAMPLES + EDGE_CASES * EDGE_CASES];
+	float y[SAMPLES + EDGE_CASES * EDGE_CASES];
+	int count;
+
+	void generate(RNG *rng, float min, float max, float minY = 0, float maxY = 0, bool edges = true) {
+		count = 0;
+		for (int i = 0; edges && i < EDGE_CASES; ++i)
+			for (int j = 0; j < EDGE_CASES; ++j) {
+				bool binary = minY != maxY;
+				if (!inDomain(edgeCases[i], min, max) || (binary && !inDomain(edgeCases[j], minY, maxY)))
+					continue;
+				x[count] = edgeCases[i];
+				y[count] = binary ? edgeCases[j] : 0;
+				++count;
+				if (!binary)
+					break;
+			}
+		for (int i = 0; i < SAMPLES; ++i) {
+			float fx = randUniform(rng, min, max);
+			float fy = randUniform(rng, minY, maxY);
+			if (i % 4 == 3) {
+				float bits = randomBits(rng, fx < 0);
+				if (bits >= min && bits <= max)
+					fx = bits;
+			}
+			x[count] = fx;
+			y[count] = fy;
+			++count;
+		}
+		while (count % 4)
+			x[count] = y[count] = 1, ++count;
+	}
+};
+
+// f(vec4) for 4 inputs at a time, so that the SIMD versions are the ones that run.
+#define TEST_UNARY(stats, in, f, reference) \
+	for (int i = 0; i < (in).count; i += 4) { \
+		vec4 v = vec4((in).x[i], (in).x[i + 1], (in).x[i + 2], (in).x[i + 3]); \
+		vec4 r = f(v); \
+		for (int k = 0; k < 4; ++k) \
+			(stats).add(r[k], reference(double(v[k])), v[k]); \
+	}
+
+#define TEST_BINARY(stats, in, f, reference, scale) \
+	for (int i = 0; i < (in).count; i += 4) { \
+		vec4 v = vec4((in).x[i], (in).x[i + 1], (in).x[i + 2], (in).x[i + 3]); \
+		vec4 w = vec4((in).y[i], (in).y[i + 1], (in).y[i + 2], (in).y[i + 3]); \
+		vec4 r = f(v, w); \
+		for (int k = 0; k < 4; ++k) \
+			(stats).add(r[k], reference(double(v[k]), double(w[k])), v[k], w[k], scale(double(v[k]), double(w[k]))); \
+	}
+
+static double noScale(double, double) {
+	return 1;
+}
+
+// pow is exp(y * log(x)), so the relative error of log(x) is multiplied by y * log(x)
+static double powScale(double x, double y) {
+	double s = 1 + std::abs(y * std::log(x));
+	return s == s ? s : 1;
+}
+
+static double scalarSin(double x) { return std::sin(x); }
+static double scalarCos(double x) { return std::cos(x); }
+static double scalarTan(double x) { return std::tan(x); }
+static double scalarExp(double x) { return std::exp(x); }
+static double scalarLog(double x) { return std::log(x); }
+static double scalarExp2(double x) { return std::exp2(x); }
+static double scalarLog2(double x) { return std::log2(x); }
+static double scalarSqrt(double x) { return std::sqrt(x); }
+static double scalarRcp(double x) { return 1 / x; }
+static double scalarInverseSqrt(double x) { return 1 / std::sqrt(x); }
+static double scalarAtan2(double y, double x) { return std::atan2(y, x); }
+static double scalarPow(double x, double y) { return std::pow(x, y); }
+
+static vec4 vecSin(vec4 v) { return sin(v); }
+static vec4 vecCos(vec4 v) { return cos(v); }
+static vec4 vecTan(vec4 v) { return tan(v); }
+static vec4 vecExp(vec4 v) { return exp(v); }
+static vec4 vecLog(vec4 v) { return log(v); }
+static vec4 vecExp2(vec4 v) { return exp2(v); }
+static vec4 vecLog2(vec4 v) { return log2(v); }
+static vec4 vecSqrt(vec4 v) { return sqrt(v); }
+static vec4 vecAtan2(vec4 y, vec4 x) { return atan2(y, x); }
+static vec4 vecPow(vec4 x, vec4 y) { return pow(x, y); }
+static vec4 vecFastSin(vec4 v) { return fastSin(v); }
+static vec4 vecFastCos(vec4 v) { return fastCos(v); }
+static vec4 vecFastTan(vec4 v) { return fastTan(v); }
+static vec4 vecFastExp(vec4 v) { return fastExp(v); }
+static vec4 vecFastLog(vec4 v) { return fastLog(v); }
+static vec4 vecFastAtan2(vec4 y, vec4 x) { return fastAtan2(y, x); }
+static vec4 vecFastPow(vec4 x, vec4 y) { return fastPow(x, y); }
+static vec4 vecFastRcp(vec4 v) { return fastRcp(v); }
+static vec4 vecFastInverseSqrt(vec4 v) { return vec4(fastInverseSqrt(v.x), fastInverseSqrt(v.y), fastInverseSqrt(v.z), fastInverseSqrt(v.w)); }
+
+static void testTranscendentals(RNG *rng, inputs *in) {
+	// (max ulp, max absolute error) - the documented accuracy in the header, with a
+	// little room for the rounding of the reference. A relative error e is up to
+	// e * 2^24 ulp, so 4.2e-6 for fastTan is 70 ulp.
+	floatStats sinStats("sin", 4, 1e-7), cosStats("cos", 4, 1e-7);
+	floatStats fastSinStats("fastSin", 4, 1.5e-6), fastCosStats("fastCos", 4, 1.5e-6);
+	in->generate(rng, -8192, 8192);
+	TEST_UNARY(sinStats, *in, vecSin, scalarSin)
+	TEST_UNARY(cosStats, *in, vecCos, scalarCos)
+	TEST_UNARY(fastSinStats, *in, vecFastSin, scalarSin)
+	TEST_UNARY(fastCosStats, *in, vecFastCos, scalarCos)
+	sinStats.report();
+	cosStats.report();
+	fastSinStats.report();
+	fastCosStats.report();
+
+	floatStats tanStats("tan", 16, 1e-7), fastTanStats("fastTan", 72);
+	in->generate(rng, -10, 10);
+	TEST_UNARY(tanStats, *in, vecTan, scalarTan)
+	TEST_UNARY(fastTanStats, *in, vecFastTan, scalarTan)
+	tanStats.report();
+	fastTanStats.report();
+
+	// exp flushes results below FLT_MIN to zero, which the absolute error allows for
+	floatStats expStats("exp", 1, FLT_MIN), exp2Stats("exp2", 1, FLT_MIN), fastExpStats("fastExp", 92, FLT_MIN);
+	in->generate(rng, -87.3f, 88.7f);
+	TEST_UNARY(expStats, *in, vecExp, scalarExp)
+	TEST_UNARY(exp2Stats, *in, vecExp2, scalarExp2)
+	TEST_UNARY(fastExpStats, *in, vecFastExp, scalarExp)
+	expStats.report();
+	exp2Stats.report();
+	fastExpStats.report();
+
+	// log over every positive float, including denormals
+	floatStats logStats("log", 1), log2Stats("log2", 1), fastLogStats("fastLog", 4, 7.5e-6), sqrtStats("sqrt", 0);
+	floatStats fastRcpStats("fastRcp", 4), fastInverseSqrtStats("fastInverseSqrt", 5);
+	in->generate(rng, 0, FLT_MAX);
+	TEST_UNARY(logStats, *in, vecLog, scalarLog)
+	TEST_UNARY(log2Stats, *in, vecLog2, scalarLog2)
+	TEST_UNARY(fastLogStats, *in, vecFastLog, scalarLog)
+	TEST_UNARY(sqrtStats, *in, vecSqrt, scalarSqrt)
+	logStats.report();
+	log2Stats.report();
+	fastLogStats.report();
+	sqrtStats.report();
+
+	// the estimates only work for normal floats whose reciprocal is normal too
+	in->generate(rng, -1e37f, 1e37f, 0, 0, false);
+	for (int i = 0; i < in->count; ++i)
+		if (std::abs(in->x[i]) < 1e-37f)
+			in->x[i] = 1;
+	TEST_UNARY(fastRcpStats, *in, vecFastRcp, scalarRcp)
+	for (int i = 0; i < in->count; ++i)
+		in->x[i] = std::abs(in->x[i]);
+	TEST_UNARY(fastInverseSqrtStats, *in, vecFastInverseSqrt, scalarInverseSqrt)
+	fastRcpStats.report();
+	fastInverseSqrtStats.report();
+
+	floatStats atan2Stats("atan2", 4), fastAtan2Stats("fastAtan2", 15);
+	in->generate(rng, -1000, 1000, -1000, 1000);
+	TEST_BINARY(atan2Stats, *in, vecAtan2, scalarAtan2, noScale)
+	TEST_BINARY(fastAtan2Stats, *in, vecFastAtan2, scalarAtan2, noScale)
+	atan2Stats.report();
+	fastAtan2Stats.report();
+
+	// pow only for positive bases, since it gives NaN for all negative ones
+	floatStats powStats("pow", 2), fastPowStats("fastPow", 220);
+	in->generate(rng, 1e-3f, 1e3f, -10, 10, false);
+	TEST_BINARY(powStats, *in, vecPow, scalarPow, powScale)
+	TEST_BINARY(fastPowStats, *in, vecFastPow, scalarPow, powScale)
+	powStats.report();
+	fastPowStats.report();
+}
+
+static void testVectors(RNG *rng) {
+	floatStats lengthStats("length(vec3)", 2), normalizeStats("normalize(vec3)", 3);
+	floatStats fastLengthStats("fastLength(vec3)", 6), fastNormalizeStats("fastNormalize(vec4)", 6);
+	floatStats fastInverseLengthStats("fastInverseLength(vec3)", 6);
+	floatStats fastQuatLengthStats("fastLength(quat)", 6), fastQuatNormalizeStats("fastNormalize(quat)", 6);
+	doubleStats dlengthStats("length(dvec3)", 2), dnormalizeStats("normalize(dvec3)", 3);
+	for (int i = 0; i < SAMPLES; ++i) {
+		float scale = std::pow(2.0f, randUniform(rng, -40, 40));
+		vec3 v = scale * vec3(randUniform(rng, -1, 1), randUniform(rng, -1, 1), randUniform(rng, -1, 1));
+		double exact = std::sqrt(double(v.x) * v.x + double(v.y) * v.y + double(v.z) * v.z);
+		if (exact == 0)
+			continue;
+		lengthStats.add(length(v), exact, v.x, v.y);
+		fastLengthStats.add(fastLength(v), exact, v.x, v.y);
+		fastInverseLengthStats.add(fastInverseLength(v), 1 / exact, v.x, v.y);
+		vec3 n = normalize(v);
+		for (int k = 0; k < 3; ++k)
+			normalizeStats.add(n[k], v[k] / exact, v.x, v.y);
+		vec4 w = vec4(v, randUniform(rng, -1, 1) * scale);
+		vec4 fn = fastNormalize(w);
+		double wLength = std::sqrt(exact * exact + double(w.w) * w.w);
+		for (int k = 0; k < 4; ++k)
+			fastNormalizeStats.add(fn[k], w[k] / wLength, w.x, w.y);
+		quat q = quat(w.x, w.y, w.z, w.w);
+		quat qn = fastNormalize(q);
+		fastQuatLengthStats.add(fastLength(q), wLength, q.x, q.y);
+		fastQuatNormalizeStats.add(qn.x, q.x / wLength, q.x, q.y);
+		fastQuatNormalizeStats.add(qn.y, q.y / wLength, q.x, q.y);
+		fastQuatNormalizeStats.add(qn.z, q.z / wLength, q.x, q.y);
+		fastQuatNormalizeStats.add(qn.w, q.w / wLength, q.x, q.y);
+
+		dvec3 d = dvec3(v) + dvec3(randUniform(rng, -1, 1), randUniform(rng, -1, 1), randUniform(rng, -1, 1)) * (double(scale) * 1e-9);
+		long double dexact = std::sqrt((long double)d.x * d.x + (long double)d.y * d.y + (long double)d.z * d.z);
+		dlengthStats.add(length(d), dexact, d.x, d.y);
+		dvec3 dn = normalize(d);
+		for (int k = 0; k < 3; ++k)
+			dnormalizeStats.add(dn[k], d[k] / dexact, d.x, d.y);
+	}
+	lengthStats.report();
+	normalizeStats.report();
+	fastLengthStats.report();
+	fastInverseLengthStats.report();
+	fastNormalizeStats.report();
+	fastQuatLengthStats.report();
+	fastQuatNormalizeStats.report();
+	dlengthStats.report();
+	dnormalizeStats.report();
+}
+
+static void testUlpFunctions() {
+	CHECK(ulpDistance(0.0f, -0.0f) == 0, "ulpDistance(0, -0)");
+	CHECK(ulpDistance(1.0f, std::nextafter(1.0f, 2.0f)) == 1, "ulpDistance(1, next)");
+	CHECK(ulpDistance(-FLT_MIN, FLT_MIN) == 2 * 0x00800000u, "ulpDistance(-FLT_MIN, FLT_MIN)");
+	CHECK(ulpDistance(FLT_MAX, float(HUGE_VAL)) == 1, "ulpDistance(FLT_MAX, inf)");
+	CHECK(ulpDistance(1.0f, float(NAN)) == 0xFFFFFFFFu, "ulpDistance(1, NaN)");
+	CHECK(ulpDistance(-1.0, std::nextafter(-1.0, 0.0)) == 1, "ulpDistance(-1.0, next)");
+	CHECK(ulpDistance(1.0, 2.0) == 1ull << 52, "ulpDistance(1.0, 2.0)");
+	CHECK(ulpEqual(1.0, 2.0, 1ull << 52) && !ulpEqual(1.0, 2.0, (1ull << 52) - 1), "ulpEqual with more than 2^32 ulp");
+	CHECK(!ulpEqual(1.0, 1e300, 0xFFFFFFFFull), "ulpEqual(1, 1e300)");
+	CHECK(all(ulpEqual(vec3(1, 2, 3), vec3(1, 2, std::nextafter(3.0f, 4.0f)), 1)), "ulpEqual(vec3) 1 ulp");
+	CHECK(!any(ulpEqual(vec2(1, 2), vec2(float(NAN), 3), 1000)), "ulpEqual(vec2) NaN");
+}
+
+static inputs in;
+
+int main() {
+	RNG rng = seedRNG(1234);
+	testUlpFunctions();
+	testTranscendentals(&rng, &in);
+	testVectors(&rng);
+
+	if (failures)
+		printf("%d checks failed\n", failures);
+	else
+		printf("all passed\n");
+	return failures != 0;
+}